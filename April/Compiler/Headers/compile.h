@@ -38,6 +38,7 @@ typedef struct {
   uniChar *out_name;
 
   int dLvl;                     // debugging level
+  int inlineSize;		/* largest function body to inline */
   logical noWarnings;
   logical preProcOnly;
   logical executable;
@@ -57,6 +58,7 @@ void assembleFile(ioPo inFile,ioPo outFile);
 #define MAXSTR 512		/* Default maximum size of a string var */
 #define MAXERRORS 16		/* Maximum number of errors reported */
 #define MAX_SYMB_LEN 512	/* Maximum length of a symbol */
+#define INLINESIZE 16		/* Default size of functions that are inlined */
 
 
 #ifndef NumberOf
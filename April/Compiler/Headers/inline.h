@@ -0,0 +1,7 @@
+#ifndef _INLINE_H_
+#define _INLINE_H_
+
+/* Interface to the inliner */
+void inlineProg(cellpo prog,int limit);
+
+#endif
@@ -395,6 +395,144 @@ int MaxDepth(cpo code)
     return 127;			/* illegal depth */
 }
 
+/* How many words does an instruction occupy? */
+static int insLength(instruction ins)
+{
+  char *opstr = opcodes[op_cde(ins)].opstr;
+  int len = 1;
+
+  for(;*opstr!='\0';opstr++)
+    if(*opstr=='x' || *opstr=='y') /* long references take a word each */
+      len++;
+  return len;
+}
+
+/*
+ * Peephole pass -- common pairs of instructions are fused into
+ * superinstructions. The second instruction of a pair stays where it is, so
+ * that a jump to it is still valid, and is executed by the superinstruction.
+ */
+static void fuseIns(cpo code)
+{
+  instruction *ins = code->cd->instr;
+  int pc = 3;
+
+  while(pc<code->pc){
+    int next = pc+insLength(ins[pc]);
+
+    if(next<code->pc){
+      opCode nxt = op_cde(ins[next]);
+      int fused = -1;
+
+      switch(op_cde(ins[pc])){
+      case ieq:
+	if(nxt==jmp)
+	  fused = ieqjmp;
+	break;
+      case ineq:
+	if(nxt==jmp)
+	  fused = ineqjmp;
+	break;
+      case ile:
+	if(nxt==jmp)
+	  fused = ilejmp;
+	break;
+      case igt:
+	if(nxt==jmp)
+	  fused = igtjmp;
+	break;
+      case mlist:
+	if(nxt==jmp)
+	  fused = mlistjmp;
+	break;
+      case movl:
+	if(nxt==esc_fun)
+	  fused = movlesc;
+	break;
+      case emove:
+	if(nxt==call)
+	  fused = emovecall;
+	break;
+      case lstpr:
+	if(nxt==lstpr)
+	  fused = lstprs;
+	break;
+      default:
+	break;
+      }
+
+      if(fused!=-1)
+	ins[pc] = (ins[pc]&~op_mask)|fused;
+    }
+    pc = next;
+  }
+}
+
+/*
+ * Is the call that ends before pc in tail position? It is if all that
+ * follows is to move its result, res, about -- perhaps with some jumps --
+ * and return it.
+ */
+static logical tailPosition(cpo code,int pc,int res,int arity,entrytype atype)
+{
+  instruction *ins = code->cd->instr;
+  int steps = 0;
+
+  while(pc>=3 && pc<code->pc && steps++<code->pc){ /* a loop of jumps? */
+    WORD32 i = ins[pc];
+
+    switch(op_cde(i)){
+    case move:
+      if(op_sm_val(i)==res)
+	res = op_sl_val(i);
+      else if(op_sl_val(i)==res)
+	return False;		/* the result has been overwritten */
+      pc++;
+      break;
+    case jmp:
+      pc += op_lo_val(i)+1;
+      break;
+    case result:
+      return atype==function && op_sm_val(i)==arity && op_sl_val(i)==res;
+    case ret:
+      return atype==procedure;
+    default:
+      return False;
+    }
+  }
+  return False;
+}
+
+/*
+ * Calls in tail position become tail calls. The code after a tail call
+ * stays: the engine makes an ordinary call when the frame has an error
+ * block in it.
+ */
+static void tailCalls(cpo code,int arity,entrytype atype)
+{
+  instruction *ins = code->cd->instr;
+  int pc = 3;
+
+  while(pc<code->pc){
+    WORD32 i = ins[pc];
+    int next = pc+insLength(i);
+
+    switch(op_cde(i)){
+    case call:
+      if(tailPosition(code,next,op_sh_val(i)+op_m_val(i)-1,arity,atype))
+	ins[pc] = (i&~op_mask)|tcall;
+      break;
+    case ecall:
+      if(tailPosition(code,next,op_sh_val(i)+op_m_val(i)-1,arity,atype))
+	ins[pc] = (i&~op_mask)|etcall;
+      break;
+    default:
+      break;
+    }
+    pc = next;
+  }
+}
+
 /* finish off a code segment */
 codepo CloseCode(cpo code,cellpo sig,cellpo freesig,entrytype atype)
 {
@@ -404,6 +542,9 @@ codepo CloseCode(cpo code,cellpo sig,cellpo freesig,entrytype atype)
   codepo cd = code->cd;
   lblpo lit=code->literals;
 
+  tailCalls(code,arity,atype);	/* before the calls are fused */
+  fuseIns(code);		/* form superinstructions */
+
   code->cd->size = code->pc;
   code->cd->lits = Next(allocTuple(code->cd->litcnt+2));
   code->cd->instr[0]=SIGNATURE; /* the universal code signature */
@@ -31,6 +31,7 @@
 #include "token.h"
 #include "macro.h"		/* access macro functions */
 #include "generate.h"
+#include "inline.h"		/* inline expansion */
 #include "assem.h"
 #include "ooio.h"
 
@@ -131,8 +132,10 @@ logical compile(ioPo inFile,ioPo outFile,optPo info)
       generalize(whichType(element,&tt,standardTypes,type,True),
 		 standardTypes,type);
 
-      if(!comperrflag)		/* only compile if no previous errors */
+      if(!comperrflag){		/* only compile if no previous errors */
+	inlineProg(element,info->inlineSize);
 	compileProg(element,global,outFile,info);
+      }
     }
     p_drop();
   }
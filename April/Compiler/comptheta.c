@@ -473,7 +473,8 @@ static logical compEqn(cellpo input,int arity,int srcvar,
       DefLabel(code,lX);
     }
 
-    compExp(rhs,info->rtype,info->dest,depth,&depth,ndict,dict,code,dLvl);
+    compExp(foldExp(rhs,rhs,ndict),info->rtype,info->dest,depth,&depth,ndict,dict,
+	    code,dLvl);
 
     if(!last||anyPresent)
       genIns(code,NULL,jmp,Next); /* we are done with the choice */
@@ -950,7 +951,7 @@ static logical assignComp(cellpo body,int temp,dictpo dict,cpo code,
     IsVar(fn,NULL,&type,NULL,NULL,NULL,NULL,NULL,dict);
 
     if(!IsFunLiteral(rhs) && !IsProcLiteral(rhs)){
-      compExp(rhs,type,&temp,depth,&depth,dict,dict,code,dLvl);
+      compExp(foldExp(rhs,rhs,dict),type,&temp,depth,&depth,dict,dict,code,dLvl);
 
       if(dLvl>0)
 	genVarDebug(code,depth,fn,type,temp,dict,dict);
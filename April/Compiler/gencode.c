@@ -40,14 +40,41 @@ typedef struct _label_ {
 } LabelRec;
 
 static void encodeInt(ioPo out,short tag,long val);
+static void encodeSym(ioPo out,symbpo sym);
 static labelPo collectTvars(cellpo input,labelPo chain);
 
 static void encode(ioPo out,cellpo input,labelPo chain,labelPo tvars);
 static void encodeType(ioPo out,cellpo input,labelPo chain,labelPo tvars);
 
+/*
+ * If icmDictionary is set, each symbol is written in full once and
+ * referred to by its index in the dictionary after that. Only engines
+ * that understand ICM dictionaries can load such files.
+ */
+logical icmDictionary = False;
+
+#define SYMDICTSIZE 256		/* Number of buckets in the dictionary */
+
+typedef struct _sym_entry_ *symEntryPo;
+typedef struct _sym_entry_ {
+  unsigned char *key;		/* the utf8 text of the symbol */
+  int len;
+  int ix;			/* its index in the dictionary */
+  symEntryPo next;
+} SymEntryRec;
+
+static symEntryPo *symDict = NULL; /* the dictionary while we are encoding */
+static int symCount = 0;
+
 void encodeICM(ioPo out,cellpo input)
 {
   labelPo tvars = collectTvars(input,NULL);
+
+  if(icmDictionary){
+    symDict = (symEntryPo*)calloc(SYMDICTSIZE,sizeof(symEntryPo));
+    symCount = 0;
+  }
+
   encode(out,input,NULL,tvars);
   
   while(tvars!=NULL){
@@ -56,6 +83,63 @@ void encodeICM(ioPo out,cellpo input)
     free(tvars);
     tvars = p;
   }
+
+  if(symDict!=NULL){
+    int i;
+
+    for(i=0;i<SYMDICTSIZE;i++){
+      while(symDict[i]!=NULL){
+	symEntryPo e = symDict[i];
+
+	symDict[i] = e->next;
+	free(e->key);
+	free(e);
+      }
+    }
+    free(symDict);
+    symDict = NULL;
+  }
+}
+
+static void encodeSym(ioPo out,symbpo sym)
+{
+  int len = uniStrLen(sym);
+  long uLen = len*4;
+  unsigned char buff[uLen];
+  int i;
+
+  len = uni_utf8(sym,uniStrLen(sym)+1,buff,uLen);
+
+  if(symDict!=NULL){
+    unsigned long h = 0;
+    symEntryPo e;
+
+    for(i=0;i<len;i++)
+      h = h*31+buff[i];
+    h = h%SYMDICTSIZE;
+
+    for(e=symDict[h];e!=NULL;e=e->next)
+      if(e->len==len && memcmp(e->key,buff,len)==0){
+	encodeInt(out,trmDictRef,e->ix);
+	return;
+      }
+
+    if(symCount<ICMDICTMAX){	/* define a new entry */
+      e = (symEntryPo)malloc(sizeof(SymEntryRec));
+      e->key = (unsigned char*)malloc(len+1);
+      memcpy(e->key,buff,len);
+      e->len = len;
+      e->ix = symCount++;
+      e->next = symDict[h];
+      symDict[h] = e;
+
+      encodeInt(out,trmDict,e->ix);
+    }
+  }
+    
+  encodeInt(out,trmSym,len);	/* the symbol length */
+  for(i=0;i<len;i++)
+    outChar(out,buff[i]);
 }
 
 
@@ -109,20 +193,9 @@ static void encode(ioPo out,cellpo input,labelPo chain,labelPo tvars)
     break;
   }
 
-  case symbolic:{
-    symbpo sym = symVal(input);
-    int len = uniStrLen(sym);
-    long uLen = len*4;
-    unsigned char buff[uLen];
-    int i;
-
-    len = uni_utf8(sym,uniStrLen(sym)+1,buff,uLen);
-    
-    encodeInt(out,trmSym,len);	/* the symbol length */
-    for(i=0;i<len;i++)
-      outChar(out,buff[i]);
+  case symbolic:
+    encodeSym(out,symVal(input));
     break;
-  }
 
   case character: {
     encodeInt(out,trmChar,CharVal(input));
@@ -293,20 +366,9 @@ static void encodeType(ioPo out,cellpo input,labelPo chain,labelPo tvars)
 
   switch(tG(input)){
 
-  case symbolic:{
-    symbpo sym = symVal(input);
-    int len = uniStrLen(sym);
-    long uLen = len*4;
-    unsigned char buff[uLen];
-    int i;
-
-    len = uni_utf8(sym,uniStrLen(sym)+1,buff,uLen);
-    
-    encodeInt(out,trmSym,len);	/* the symbol length */
-    for(i=0;i<len;i++)
-      outChar(out,buff[i]);
+  case symbolic:
+    encodeSym(out,symVal(input));
     break;
-  }
 
   case constructor: {
     unsigned int i,ar;
@@ -0,0 +1,903 @@
+/*
+  Inline expansion of small functions and procedures
+  (c) 1994-2003 Imperial College and F.G.McCabe
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+  Contact: Francis McCabe <fgm@fla.fujitsu.com>
+*/
+
+/*
+ * The inliner runs on the type checked program. Within a theta -- or a
+ * sequence of statements -- a definition of the form
+ *
+ *   f = (X1,..,Xn) => E      or      p = (X1,..,Xn) -> S
+ *
+ * is a candidate if its body is small, does not mention f itself, and is
+ * made only of expressions -- or simple statements -- that can be copied
+ * without renaming anything. Calls to a candidate within the theta are
+ * replaced by a copy of its body, with the arguments in place of the
+ * parameters. The copied cells keep their line information, so the
+ * debugging code still refers to the source of the function.
+ *
+ * A call is only replaced if that cannot change what the program does: the
+ * names that the body uses must mean the same at the call -- no form
+ * between the definition and the call may bind them again -- and each
+ * argument must be evaluated just as it would have been by the call. A
+ * procedure's arguments that are not simple are bound to new variables.
+ * The result is constant folded when it is compiled -- folding needs the
+ * code generator's dictionary.
+ */
+
+#include "config.h"
+#include <stdlib.h>		/* Standard functions */
+#include "compile.h"		/* Compiler structures */
+#include "cellP.h"
+#include "keywords.h"		/* Standard April keywords */
+#include "inline.h"
+
+typedef struct _binder_ *binderPo;
+
+typedef struct _binder_ {
+  cellpo scope;			/* a form that may bind names */
+  binderPo prev;
+} BinderRec;
+
+typedef struct _inline_ *inlinePo;
+
+typedef struct _inline_ {
+  symbpo name;			/* the function or procedure */
+  logical proc;			/* True if it is a procedure */
+  cellpo args;			/* tuple of parameters */
+  cellpo body;			/* copy of the body */
+  logical calls;		/* does the body call anything? */
+  binderPo binders;		/* the binding forms around its definition */
+  inlinePo prev;
+} InlineRec;
+
+typedef struct _mutable_ *mutablePo;
+
+typedef struct _mutable_ {
+  symbpo name;			/* a variable that is assigned to */
+  mutablePo prev;
+} MutableRec;
+
+typedef struct {
+  cellpo args;			/* parameters of the candidate */
+  cellpo body;			/* the theta or sequence it is defined in */
+  logical theta;
+  cellpo self;			/* its definition */
+} ScopeRec;
+
+typedef struct {
+  symbpo param;
+  int uses;			/* how often the parameter is used */
+  logical cond;			/* is a use conditional? */
+  logical head;			/* is it called? */
+} UseRec;
+
+typedef logical (*subTest)(cellpo input,void *cl);
+
+static int inlineLimit;		/* largest body that we inline */
+static mutablePo mutables = NULL; /* variables that may be assigned to */
+static binderPo binders = NULL;	/* the binding forms we are within */
+static int freshCount = 0;
+
+static void inlineExp(cellpo input,inlinePo cands);
+static void inlineStmt(cellpo input,inlinePo cands);
+static void inlineBody(cellpo body,logical theta,inlinePo cands);
+
+/* Apply a test to the sub-terms of a cell, stopping at the first success */
+static logical anySub(cellpo input,subTest test,void *cl)
+{
+  unsigned long i;
+
+  if(isCons(input)){
+    if(test(consFn(input),cl))
+      return True;
+    for(i=0;i<consArity(input);i++)
+      if(test(consEl(input,i),cl))
+	return True;
+  }
+  else if(isTpl(input)){
+    for(i=0;i<tplArity(input);i++)
+      if(test(tplArg(input,i),cl))
+	return True;
+  }
+  else if(isNonEmptyList(input))
+    return test(listHead(input),cl) || test(listTail(input),cl);
+  return False;
+}
+
+static logical literal(cellpo input)
+{
+  return IsInt(input) || IsFloat(input) || isChr(input) || IsString(input) ||
+    IsIdent(input) || isEmptyList(input) || IsQuote(input,NULL) ||
+    IsEnumStruct(input,NULL);
+}
+
+/* Forms that we never copy */
+static logical special(symbpo s)
+{
+  return s==kfn || s==kstmt || s==kchoice || s==kvalueof || s==kcollect ||
+    s==ksetof || s==kcase || s==kcatch || s==ktry || s==kraise ||
+    s==ksemi || s==kdefn || s==kfield || s==kmatch || s==knomatch ||
+    s==kin || s==kquery || s==ktstring || s==ktcoerce || s==kdot ||
+    s==kassign || s==ksend || s==kvalis || s==kelement || s==kleave ||
+    s==klabel || s==kguard || s==kdo || s==kwhile || s==kfor ||
+    s==kwithin || s==ktype || s==kconstr || s==ktpname || s==khash ||
+    s==kshriek;
+}
+
+/* Operators that do not call anything */
+static logical pureOp(symbpo s)
+{
+  return s==kplus || s==kminus || s==kstar || s==kslash || s==kindex ||
+    s==kequal || s==knotequal || s==kgreaterthan || s==kgreatereq ||
+    s==klessthan || s==klesseq || s==kand || s==kor || s==knot ||
+    s==kdand || s==kdor || s==kdnot || s==kif || s==kthen || s==kelse;
+}
+
+static long paramNo(cellpo args,symbpo s)
+{
+  unsigned long i;
+
+  for(i=0;i<tplArity(args);i++)
+    if(symVal(tplArg(args,i))==s)
+      return i;
+  return -1;
+}
+
+static logical occurs(cellpo input,void *cl)
+{
+  input = deRef(input);
+
+  if(isSymb(input))
+    return symVal(input)==(symbpo)cl;
+  else
+    return anySub(input,occurs,cl);
+}
+
+static long cellSize(cellpo input)
+{
+  input = stripCell(input);
+
+  if(isCons(input)){
+    long size = isSymb(consFn(input))?1:1+cellSize(consFn(input));
+    unsigned long i;
+
+    for(i=0;i<consArity(input);i++)
+      size += cellSize(consEl(input,i));
+    return size;
+  }
+  else if(isTpl(input)){
+    long size = 1;
+    unsigned long i;
+
+    for(i=0;i<tplArity(input);i++)
+      size += cellSize(tplArg(input,i));
+    return size;
+  }
+  else if(isNonEmptyList(input))
+    return cellSize(listHead(input))+cellSize(listTail(input));
+  else
+    return 1;
+}
+
+/* Does an expression call anything -- other than the standard operators? */
+static logical callsIn(cellpo input,void *cl)
+{
+  cellpo lhs,rhs;
+
+  input = stripCell(input);
+
+  if(isSymb(input) || literal(input))
+    return False;
+  else if(isBinaryCall(input,kdot,&lhs,&rhs) && isSymb(rhs))
+    return callsIn(lhs,cl);
+  else if(isCons(input))
+    return !isSymb(consFn(input)) || !pureOp(symVal(consFn(input))) ||
+      anySub(input,callsIn,cl);
+  else
+    return anySub(input,callsIn,cl);
+}
+
+/* Variables that are assigned to -- anywhere in the program */
+static logical isMutable(symbpo s)
+{
+  mutablePo m;
+
+  for(m=mutables;m!=NULL;m=m->prev)
+    if(m->name==s)
+      return True;
+  return False;
+}
+
+static logical addMutable(cellpo input,void *cl)
+{
+  if(isSymb(input)){
+    if(!isMutable(symVal(input))){
+      mutablePo m = (mutablePo)malloc(sizeof(MutableRec));
+
+      m->name = symVal(input);
+      m->prev = mutables;
+      mutables = m;
+    }
+    return False;
+  }
+  else
+    return anySub(input,addMutable,cl);
+}
+
+static logical findMutable(cellpo input,void *cl)
+{
+  cellpo lhs,rhs;
+
+  if(isBinaryCall(input,kassign,&lhs,&rhs) || isBinaryCall(input,kfield,&lhs,&rhs))
+    addMutable(lhs,cl);
+  return anySub(input,findMutable,cl);
+}
+
+/* An argument that can be used any number of times, in any order */
+static logical trivial(cellpo arg)
+{
+  return literal(arg) || (isSymb(arg) && !isMutable(symVal(arg)));
+}
+
+/* Is there a binding occurrence of a symbol within input? */
+static logical binds(cellpo input,void *cl)
+{
+  cellpo lhs,rhs;
+
+  input = deRef(input);
+
+  if(IsQuote(input,NULL) || IsEnumStruct(input,NULL))
+    return False;
+  else if(isBinaryCall(input,kfn,&lhs,&rhs) || isBinaryCall(input,kstmt,&lhs,&rhs) ||
+	  isBinaryCall(input,kmatch,&lhs,&rhs) || isBinaryCall(input,knomatch,&lhs,&rhs) ||
+	  isBinaryCall(input,kin,&lhs,&rhs) || isBinaryCall(input,kdefn,&lhs,&rhs) ||
+	  isBinaryCall(input,kfield,&lhs,&rhs))
+    return occurs(lhs,cl) || binds(rhs,cl);
+  else if(IsQuery(input,NULL,NULL) || isBinaryCall(input,ktype,NULL,NULL) ||
+	  isBinaryCall(input,kconstr,NULL,NULL) ||
+	  isBinaryCall(input,ktpname,NULL,NULL))
+    return occurs(input,cl);
+  else if(isBinaryCall(input,kdot,&lhs,&rhs) && !isSymb(rhs))
+    return True;		/* the record's fields are in scope here */
+  else
+    return anySub(input,binds,cl);
+}
+
+/* Does a member of a theta -- or a statement of a sequence -- bind s? */
+static logical boundBy(cellpo def,symbpo s,logical theta,cellpo self)
+{
+  cellpo lhs,rhs;
+
+  def = stripCell(def);
+
+  if((isBinaryCall(def,kdefn,&lhs,&rhs) || isBinaryCall(def,kfield,&lhs,&rhs)) &&
+     (theta || def==self))
+    return binds(rhs,s);	/* the member itself is what s means */
+  else if(theta && (IsQuery(def,NULL,NULL) || isBinaryCall(def,ktype,NULL,NULL) ||
+		    isBinaryCall(def,kconstr,NULL,NULL) ||
+		    isBinaryCall(def,ktpname,NULL,NULL)))
+    return False;
+  else
+    return binds(def,s);
+}
+
+/*
+ * In a theta, every member is in scope everywhere; in a sequence a
+ * statement is only in scope after it, so only the candidate's own
+ * definition is exempt
+ */
+static logical boundIn(cellpo body,symbpo s,logical theta,cellpo self)
+{
+  cellpo lhs,rhs;
+
+  if(IsHashStruct(body,kdebug,&lhs) || IsHashStruct(body,knodebug,&lhs))
+    return boundIn(lhs,s,theta,self);
+  else if(isBinaryCall(body,ksemi,&lhs,&rhs)){
+    if(theta)
+      return boundIn(lhs,s,theta,self) || boundIn(rhs,s,theta,self);
+    else
+      return boundBy(lhs,s,theta,self) || boundIn(rhs,s,theta,self);
+  }
+  else if(isUnaryCall(body,ksemi,&lhs))
+    return boundIn(lhs,s,theta,self);
+  else
+    return boundBy(body,s,theta,self);
+}
+
+/* Does the body use a name that may mean something else at a call? */
+static logical freeBound(cellpo input,void *cl)
+{
+  ScopeRec *scope = (ScopeRec*)cl;
+  cellpo lhs,rhs;
+
+  input = stripCell(input);
+
+  if(isSymb(input))
+    return paramNo(scope->args,symVal(input))<0 &&
+      boundIn(scope->body,symVal(input),scope->theta,scope->self);
+  else if(IsQuote(input,NULL) || IsEnumStruct(input,NULL))
+    return False;
+  else if(isBinaryCall(input,kdot,&lhs,&rhs) && isSymb(rhs))
+    return freeBound(lhs,cl);
+  else
+    return anySub(input,freeBound,cl);
+}
+
+/* Can this expression not be copied into a call? */
+static logical badExp(cellpo input,void *cl)
+{
+  cellpo lhs,rhs;
+
+  input = stripCell(input);
+
+  if(isSymb(input) || literal(input))
+    return False;
+  else if(isBinaryCall(input,kdot,&lhs,&rhs))
+    return !isSymb(rhs) || badExp(lhs,cl);
+  else if(isCons(input))
+    return !isSymb(consFn(input)) || special(symVal(consFn(input))) ||
+      anySub(input,badExp,cl);
+  else if(isTpl(input) || IsList(input))
+    return anySub(input,badExp,cl);
+  else
+    return True;
+}
+
+/* Can this statement not be copied into a call? */
+static logical badStmt(cellpo input,void *cl)
+{
+  cellpo args = (cellpo)cl;
+  cellpo lhs,rhs,test,then;
+
+  input = stripCell(input);
+
+  if(isSymb(input))
+    return !IsSymbol(input,krelax);
+  else if(isBinaryCall(input,ksemi,&lhs,&rhs))
+    return badStmt(lhs,cl) || badStmt(rhs,cl);
+  else if(isUnaryCall(input,ksemi,&lhs))
+    return badStmt(lhs,cl);
+  else if(isBinaryCall(input,kelse,&lhs,&rhs)){
+    if(isBinaryCall(lhs,kthen,&test,&then) && isUnaryCall(test,kif,&test))
+      return badExp(test,NULL) || badStmt(then,cl) || badStmt(rhs,cl);
+    else
+      return True;
+  }
+  else if(isBinaryCall(input,kthen,&test,&then)){
+    if(isUnaryCall(test,kif,&test))
+      return badExp(test,NULL) || badStmt(then,cl);
+    else
+      return True;
+  }
+  else if(isBinaryCall(input,kassign,&lhs,&rhs))
+    return !isSymb(lhs) || paramNo(args,symVal(lhs))>=0 || badExp(rhs,NULL);
+  else if(isBinaryCall(input,ksend,&lhs,&rhs))
+    return badExp(lhs,NULL) || badExp(rhs,NULL);
+  else if(isCons(input) && isSymb(consFn(input))) /* a procedure call */
+    return special(symVal(consFn(input))) || pureOp(symVal(consFn(input))) ||
+      anySub(input,badExp,NULL);
+  else
+    return True;
+}
+
+/* How is a parameter used in the body of a function? */
+static void countUses(cellpo input,UseRec *use,logical cond)
+{
+  cellpo lhs,rhs,test;
+  unsigned long i;
+
+  input = stripCell(input);
+
+  if(isSymb(input)){
+    if(symVal(input)==use->param){
+      use->uses++;
+      if(cond)
+	use->cond = True;
+    }
+  }
+  else if(IsQuote(input,NULL) || IsEnumStruct(input,NULL))
+    return;
+  else if(isBinaryCall(input,kdot,&lhs,&rhs) && isSymb(rhs))
+    countUses(lhs,use,cond);
+  else if(isBinaryCall(input,kelse,&lhs,&rhs) &&
+	  isBinaryCall(lhs,kthen,&test,&lhs) && isUnaryCall(test,kif,&test)){
+    countUses(test,use,cond);
+    countUses(lhs,use,True);
+    countUses(rhs,use,True);
+  }
+  else if(isBinaryCall(input,kand,&lhs,&rhs) || isBinaryCall(input,kor,&lhs,&rhs) ||
+	  isBinaryCall(input,kdand,&lhs,&rhs) || isBinaryCall(input,kdor,&lhs,&rhs)){
+    countUses(lhs,use,cond);
+    countUses(rhs,use,True);
+  }
+  else if(isCons(input)){
+    if(isSymb(consFn(input)) && symVal(consFn(input))==use->param)
+      use->head = True;
+    countUses(consFn(input),use,cond);
+    for(i=0;i<consArity(input);i++)
+      countUses(consEl(input,i),use,cond);
+  }
+  else if(isTpl(input)){
+    for(i=0;i<tplArity(input);i++)
+      countUses(tplArg(input,i),use,cond);
+  }
+  else if(isNonEmptyList(input)){
+    countUses(listHead(input),use,cond);
+    countUses(listTail(input),use,cond);
+  }
+}
+
+/* Copy an expression, replacing parameters by the arguments of a call */
+static void copyExp(cellpo input,cellpo out,cellpo args,cellpo call)
+{
+  long i;
+
+  if(args!=NULL && isSymb(input) && (i=paramNo(args,symVal(input)))>=0)
+    copyExp(consEl(call,i),out,NULL,NULL);
+  else if(isCons(input)){
+    long ar = consArity(input);
+
+    *out = *input;		/* keep the line and type information */
+    out->d.t = allocCons(ar);
+
+    if(IsQuote(input,NULL) || IsEnumStruct(input,NULL))
+      args = NULL;		/* nothing to replace in here */
+
+    copyExp(consFn(input),consFn(out),args,call);
+    for(i=0;i<ar;i++)
+      copyExp(consEl(input,i),consEl(out,i),
+	      isBinaryCall(input,kdot,NULL,NULL) && i==1?NULL:args,call);
+  }
+  else if(isTpl(input)){
+    long ar = tplArity(input);
+
+    *out = *input;
+    out->d.t = allocTuple(ar);
+
+    for(i=0;i<ar;i++)
+      copyExp(tplArg(input,i),tplArg(out,i),args,call);
+  }
+  else if(isNonEmptyList(input)){
+    *out = *input;
+    out->d.t = allocPair();
+
+    copyExp(listHead(input),listHead(out),args,call);
+    copyExp(listTail(input),listTail(out),args,call);
+  }
+  else
+    *out = *input;
+}
+
+/* Is a definition one that we can inline? */
+static inlinePo candidate(cellpo def,cellpo body,logical theta,inlinePo cands)
+{
+  cellpo lhs,rhs,args,exp;
+  logical proc;
+  unsigned long i;
+
+  def = stripCell(def);
+
+  if(!isBinaryCall(def,kdefn,&lhs,&rhs))
+    return cands;
+
+  IsQuery(lhs,NULL,&lhs);	/* a type annotated name */
+  rhs = stripCell(rhs);
+
+  if(isBinaryCall(rhs,kfn,&args,&exp))
+    proc = False;
+  else if(isBinaryCall(rhs,kstmt,&args,&exp))
+    proc = True;
+  else
+    return cands;
+
+  if(!isSymb(lhs) || !isTpl(args))
+    return cands;
+
+  for(i=0;i<tplArity(args);i++){
+    cellpo a = tplArg(args,i);
+
+    if(!isSymb(a) || IsSymbol(a,kuscore) || paramNo(args,symVal(a))!=(long)i)
+      return cands;
+  }
+
+  if(cellSize(exp)>inlineLimit || occurs(exp,symVal(lhs)) ||
+     (proc?badStmt(exp,args):badExp(exp,NULL)))
+    return cands;
+  else{
+    ScopeRec scope = {args,body,theta,def};
+
+    if(boundIn(body,symVal(lhs),theta,def) || freeBound(exp,&scope))
+      return cands;
+    else{
+      inlinePo cand = (inlinePo)malloc(sizeof(InlineRec));
+
+      cand->name = symVal(lhs);
+      cand->proc = proc;
+      cand->args = args;
+      cand->body = allocSingle();
+      copyExp(exp,cand->body,NULL,NULL); /* calls in the original may be inlined */
+      cand->calls = callsIn(exp,NULL);
+      cand->binders = binders;
+      cand->prev = cands;
+      return cand;
+    }
+  }
+}
+
+static int defCount(cellpo body,symbpo s)
+{
+  cellpo lhs,rhs;
+
+  if(IsHashStruct(body,kdebug,&lhs) || IsHashStruct(body,knodebug,&lhs))
+    return defCount(lhs,s);
+  else if(isBinaryCall(body,ksemi,&lhs,&rhs))
+    return defCount(lhs,s)+defCount(rhs,s);
+  else if(isUnaryCall(body,ksemi,&lhs))
+    return defCount(lhs,s);
+  else if(isBinaryCall(body,kdefn,&lhs,&rhs) || isBinaryCall(body,kfield,&lhs,&rhs))
+    return occurs(lhs,s)?1:0;
+  else
+    return 0;
+}
+
+/* All the members of a theta are in scope throughout it */
+static inlinePo thetaCands(cellpo input,cellpo body,inlinePo cands)
+{
+  cellpo lhs,rhs;
+
+  if(IsHashStruct(input,kdebug,&lhs) || IsHashStruct(input,knodebug,&lhs))
+    return thetaCands(lhs,body,cands);
+  else if(isBinaryCall(input,ksemi,&lhs,&rhs))
+    return thetaCands(rhs,body,thetaCands(lhs,body,cands));
+  else if(isUnaryCall(input,ksemi,&lhs))
+    return thetaCands(lhs,body,cands);
+  else{
+    inlinePo cand = candidate(input,body,True,cands);
+
+    if(cand!=cands && defCount(body,cand->name)!=1){
+      free(cand);		/* there is more than one definition */
+      return cands;
+    }
+    return cand;
+  }
+}
+
+/* Has a form entered since the candidate was defined rebound its names? */
+static logical shadowed(inlinePo cand)
+{
+  binderPo b;
+
+  for(b=binders;b!=cand->binders;b=b->prev){
+    ScopeRec scope = {cand->args,b->scope,False,NULL};
+
+    if(binds(b->scope,cand->name) || freeBound(cand->body,&scope))
+      return True;
+  }
+  return False;
+}
+
+static inlinePo findCand(inlinePo cands,cellpo call,logical proc)
+{
+  for(;cands!=NULL;cands=cands->prev)
+    if(cands->name==symVal(consFn(call))){
+      if(cands->proc==proc && tplArity(cands->args)==consArity(call) &&
+	 !shadowed(cands))
+	return cands;
+      else
+	return NULL;
+    }
+  return NULL;
+}
+
+static void inlineFun(cellpo call,inlinePo cand)
+{
+  cellpo type = typeInfo(call);
+  cellpo out = allocSingle();
+  unsigned long i;
+
+  for(i=0;i<consArity(call);i++){
+    cellpo arg = consEl(call,i);
+    UseRec use = {symVal(tplArg(cand->args,i)),0,False,False};
+
+    countUses(cand->body,&use,False);
+
+    if(use.head && !isSymb(arg))
+      return;
+    else if(!trivial(arg) &&
+	    !(use.uses==1 && !use.cond && !cand->calls && !callsIn(arg,NULL)))
+      return;			/* it would not be evaluated as it was */
+  }
+
+  copyExp(cand->body,out,cand->args,call);
+  *call = *out;
+  if(type!=NULL)
+    setTypeInfo(call,type);
+}
+
+static void inlineProc(cellpo call,inlinePo cand)
+{
+  unsigned long ar = consArity(call);
+  cellpo vars = BuildStruct(consFn(call),ar,allocSingle());
+  cellpo out = allocSingle();
+  long i;
+
+  for(i=0;i<(long)ar;i++){
+    cellpo arg = consEl(call,i);
+    cellpo par = tplArg(cand->args,i);
+
+    if(trivial(arg))
+      copyCell(consEl(vars,i),arg);
+    else{			/* bind the argument to a new variable */
+      cellpo type = typeInfo(arg)!=NULL?typeInfo(arg):typeInfo(par);
+      uniChar name[MAX_SYMB_LEN];
+
+      if(type==NULL)
+	return;
+
+      strMsg(name,NumberOf(name),"%U'%d",symVal(par),++freshCount);
+      mkSymb(consEl(vars,i),locateU(name));
+      copyLineInfo(arg,consEl(vars,i));
+      setTypeInfo(consEl(vars,i),type);
+    }
+  }
+
+  copyExp(cand->body,out,cand->args,vars);
+
+  for(i=(long)ar-1;i>=0;i--){
+    if(!trivial(consEl(call,i))){
+      cellpo decl = BuildBinCall(kdefn,consEl(vars,i),consEl(call,i),allocSingle());
+
+      copyLineInfo(call,decl);
+      out = BuildBinCall(ksemi,decl,out,allocSingle());
+      copyLineInfo(call,out);
+    }
+  }
+
+  *call = *out;
+}
+
+static void inlineExp(cellpo input,inlinePo cands)
+{
+  cellpo lhs,rhs;
+  inlinePo cand;
+  BinderRec b = {input,binders};
+
+  if(IsHashStruct(input,kdebug,&lhs) || IsHashStruct(input,knodebug,&lhs))
+    inlineExp(lhs,cands);
+  else if(IsQuote(input,NULL) || IsEnumStruct(input,NULL) || IsQuery(input,NULL,NULL))
+    return;
+  else if(IsTheta(input,NULL))
+    inlineBody(input,True,cands);
+  else if(isBinaryCall(input,kfn,NULL,&rhs)){
+    binders = &b;		/* the parameters hide outer names */
+    inlineExp(rhs,cands);
+    binders = b.prev;
+  }
+  else if(isBinaryCall(input,kstmt,NULL,&rhs)){
+    binders = &b;
+    inlineStmt(rhs,cands);
+    binders = b.prev;
+  }
+  else if(isUnaryCall(input,kvalueof,&rhs) || isUnaryCall(input,kcollect,&rhs) ||
+	  isUnaryCall(input,ksetof,&rhs))
+    inlineStmt(rhs,cands);
+  else if(isUnaryCall(input,kcase,&lhs) && isBinaryCall(lhs,kin,&lhs,&rhs)){
+    inlineExp(lhs,cands);
+    inlineExp(rhs,cands);	/* the clauses */
+  }
+  else if(isBinaryCall(input,kmatch,NULL,&rhs) || isBinaryCall(input,knomatch,NULL,&rhs) ||
+	  isBinaryCall(input,kin,NULL,&rhs) || isBinaryCall(input,kdefn,NULL,&rhs) ||
+	  isBinaryCall(input,kfield,NULL,&rhs))
+    inlineExp(rhs,cands);	/* but not in the pattern */
+  else if(isBinaryCall(input,kdot,&lhs,&rhs)){
+    inlineExp(lhs,cands);
+    if(!isSymb(rhs)){
+      binders = &b;		/* the record's fields are in scope */
+      inlineExp(rhs,cands);
+      binders = b.prev;
+    }
+  }
+  else if(isCons(input)){
+    unsigned long i;
+
+    if(isSymb(consFn(input)) &&	/* a condition may bind names */
+       (symVal(consFn(input))==kelse || symVal(consFn(input))==kthen ||
+	symVal(consFn(input))==kand || symVal(consFn(input))==kdand))
+      binders = &b;
+
+    if(!isSymb(consFn(input)))
+      inlineExp(consFn(input),cands);
+    for(i=0;i<consArity(input);i++)
+      inlineExp(consEl(input,i),cands);
+
+    binders = b.prev;
+
+    if(isSymb(consFn(input)) && (cand=findCand(cands,input,False))!=NULL)
+      inlineFun(input,cand);
+  }
+  else if(isTpl(input)){
+    unsigned long i;
+
+    for(i=0;i<tplArity(input);i++)
+      inlineExp(tplArg(input,i),cands);
+  }
+  else if(isNonEmptyList(input)){
+    inlineExp(listHead(input),cands);
+    inlineExp(listTail(input),cands);
+  }
+}
+
+static void inlineStmt(cellpo input,inlinePo cands)
+{
+  cellpo lhs,rhs,test;
+  inlinePo cand;
+  BinderRec b = {NULL,binders};
+
+  if(IsHashStruct(input,kdebug,&lhs) || IsHashStruct(input,knodebug,&lhs))
+    inlineStmt(lhs,cands);
+  else if(IsTheta(input,NULL))
+    inlineBody(input,False,cands);
+  else if(isBinaryCall(input,kelse,&lhs,&rhs)){
+    if(isBinaryCall(lhs,kthen,&test,&lhs) && isUnaryCall(test,kif,&test)){
+      inlineExp(test,cands);
+      b.scope = test;		/* the test may bind names */
+      binders = &b;
+      inlineStmt(lhs,cands);
+      inlineStmt(rhs,cands);
+      binders = b.prev;
+    }
+  }
+  else if(isBinaryCall(input,kthen,&test,&lhs)){
+    if(isUnaryCall(test,kif,&test)){
+      inlineExp(test,cands);
+      b.scope = test;
+      binders = &b;
+      inlineStmt(lhs,cands);
+      binders = b.prev;
+    }
+  }
+  else if(isBinaryCall(input,kdo,&test,&rhs)){
+    if(isUnaryCall(test,kfor,&test) && isBinaryCall(test,kin,NULL,&lhs)){
+      inlineExp(lhs,cands);
+      b.scope = test;		/* the loop's pattern */
+      binders = &b;
+      inlineStmt(rhs,cands);
+      binders = b.prev;
+    }
+    else if(isUnaryCall(test,kwhile,&test)){
+      inlineExp(test,cands);
+      b.scope = test;
+      binders = &b;
+      inlineStmt(rhs,cands);
+      binders = b.prev;
+    }
+  }
+  else if(isUnaryCall(input,ktry,&lhs) || isUnaryCall(input,kvalueof,&lhs))
+    inlineStmt(lhs,cands);
+  else if(isBinaryCall(input,kcatch,&lhs,&rhs) || isBinaryCall(input,kwithin,&lhs,&rhs)){
+    inlineStmt(lhs,cands);
+    inlineExp(rhs,cands);	/* the handlers, or the time limit */
+  }
+  else if((isBinaryCall(input,klabel,&lhs,&rhs) ||
+	   isBinaryCall(input,kguard,&lhs,&rhs)) && isSymb(lhs))
+    inlineStmt(rhs,cands);
+  else if(isUnaryCall(input,kelement,&rhs) || isUnaryCall(input,kvalis,&rhs) ||
+	  isUnaryCall(input,kraise,&rhs))
+    inlineExp(rhs,cands);
+  else if(isBinaryCall(input,ksend,&lhs,&rhs)){
+    inlineExp(lhs,cands);
+    inlineExp(rhs,cands);
+  }
+  else if(isBinaryCall(input,kassign,NULL,&rhs) || isBinaryCall(input,kmatch,NULL,&rhs) ||
+	  isBinaryCall(input,kfield,NULL,&rhs) || isBinaryCall(input,kdefn,NULL,&rhs))
+    inlineExp(rhs,cands);
+  else if(isBinaryCall(input,kdot,&lhs,&rhs)){
+    inlineExp(lhs,cands);
+    b.scope = input;		/* the record's fields are in scope */
+    binders = &b;
+    inlineStmt(rhs,cands);
+    binders = b.prev;
+  }
+  else if(isUnaryCall(input,kcase,&lhs) && isBinaryCall(lhs,kin,&lhs,&rhs)){
+    inlineExp(lhs,cands);
+    inlineExp(rhs,cands);	/* the clauses */
+  }
+  else if(isCons(input) && isSymb(consFn(input))){ /* a procedure call */
+    unsigned long i;
+
+    for(i=0;i<consArity(input);i++)
+      inlineExp(consEl(input,i),cands);
+
+    if((cand=findCand(cands,input,True))!=NULL)
+      inlineProc(input,cand);
+  }
+}
+
+/* A statement of a sequence is only in scope in the statements after it */
+static void inlineMember(cellpo input,cellpo body,logical theta,inlinePo *cands)
+{
+  cellpo rhs;
+
+  if(theta){
+    cellpo def = stripCell(input);
+
+    if(isBinaryCall(def,kdefn,NULL,&rhs) || isBinaryCall(def,kfield,NULL,&rhs))
+      inlineExp(rhs,*cands);
+  }
+  else{
+    inlineStmt(input,*cands);
+    *cands = candidate(input,body,False,*cands);
+  }
+}
+
+static void inlineMembers(cellpo input,cellpo body,logical theta,inlinePo *cands)
+{
+  cellpo lhs,rhs;
+
+  if(IsHashStruct(input,kdebug,&lhs) || IsHashStruct(input,knodebug,&lhs))
+    inlineMembers(lhs,body,theta,cands);
+  else if(isBinaryCall(input,ksemi,&lhs,&rhs)){
+    if(theta)
+      inlineMembers(lhs,body,theta,cands);
+    else
+      inlineMember(lhs,body,theta,cands); /* a nested block */
+    inlineMembers(rhs,body,theta,cands);
+  }
+  else if(isUnaryCall(input,ksemi,&lhs))
+    inlineMembers(lhs,body,theta,cands);
+  else
+    inlineMember(input,body,theta,cands);
+}
+
+static void inlineBody(cellpo body,logical theta,inlinePo cands)
+{
+  BinderRec b = {body,binders};
+  inlinePo local;
+
+  binders = &b;			/* what is defined here hides outer names */
+  local = theta?thetaCands(body,body,cands):cands;
+
+  inlineMembers(body,body,theta,&local);
+
+  while(local!=cands){		/* drop the candidates defined here */
+    inlinePo prev = local->prev;
+
+    free(local);
+    local = prev;
+  }
+  binders = b.prev;
+}
+
+void inlineProg(cellpo prog,int limit)
+{
+  if(limit>0){
+    inlineLimit = limit;
+
+    findMutable(prog,NULL);
+    inlineExp(prog,NULL);
+
+    while(mutables!=NULL){
+      mutablePo prev = mutables->prev;
+
+      free(mutables);
+      mutables = prev;
+    }
+  }
+}
@@ -38,6 +38,7 @@ extern logical traceCompile;	/* tracing preprocessor */
 extern logical traceType;	/* tracing of the type checker */
 extern logical traceMemory;	/* Tracing of GC */
 extern logical traceParse;      // Tracing the parse process
+extern logical icmDictionary;	/* Encode symbols with a dictionary */
 
 static logical quiet = False;	/* true if not to display version info */
 
@@ -62,7 +63,7 @@ int getOptions(int argc, char **argv,OptInfoRec *info)
   extern char *optarg;
   extern int optind;
 
-  while((opt=getopt(argc,argv,"vETqd:gxo:s:P:WI:i:#:VM"))>=0){
+  while((opt=getopt(argc,argv,"vETqd:gxo:s:P:WI:i:#:VMDO:"))>=0){
     switch(opt){
     case 'd':{			/* turn on various debugging options */
       char *c = optarg;
@@ -178,6 +179,14 @@ int getOptions(int argc, char **argv,OptInfoRec *info)
       info->makeAf = True;
       continue;
 
+    case 'D':			/* output needs an engine that knows dictionaries */
+      icmDictionary = True;
+      continue;
+
+    case 'O':			/* size of functions to inline, 0 for none */
+      info->inlineSize = atoi(optarg);
+      continue;
+
     default:
       return -1;
     }
@@ -207,6 +216,7 @@ int main(int argc, char **argv)
   info.out_name = NULL;
   info.macJoin = khash;		/* default macro generation prefix */
   info.dLvl = 0;		/* symbolic debugging? */
+  info.inlineSize = INLINESIZE;	/* inline small functions */
   info.noWarnings = False;	/* true if we do not display warnings */
   info.preProcOnly = False;	/* True if only displaying result of macro output */
   info.executable = False;	/* True if output is marked as executable */
@@ -221,7 +231,8 @@ int main(int argc, char **argv)
       
     outMsg(logFile,"usage: %s [-v] [-d [ctmME]] [-g] "
 	    "[-s serverName] [-P port] [-E] "
-	    "[-x] [-X header] [-I include] [-q] [-# join] [-V] [-M] "
+	    "[-x] [-X header] [-I include] [-q] [-# join] [-V] [-M] [-D] "
+	    "[-O size] "
 	    "file...\n",argv[0]);
     comp_exit(1);
   }
@@ -0,0 +1,35 @@
+/*
+ * Header for asynchronous escapes executed by a pool of worker threads
+ */
+#ifndef _ASYNC_H_
+#define _ASYNC_H_
+
+#ifndef ASYNCWORKERS
+#define ASYNCWORKERS 4		/* Number of worker threads */
+#endif
+
+typedef struct _async_job_ *asyncPo;
+
+/* A job function is run in a worker thread: it must not touch the heap */
+typedef retCode (*asyncFun)(asyncPo job);
+
+typedef struct _async_job_ {
+  asyncFun fun;			/* What should be done */
+  processpo p;			/* Which process is waiting for it */
+  void *data;			/* Job specific request and result data */
+  retCode ret;			/* Result of the job */
+  int err;			/* errno as seen by the worker */
+  logical done;			/* Has the job been completed? */
+  asyncPo next;			/* Next job in the worker queue */
+  asyncPo chain;		/* Next job known to the engine */
+} AsyncRec;
+
+retCode asyncEscape(processpo p,asyncFun fun,void *data);
+asyncPo asyncResult(processpo p,asyncFun fun);
+void asyncFree(asyncPo job);
+void asyncCancel(processpo p);
+
+int asyncPollFd(void);		/* file descriptor that goes ready on completion */
+void asyncComplete(void);	/* resume processes whose jobs have finished */
+
+#endif
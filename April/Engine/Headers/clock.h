@@ -20,6 +20,7 @@ extern retCode set_alarm(processpo P,number tm,timeFun onWakeup,void *cl);
 extern retCode set_timer(processpo P,number tm,timeFun onWakeup,void *cl);
 
 void flush_from_time_q(processpo p);
+void flush_timer(timeFun onWakeup,void *cl);
 void reset_timer(void);
 struct timeval *nextTimeOut(void);
 integer taxiFlag(void);
@@ -27,6 +27,11 @@ retCode error_debug(processpo p,objPo msg);
 
 insPo dissass(insPo pc,insPo base,objPo *fp, objPo *e,objPo *lits);
 
+/* Debugging instructions are disabled when there is no debugger */
+void disableDebugSites(objPo code);
+void enableDebugSites(void);
+unsigned WORD32 loadedIns(objPo code,unsigned long off);
+
 /* Debugging escapes */
 retCode m_debug(processpo p,objPo * args);
 retCode m_debug_wait(processpo p,objPo *args);
@@ -8,7 +8,8 @@ void init_dict(void);	/* initialize dictionary */
 objPo newUniSymbol(const uniChar *name);
 objPo newSymbol(const char *name); /* access symbol from a dict */
 void installSymbol(objPo s);
-#ifdef EXECTRACE
+objPo internSymbol(objPo s);
+#if defined(EXECTRACE) || defined(STATISTICS)
 char *escapeName(int code);
 #endif
 funpo escapeCode(unsigned int code);
@@ -13,7 +13,8 @@ logical executableFile(char *file);
 
 ioPo opaqueFilePtr(objPo p);
 objPo allocOpaqueFilePtr(ioPo file);
-retCode load_code_file(uniChar *sys,uniChar *url,objPo *tgt,logical verify);
+retCode load_code_file(uniChar *sys,uniChar *url,objPo *tgt,logical verify,logical lazy);
+retCode localFileName(uniChar *sys,uniChar *url,char *fn,WORD32 len);
 
 typedef enum { input, output } ioMode;
  
@@ -11,6 +11,10 @@ void adjustRoots(void);
 void scanLabels(void);
 void markLabels(void);
 void adjustLabels(void);
+void scanImage(void);
+void markImage(void);
+void adjustImage(void);
+void sweepDebugSites(objPo (*alive)(objPo o));
 
 /* Used for recording old->new pointers */
 #ifndef CARDSHIFT
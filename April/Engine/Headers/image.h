@@ -0,0 +1,18 @@
+/*
+ * Header for boot images -- loaded code saved as a relocatable heap
+ */
+#ifndef _IMAGE_H_
+#define _IMAGE_H_
+
+#define IMAGEMAGIC "AprilImg"	/* first bytes of an image file */
+
+extern char *bootImageFile;	/* image to start from */
+extern char *saveImageFile;	/* image to write when we exit */
+
+void initImage(void);		/* load the boot image, if there is one */
+void saveImage(void);		/* write out the loaded modules */
+
+retCode imageCode(uniChar *url,objPo *tgt); /* code for url from the image */
+void imageRecord(uniChar *url,objPo code); /* remember a loaded module */
+
+#endif
@@ -22,17 +22,51 @@
 #ifndef _ENCODE_H_
 #define _ENCODE_H_
 
-typedef struct _label_ *lblPo;
-
-lblPo createLabel(objPo term,int ref,lblPo chain);
-int searchLabels(objPo term,lblPo chain);
-objPo findObj(int ref,lblPo chain);
-lblPo freeAllLabels(lblPo chain);
-
-typedef struct _label_ {
-  objPo term;
-  int ref;
-  lblPo prev;
-} LabelRec;
+/* A pointer keyed hash table mapping terms to labels */
+typedef struct _label_table_ *lblTablePo;
+
+lblTablePo newLabelTable(int size);
+int findLabel(lblTablePo tbl,objPo term); /* -1 if the term is not there */
+void setLabel(lblTablePo tbl,objPo term,int ref);
+int labelCount(lblTablePo tbl);
+void freeLabelTable(lblTablePo tbl);
+
+typedef struct _label_table_ {
+  int size;			/* number of slots -- a power of two */
+  int count;			/* number of slots in use */
+  objPo *terms;			/* the keys, NULL if the slot is empty */
+  int *refs;			/* the labels */
+} LabelTable;
+
+/*
+ * A per-stream dictionary of symbols and type signatures. The encoder
+ * looks entries up by their encoded bytes, the decoder by their index.
+ */
+typedef struct _icm_dict_ *icmDictPo;
+
+icmDictPo newIcmDict(void);
+void freeIcmDict(icmDictPo dict);
+void clearIcmDict(icmDictPo dict);
+int icmDictCount(icmDictPo dict);
+void truncIcmDict(icmDictPo dict,int count); /* forget keys added since */
+int findDictKey(icmDictPo dict,unsigned char *key,int len); /* -1 if not there */
+int addDictKey(icmDictPo dict,unsigned char *key,int len); /* -1 if full */
+objPo dictValue(icmDictPo dict,int ix);
+retCode setDictValue(icmDictPo dict,int ix,objPo val);
+
+void scanIcmDicts(void);	/* garbage collection support */
+void markIcmDicts(void);
+void adjustIcmDicts(void);
+
+typedef struct _icm_dict_ {
+  int size;			/* number of key slots -- a power of two */
+  int count;			/* number of entries */
+  unsigned char **keys;		/* the keys, NULL if the slot is empty */
+  int *keyLens;			/* the length of each key */
+  int *ixs;			/* the index of each key */
+  objPo *vals;			/* decoded entries, indexed by number */
+  int maxVal;			/* size of the vals array */
+  icmDictPo next;		/* chain of all dictionaries */
+} IcmDict;
 
 #endif
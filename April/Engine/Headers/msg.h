@@ -14,8 +14,11 @@ typedef struct msg_rec {
   objPo msg;			/* The message */
   long sequence;		/* Sequence number of this message */
   time_t lease;			/* What is the lease time on this message? */
+  struct timeval queued;	/* When was it put in the queue? */
   msgpo prev;			/* Previous message */
   msgpo next;			/* Next message */
+  msgpo lprev;			/* Previous message in the lease index */
+  msgpo lnext;			/* Next message in the lease index */
 } msg_record;
 
 /* message processing functions */
@@ -26,7 +29,10 @@ msgpo get_msg(processpo P);
 void set_msg_range(processpo P);
 void reset_msg_q(processpo P);
 void discard_msgs(processpo P);
+void cancelMailboxWait(processpo p); /* a blocked sender is going away */
+void expireLeases(void);	/* discard messages whose lease has run out */
 void printMessages(void);
+void displayMsgStats(processpo p);
 void printMsgs(processpo p);
 
 int msgcount(processpo p);
@@ -36,11 +42,16 @@ void init_msgs(void);		/* initialize message queues etc. */
 /* Escape interface */
 retCode m_send(processpo p,objPo *args);	/* Send a message */
 retCode m_send2(processpo p,objPo *args);	/* Privileged version of send */
+retCode m_multicast(processpo p,objPo *args);	/* Send to many recipients */
 retCode m_front_msg(processpo p,objPo *args); /* Post message on front */
 retCode m_nextmsg(processpo p,objPo *args);
+retCode m_selectmsg(processpo p,objPo *args);
 retCode m_waitmsg(processpo p,objPo *args);
+retCode m_selectwait(processpo p,objPo *args);
 retCode m_replacemsg(processpo p,objPo *args);
 retCode m_mailer(processpo p,objPo *args);	/* what is our mail handler */
 retCode m_set_mailer(processpo p,objPo *args); /* set name of the mailer process */
+retCode m_mailbox(processpo p,objPo *args);	/* bound the mailbox */
+retCode m_msg_stats(processpo p,objPo *args);	/* mailbox statistics */
 
 #endif
@@ -23,10 +23,14 @@
 #define _OPAQUE_WORD_H_
 
 objPo allocateOpaque(short int type,void *data);
-typedef enum { showOpaque, markOpaque, copyOpaque, scanOpaque} opaqueEvalCode;
+typedef enum { showOpaque, markOpaque, copyOpaque, scanOpaque, finaliseOpaque} opaqueEvalCode;
 typedef retCode (*opaqueHdlr)(opaqueEvalCode code,void *data,void *cd,void *cl);
 void registerOpaqueType(opaqueHdlr cb,short int code,void *cl);
 retCode displayOpaque(ioPo f,opaquePo p);
 
+/* Ask for a finaliseOpaque call when the value dies -- it must not allocate */
+void finaliseOnDeath(objPo o);
+void sweepOpaques(objPo (*alive)(objPo o));
+
 #endif
 
@@ -5,17 +5,42 @@
 #ifndef _PROCESS_H_
 #define _PROCESS_H_
 
-#ifndef DEFSTACK
-#define DEFSTACK 128		/* Default size of a process stack */
-#endif
+#include <sys/time.h>
 
 #define MAXERROR 32		/* Maximum depth of error blocks */
 
+#ifndef MINSTACK
+#define MINSTACK 32		/* Smallest process stack size class */
+#endif
+
+#define STACKCLASSES 10		/* Number of pooled stack size classes */
+#define MAXPOOLSTACKS 32	/* Maximum free stacks kept per size class */
+#define SHRINKRATIO 4		/* Shrink when usage is below 1/SHRINKRATIO */
+
+#define MAXFRAME 128		/* Maximum number of locals in a frame */
+#define FRAMESLACK 4		/* Extra room needed for an outgoing call */
+
 typedef struct msg_rec *msgpo; /* pointer to a message record */
 
-typedef enum {quiescent, runnable, wait_io, wait_msg, wait_timer, wait_lock, wait_child, dead
+typedef enum {quiescent, runnable, wait_io, wait_msg, wait_timer, wait_lock, wait_child,
+	      wait_mailbox, dead
 } process_state;
 
+/* What happens to a message sent to a full mailbox */
+typedef enum {mailBlock, mailDropOldest, mailDropNewest, mailError} mailPolicy;
+
+#define MSGLATENCIES 20		/* Buckets in the message latency histogram */
+
+typedef struct {
+  long received;		/* Messages taken out of the mailbox */
+  long maxDepth;		/* Deepest the mailbox has been */
+  long latency[MSGLATENCIES];	/* Time spent queued, in powers of two usecs */
+  logical taken;		/* a message was received last ... */
+  long takenSeq;		/* ... this one ... */
+  struct timeval takenQueued;	/* ... queued then ... */
+  int takenBucket;		/* ... and counted here */
+} MsgStats;
+
 typedef struct process_{
   objPo *stack;			/* On board stack */
   objPo *sp;			/* Top of stack pointer */
@@ -28,6 +53,15 @@ typedef struct process_{
   msgpo mfront;			/* front of message queue */
   msgpo mback;			/* back of message queue */
   long sequence;		/* sequence number of last message received */
+  msgpo mcursor;		/* last message looked at by a selective receive */
+  long mcursorSeq;		/* which receive the cursor belongs to */
+  long mcount;			/* number of messages in the queue */
+  long mcapacity;		/* mailbox capacity, 0 if unbounded */
+  mailPolicy mpolicy;		/* what to do when the mailbox is full */
+  processpo mblocked;		/* senders waiting for room in our mailbox */
+  processpo mwaitOn;		/* whose mailbox we are waiting to send to */
+  processpo mblockNext;		/* next sender waiting on the same mailbox */
+  MsgStats mstats;		/* mailbox statistics */
   objPo handle;			/* The handle of this process */
   objPo creator;		/* The handle of the creator of this process */
   objPo filer;			/* Handle of the file manager process */
@@ -36,6 +70,8 @@ typedef struct process_{
   processpo pprev;		/* Previous in run queue */
   void *cl;			/* Client specific data */
   objPo clicks;			/* pointer to the click counter object */
+  objPo frozen;			/* Heap copy of the stack while hibernating */
+  long idleSince;		/* When the process started waiting for a message */
   logical priveleged;		/* Is this process priveleged? */
   process_state state;		/* What is the status of this process? */
 } process;
@@ -76,6 +112,14 @@ extern logical childDone;               /* set when a child process sends a sign
 void checkOutShells(void);              /* pick up any child processes */
 
 int grow_stack(processpo p, int factor); /* Grow a stack by a given size */
+int extend_stack(processpo p,WORD32 extra); /* Grow it to fit extra words */
+void shrinkStacks(void);	/* Release unused stack space after a GC */
+
+extern long hibernateTime;	/* Idle seconds before a process hibernates */
+retCode hibernateProcess(processpo p); /* Move a process's stack into the heap */
+void awakenProcess(processpo p); /* Rebuild the stack of a hibernating process */
+void hibernateIdle(void);	/* Hibernate processes idle for too long */
+#define isHibernating(p) ((p)->frozen!=NULL)
 processpo add_to_run_q(processpo p,logical fr); /* add a process to the run Q */
 processpo remove_from_run_q(register processpo p,process_state reason);
 void MonitorDie(objPo H);	/* send termination message to monitor */
@@ -114,6 +158,7 @@ retCode m_filer(processpo p,objPo *args);
 retCode m_file_manager(processpo p,objPo *args); /* set name of the filer */
 retCode m_kill(processpo p,objPo *args);
 retCode m_wait_msg(processpo p,objPo *args);
+retCode m_hibernate(processpo p,objPo *args);
 
 retCode m_credit_clicks(processpo p,objPo *args);
 retCode m_clicks(processpo p,objPo *args);
@@ -0,0 +1,16 @@
+/*
+ * Header for the sampling profiler
+ */
+#ifndef _PROFILE_H_
+#define _PROFILE_H_
+
+#define PROFILETICKS 10		/* Milliseconds of cpu time between samples */
+#define PROFILEDEPTH 64		/* Most frames recorded in a sample */
+
+extern char *profileFile;	/* where samples are written, if profiling */
+extern logical sampleDue;	/* set by the timer when a sample should be taken */
+
+void profileSample(processpo p); /* record where p is */
+void dumpProfile(void);		/* write out the samples */
+
+#endif
@@ -2,14 +2,31 @@
 #define _STATS_H_
 
 #ifdef STATISTICS
-extern logical statistics;	/* true if stats collection enabled */
-void stat_ins_start(void);	/* Initialize stats collection for instructions */
-void stat_ins_usage(long ins);	/* instruction usage */
+/*
+ * Execution profile, collected when the engine is configured with
+ * --enable-statistics
+ */
+#define STATOPS 256		/* opcodes are one byte */
+
+extern unsigned long opCounts[STATOPS]; /* executions of each opcode */
+extern unsigned long pairCounts[STATOPS][STATOPS]; /* and of each pair */
+extern int lastOp;		/* the previous instruction executed */
+
+#define stat_ins_usage(op) {\
+  opCounts[op]++;\
+  pairCounts[lastOp][op]++;\
+  lastOp = (op);\
+}
+
+void stat_ins_start(void);	/* Clear the collected statistics */
+retCode stat_escape(funpo ef,int code,processpo P,objPo *SP); /* timed escape */
 void dump_stats(void);		/* Display statistics */
 void dump_escape_stats(void);
 
 #endif
 
+retCode m_stats(processpo p,objPo *args);
+
 typedef enum {initTime,execTime, gcTime, allocTime, escTime, endTime, noTime} statMode;
 void startClock(void);
 void stopClock(void);
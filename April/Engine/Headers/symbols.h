@@ -10,7 +10,7 @@
 extern objPo kvoid,kany,kanyQ;
 extern objPo kanyTp,kfunTp,kprocTp,ktplTp,klstTp,kallQ;
 extern objPo knumberTp, ksymbolTp, kcharTp, khandleTp, kstringTp ,klogicalTp,kqueryTp,kopaqueTp;
-extern objPo msgTp, monitorTp, debugTp;
+extern objPo msgTp, mcastTp, monitorTp, debugTp;
 
 extern objPo kerror,kinterrupt,ktimedout,kfailed,kclicked,kblock;
 extern objPo emptyList,emptySymbol,emptyTuple,ktpl;
@@ -9,12 +9,23 @@ retCode displayType(ioPo f,objPo p,long width,int prec,logical alt);
 retCode wStringChr(ioPo f,uniChar ch);
 retCode ReadData(ioPo in,objPo *tgt);
 retCode readFmtd(ioPo in,processpo p,char *fmt,objPo *result);
-retCode decodeICM(ioPo in,objPo *tgt,logical verify);
+struct _icm_dict_;		/* see labels.h */
+
+retCode decodeICM(ioPo in,objPo *tgt,logical verify,struct _icm_dict_ *dict);
+retCode decodeLazyICM(ioPo in,objPo *tgt,logical verify); /* nested code on first call */
 retCode decInt(ioPo in,integer *ii,uniChar tag);
-retCode encodeICM(ioPo out,objPo input);
+retCode encodeICM(ioPo out,objPo input,logical share,struct _icm_dict_ *dict);
 retCode encodeInt(ioPo out,long val,int tag);
 
 extern logical verifyCode;
 char *codeVerify(objPo code,logical allow_priv);
+char *sigVerify(objPo code);	/* just the signature */
+
+#define VERIFYVERSION 1		/* Change whenever the verifier's rules do */
+extern char *verifyCacheFile;
+char *verifyCached(objPo code,logical allow_priv); /* skip code verified before */
+
+#define DIGESTLEN 32		/* Length of a SHA-256 digest */
+logical fileDigest(char *file,unsigned char *d); /* digest of a file's contents */
 
 #endif
@@ -0,0 +1,36 @@
+/*
+ * Header for the native message transport -- ICM frames over TCP
+ */
+#ifndef _TRANSPORT_H_
+#define _TRANSPORT_H_
+
+#include <sys/select.h>
+
+#ifndef TRANSPORTBATCH
+#define TRANSPORTBATCH 64	/* Frames queued on a connection before we write */
+#endif
+
+#ifndef TRANSPORTRING
+#define TRANSPORTRING (1<<20)	/* Size of a ring between neighbours */
+#endif
+
+#ifndef TRANSPORTROUTES
+#define TRANSPORTROUTES 4096	/* Most routes learned from incoming messages */
+#endif
+
+#define TRANSPORTIOV 64		/* Most frames written by one writev */
+#define TRANSPORTMAXFRAME (16*1024*1024) /* Largest frame we will accept */
+
+retCode transportSend(objPo to,objPo sender,objPo opts,objPo msg);
+
+void transportSleep(void);	/* we are about to wait */
+int transportFds(fd_set *in,fd_set *out,int max); /* what to wait for */
+void transportAwake(void);	/* we have stopped waiting */
+void transportPoll(void);	/* accept, read and deliver; allocates */
+void flushTransport(void);	/* write out the queued frames */
+
+/* Escape functions */
+retCode m_transport_listen(processpo p,objPo *args);
+retCode m_transport_route(processpo p,objPo *args);
+
+#endif
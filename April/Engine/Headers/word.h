@@ -594,6 +594,12 @@ objPo allocateCode(integer size,integer count);
 void updateCodeLit(objPo pc,uinteger offset,objPo el);
 void updateCodeSig(objPo pc,objPo el);
 void updateCodeFrSig(objPo pc,objPo el);
+unsigned long scanSpaceReq(insPo code,unsigned long size);
+
+/* Stubs for code that is loaded when it is first called */
+logical isLazyCode(objPo code);
+retCode loadLazyCode(objPo stub,objPo *tgt); /* the code a stub stands for */
+unsigned char *lazyCodeText(objPo stub,integer *len,objPo *loaded);
 
 typedef struct _forward_record_ {
   integer sign;			/* Signature of a forwarded pointer */
@@ -0,0 +1,270 @@
+/*
+  Asynchronous escapes -- blocking operations executed by worker threads
+  (c) 1994-2002 Imperial College and F.G.McCabe
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+  Contact: Francis McCabe <fgm@fla.fujitsu.com>
+*/
+
+/*
+ * An escape that would block the engine hands its work to a worker thread
+ * and suspends the calling process in wait_io. The worker only sees C data
+ * -- it must never touch the heap. When the job is finished the worker posts
+ * it back through a pipe, the scheduler notices the pipe going ready, and
+ * the process is put back on the run queue. Since the escape backed up the
+ * process's PC before suspending, the escape is re-entered and picks up the
+ * result with asyncResult.
+ *
+ * Without thread support, jobs are simply executed in line.
+ */
+
+#include "config.h"		/* pick up standard configuration header */
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#ifdef HAVE_LIBPTHREAD
+#include <pthread.h>
+#endif
+
+#include "april.h"
+#include "process.h"
+#include "clock.h"
+#include "async.h"
+
+static asyncPo jobs = NULL;	/* All the jobs known to the engine */
+
+#ifdef HAVE_LIBPTHREAD
+static pthread_mutex_t qLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t qCond = PTHREAD_COND_INITIALIZER;
+static asyncPo queue = NULL;	/* Jobs waiting for a worker */
+static asyncPo qTail = NULL;
+
+static pthread_mutex_t cLock = PTHREAD_MUTEX_INITIALIZER;
+static asyncPo completed = NULL; /* Jobs finished by a worker */
+
+static int asyncPipe[2] = {-1,-1};
+static logical started = False;
+
+static void *worker(void *arg)
+{
+  sigset_t all;
+
+  sigfillset(&all);		/* signals are for the engine thread */
+  pthread_sigmask(SIG_BLOCK,&all,NULL);
+
+  for(;;){
+    asyncPo job;
+
+    pthread_mutex_lock(&qLock);
+    while(queue==NULL)
+      pthread_cond_wait(&qCond,&qLock);
+    job = queue;
+    if((queue=job->next)==NULL)
+      qTail = NULL;
+    pthread_mutex_unlock(&qLock);
+
+    errno = 0;
+    job->ret = job->fun(job);
+    job->err = errno;
+
+    pthread_mutex_lock(&cLock);
+    job->next = completed;
+    completed = job;
+    pthread_mutex_unlock(&cLock);
+
+    write(asyncPipe[1],"",1);	/* kick the engine */
+    wakeywakey = True;
+  }
+  return NULL;
+}
+
+static retCode startWorkers(void)
+{
+  if(!started){
+    int i;
+
+    if(pipe(asyncPipe)!=0)
+      return Error;
+
+    fcntl(asyncPipe[0],F_SETFL,O_NONBLOCK);
+
+    for(i=0;i<ASYNCWORKERS;i++){
+      pthread_t th;
+
+      if(pthread_create(&th,NULL,worker,NULL)!=0)
+	return i>0?Ok:Error;
+      pthread_detach(th);
+    }
+    started = True;
+  }
+  return Ok;
+}
+#endif
+
+static void unlinkJob(asyncPo job)
+{
+  asyncPo *j = &jobs;
+
+  while(*j!=NULL){
+    if(*j==job){
+      *j = job->chain;
+      return;
+    }
+    else
+      j = &(*j)->chain;
+  }
+}
+
+/*
+ * Start a job on behalf of process p; the job owns the malloc'd data.
+ * Normally the process is suspended and Suspend is returned; if the job
+ * had to be run in line, Ok is returned and the result is available
+ * immediately through asyncResult.
+ */
+retCode asyncEscape(processpo p,asyncFun fun,void *data)
+{
+  asyncPo job = (asyncPo)malloc(sizeof(AsyncRec));
+
+  if(job==NULL){
+    free(data);
+    return Space;
+  }
+
+  job->fun = fun;
+  job->p = p;
+  job->data = data;
+  job->ret = Ok;
+  job->err = 0;
+  job->done = False;
+  job->next = NULL;
+  job->chain = jobs;
+  jobs = job;
+
+#ifdef HAVE_LIBPTHREAD
+  if(startWorkers()==Ok){
+    pthread_mutex_lock(&qLock);
+    if(qTail!=NULL)
+      qTail->next = job;
+    else
+      queue = job;
+    qTail = job;
+    pthread_cond_signal(&qCond);
+    pthread_mutex_unlock(&qLock);
+
+    p->pc--;			/* re-enter the escape when we are done */
+    ps_suspend(p,wait_io);
+    return Suspend;
+  }
+#endif
+
+  job->ret = fun(job);		/* no workers, do it now */
+  job->err = errno;
+  job->done = True;
+  return Ok;
+}
+
+/* Pick up the completed job of a given kind for a process */
+asyncPo asyncResult(processpo p,asyncFun fun)
+{
+  asyncPo job = jobs;
+
+  while(job!=NULL){
+    if(job->p==p && job->fun==fun && job->done){
+      unlinkJob(job);
+      return job;
+    }
+    job = job->chain;
+  }
+  return NULL;
+}
+
+void asyncFree(asyncPo job)
+{
+  if(job->data!=NULL)
+    free(job->data);
+  free(job);
+}
+
+/*
+ * The process is going away, or is no longer waiting for its jobs.
+ * Jobs still in the hands of the workers are orphaned and discarded
+ * when they complete.
+ */
+void asyncCancel(processpo p)
+{
+  asyncPo job = jobs;
+
+  while(job!=NULL){
+    asyncPo next = job->chain;
+
+    if(job->p==p){
+      if(job->done){
+	unlinkJob(job);
+	asyncFree(job);
+      }
+      else
+	job->p = NULL;
+    }
+    job = next;
+  }
+}
+
+int asyncPollFd(void)
+{
+#ifdef HAVE_LIBPTHREAD
+  return asyncPipe[0];
+#else
+  return -1;
+#endif
+}
+
+void asyncComplete(void)
+{
+#ifdef HAVE_LIBPTHREAD
+  if(started){
+    char buff[64];
+    asyncPo done;
+
+    while(read(asyncPipe[0],buff,sizeof(buff))>0)
+      ;				/* drain the pipe */
+
+    pthread_mutex_lock(&cLock);
+    done = completed;
+    completed = NULL;
+    pthread_mutex_unlock(&cLock);
+
+    while(done!=NULL){
+      asyncPo job = done;
+      processpo p = job->p;
+
+      done = job->next;
+
+      if(p==NULL){		/* nobody is interested any more */
+	unlinkJob(job);
+	asyncFree(job);
+      }
+      else{
+	job->done = True;
+
+	if(ps_state(p)==wait_io)
+	  add_to_run_q(p,False);
+      }
+    }
+  }
+#endif
+}
@@ -28,11 +28,12 @@
 #include "process.h"
 #include "clock.h"
 #include "symbols.h"
+#include "profile.h"
 
 #define MAXTIMEOUT 200		/* initial number of time records */
 
 typedef struct time_rec {
-  processpo ps;			/* process to wake up */
+  processpo ps;			/* process to wake up, NULL for an engine timer */
   struct timeval tval;		/* what time ? */
   timeFun onWakeup;             // What to do when we wake up
   void *cl;                     // client data
@@ -126,11 +127,13 @@ void sig_alarm(int sig)		/* UNIX version of timer handler */
 
 static void timerWakeup(int ignored);
 
+static WORD32 tickGap = 0;	/* milliseconds between scheduler ticks */
+static WORD32 tickTime = 0;	/* cpu time since the last tick when profiling */
+
 void setupTicks(WORD32 gap)	/* set up the tick timer every gap millisecs*/
 {
   struct sigaction act;
   struct itimerval period;
-  static WORD32 lastGap = 0;
 
   act.sa_handler = timerWakeup;
   act.sa_flags = 0;
@@ -140,12 +143,15 @@ void setupTicks(WORD32 gap)	/* set up the tick timer every gap millisecs*/
   sigaction(SIGVTALRM,&act,NULL);
 
   if(gap<0)
-    gap = lastGap;
+    gap = tickGap;
 
-  lastGap = gap;
+  tickGap = gap;
   
   if(gap<SCHEDULETICKS/10)
-    gap = lastGap = SCHEDULETICKS;
+    gap = tickGap = SCHEDULETICKS;
+
+  if(profileFile!=NULL)		/* the profiler samples more often */
+    gap = PROFILETICKS;
 
   period.it_value.tv_sec = gap/1000;
   period.it_value.tv_usec = gap*1000;
@@ -156,6 +162,17 @@ void setupTicks(WORD32 gap)	/* set up the tick timer every gap millisecs*/
 
 static void timerWakeup(int sig) /* This one is invoked for cpu time */
 {
+  if(profileFile!=NULL){
+    sampleDue = True;		/* Signal the profiler */
+
+    tickTime += PROFILETICKS;
+    if(tickTime<tickGap){
+      setupTicks(-1);
+      return;			/* not yet time to reschedule */
+    }
+    tickTime = 0;
+  }
+
   wakeywakey = True;		/* Signal scheduler */
 
 #ifdef CLOCKTRACE
@@ -204,7 +221,7 @@ void reset_timer(void)
       time_q = time_q->next;
 
 #ifdef CLOCKTRACE
-      if(traceClock)
+      if(traceClock && t->ps!=NULL)
 	outMsg(logFile,"Wakeup [%#w] (timed out)\n",t->ps->handle);
 #endif
 
@@ -287,7 +304,7 @@ static void add_to_time_q(timepo t)
   /* find place in queue to insert */
   while(tp!=NULL && (tp->tval.tv_sec<t_secs || 
 		     (tp->tval.tv_sec==t_secs &&tp->tval.tv_usec<t_usecs)))
-    if(p!=tp->ps){		/* skip timer entry for different process */
+    if(p==NULL || p!=tp->ps){	/* skip timer entry for different process */
       prev = &tp->next;
       tp = *prev;
     }
@@ -300,8 +317,8 @@ static void add_to_time_q(timepo t)
   tr = tp;			/* look for redundant entries for the same process*/
   trp = prev;
 
-  while(tr!=NULL){
-    if(tr->ps==t->ps){		/* a redundant entry later in the Q */
+  while(tr!=NULL && p!=NULL){
+    if(tr->ps==p){		/* a redundant entry later in the Q */
       *trp = tr->next;		/* removing redundant entry */
       freePool(time_pool,(void*)tr);
       tr = *trp;
@@ -470,6 +487,29 @@ void flush_from_time_q(processpo p)
   }
 }
 
+/* remove an engine timer -- one that is not attached to a process */
+void flush_timer(timeFun onWakeup,void *cl)
+{
+  timepo tp = time_q;
+  timepo prev = NULL;
+
+  while(tp!=NULL){
+    if(tp->ps==NULL && tp->onWakeup==onWakeup && tp->cl==cl){
+      timepo next = tp->next;
+      if(prev==NULL)
+	time_q = next;
+      else
+	prev->next = next;
+      freePool(time_pool,(void*)tp);
+      tp = next;
+    }
+    else{
+      prev = tp;
+      tp = tp->next;
+    }
+  }
+}
+
 /*
  *  returns the current ticks
  */
@@ -524,7 +564,7 @@ void display_time_q(void)
 	  n.tv_sec-t.tv_sec+(n.tv_usec-t.tv_usec)/1e6);
   if(tm!=NULL){
     while(tm!=NULL){
-      outMsg(logFile, "%#w(%8.5f) ", tm->ps->handle,
+      outMsg(logFile, "%#w(%8.5f) ", (tm->ps!=NULL?tm->ps->handle:knullhandle),
 	     tm->tval.tv_sec-n.tv_sec+(tm->tval.tv_usec-n.tv_usec)/1e6);
       tm = tm->next;
     }
@@ -30,6 +30,7 @@
 #include "astring.h"
 #include "symbols.h"		/* We need some standard symbols */
 #include "process.h"
+#include "opcodes.h"
 
 /* Call a program out of an any structure and a list of strings  */
 /* Used to invoke the user's main program */
@@ -131,3 +132,21 @@ inline objPo *codeFreeVector(objPo p)
   
   return consData(p);
 }
+
+/* Compute the approximate stack space a code segment needs below its frame
+   pointer -- the deepest allocv plus room for an outgoing call */
+unsigned long scanSpaceReq(insPo code,unsigned long size)
+{
+  unsigned long req = 0;
+  unsigned long i;
+
+  for(i=0;i<size;i++){
+    if(op_cde(code[i])==allocv){
+      WORD32 depth = -op_so_val(code[i]);
+
+      if(depth>=0 && depth>req) /* a big frame needs a big stack */
+	req = depth;
+    }
+  }
+  return req+FRAMESLACK;
+}
@@ -391,6 +391,11 @@ static WORD32 countBits(cardMap *map,WORD32 limit)
 }
 #endif
 
+static objPo markedOpaque(objPo o)
+{
+  return marked(o)?o:NULL;
+}
+
 objPo compactHeap(objPo heap,objPo end,objPo heaplimit)
 {
   objPo next = heap;		/* we have to scan the whole heap... */
@@ -418,6 +423,10 @@ objPo compactHeap(objPo heap,objPo end,objPo heaplimit)
   markProcesses();
   markRoots();
   markLabels();
+  markImage();
+
+  sweepOpaques(markedOpaque);	/* finalise before the dead are overwritten */
+  sweepDebugSites(markedOpaque);
 
   if(oCnt>(breakPo)heaplimit-(breakPo)end)
     Brk = endBrk = (breakPo)malloc(sizeof(breakEntry)*oCnt);
@@ -651,6 +660,9 @@ objPo compactHeap(objPo heap,objPo end,objPo heaplimit)
   adjustProcesses();
   adjustHandles();
   adjustLabels();
+  adjustImage();
+  sweepOpaques(adjustCell);
+  sweepDebugSites(adjustCell);
 
   if(Brk!=(breakPo)end)
     free(Brk);
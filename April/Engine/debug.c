@@ -162,6 +162,20 @@ insPo dissass(insPo pc,insPo base,objPo *fp, objPo *e,objPo *lits)
     return pc+1;
   }
 
+  case tcall:			/* tail call procedure */
+    outMsg(logFile,"tcall ");
+    p_d(op_sh_val(pcx),",");
+    p_d(op_sm_val(pcx),",");
+    p_s(fp,op_sl_val(pcx),"");
+    return pc+1;
+
+  case etcall:			/* tail call procedure */
+    outMsg(logFile,"etcall ");
+    p_d(op_sh_val(pcx),",");
+    p_d(op_sm_val(pcx),",");
+    p_e(e,op_sl_val(pcx),"");
+    return pc+1;
+
   case ret:			/* Return from procedure */
     outMsg(logFile,"ret");
     return pc+1;
@@ -649,6 +663,58 @@ insPo dissass(insPo pc,insPo base,objPo *fp, objPo *e,objPo *lits)
     p_a(pc+1,op_so_val(pcx),"");
     return pc+1;
 
+    /* superinstructions -- the next instruction is shown on its own */
+
+  case ieqjmp:			/* integer equality, and jump */
+    outMsg(logFile,"ieqjmp ");
+    p_s(fp,op_sm_val(pcx),",");
+    p_s(fp,op_sl_val(pcx),"");
+    return pc+1;
+
+  case ineqjmp:			/* integer inequality, and jump */
+    outMsg(logFile,"ineqjmp ");
+    p_s(fp,op_sm_val(pcx),",");
+    p_s(fp,op_sl_val(pcx),"");
+    return pc+1;
+
+  case ilejmp:			/* integer less than or equal, and jump */
+    outMsg(logFile,"ilejmp ");
+    p_s(fp,op_sm_val(pcx),",");
+    p_s(fp,op_sl_val(pcx),"");
+    return pc+1;
+
+  case igtjmp:			/* integer greater than, and jump */
+    outMsg(logFile,"igtjmp ");
+    p_s(fp,op_sm_val(pcx),",");
+    p_s(fp,op_sl_val(pcx),"");
+    return pc+1;
+
+  case mlistjmp:		/* Match a non-empty list, or jump */
+    outMsg(logFile,"mlistjmp ");
+    p_s(fp,op_sh_val(pcx),",");
+    p_s(NULL,op_sm_val(pcx),",");
+    p_s(NULL,op_sl_val(pcx),"");
+    return pc+1;
+
+  case movlesc:			/* Move a literal, and escape */
+    outMsg(logFile,"movlesc ");
+    p_lit(lits[op_o_val(pcx)],",");
+    p_s(NULL,op_sh_val(pcx),"");
+    return pc+1;
+
+  case emovecall:		/* Move from environment, and call */
+    outMsg(logFile,"emovecall ");
+    p_e(e,op_sm_val(pcx),",");
+    p_s(NULL,op_sl_val(pcx),"");
+    return pc+1;
+
+  case lstprs:			/* Construct a list pair, and the next */
+    outMsg(logFile,"lstprs ");
+    p_s(fp,op_sh_val(pcx),",");
+    p_s(fp,op_sm_val(pcx),",");
+    p_s(NULL,op_sl_val(pcx),"");
+    return pc+1;
+
   default:			/* anything else? */
     outMsg(logFile,"unknown[%lx]",pcx);
     return pc+1;
@@ -0,0 +1,293 @@
+/*
+  Patchable debugging instructions
+  (c) 1994-2003 Imperial College and F.G.McCabe
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+  Contact: Francis McCabe <fgm@fla.fujitsu.com>
+*/
+
+/*
+ * Code compiled for debugging is full of debugging instructions, which do
+ * nothing unless a debugger is attached. When code is loaded and there is
+ * no debugger, each of them is overwritten by a jmp to where execution
+ * would go after it -- past any debugging instructions that follow, and
+ * past the code that debug_d guards. The instructions that were replaced
+ * are kept here, and are put back when a debugger is attached.
+ *
+ * The table does not keep code alive: the garbage collector tells us
+ * where code has moved to, and which code has gone.
+ */
+
+#include "config.h"		/* pick up standard configuration header */
+#include <stdlib.h>
+#include <string.h>
+
+#include "april.h"
+#include "gcP.h"
+#include "process.h"
+#include "opcodes.h"
+#include "debug.h"
+
+#define SITESINIT 64		/* Initial size of the table of segments */
+
+typedef struct {
+  unsigned long off;		/* where the site is in the code */
+  unsigned WORD32 ins;		/* the instruction that was there */
+} SiteRec, *sitePo;
+
+typedef struct {
+  objPo code;			/* the code segment */
+  long count;			/* how many sites were disabled */
+  sitePo sites;			/* in order of their offsets */
+} SegRec, *segPo;
+
+static SegRec *segs = NULL;	/* segments with disabled sites */
+static long segCount = 0;
+static long segMax = 0;
+
+static long *segIndex = NULL;	/* open hash table of segments by address */
+static unsigned long indexSize = 0;
+
+static inline unsigned long hashCode(objPo code)
+{
+  return ((((unsigned long)code)>>3)*2654435761ul)&(indexSize-1);
+}
+
+static void indexSeg(long i)
+{
+  unsigned long h = hashCode(segs[i].code);
+
+  while(segIndex[h]>=0)
+    h = (h+1)&(indexSize-1);
+  segIndex[h] = i;
+}
+
+/* Rebuild the index -- code moves when the garbage collector runs */
+static void reIndex(void)
+{
+  long i;
+
+  if(indexSize<2*segCount+SITESINIT){	/* keep the table half empty */
+    while(indexSize<2*segCount+SITESINIT)
+      indexSize = (indexSize==0?SITESINIT:indexSize<<1);
+    free(segIndex);
+    segIndex = (long*)malloc(indexSize*sizeof(long));
+  }
+
+  for(i=0;i<(long)indexSize;i++)
+    segIndex[i] = -1;
+
+  for(i=0;i<segCount;i++)
+    indexSeg(i);
+}
+
+static segPo findSeg(objPo code)
+{
+  unsigned long h;
+
+  if(segCount==0)
+    return NULL;
+
+  for(h=hashCode(code);segIndex[h]>=0;h=(h+1)&(indexSize-1))
+    if(segs[segIndex[h]].code==code)
+      return &segs[segIndex[h]];
+  return NULL;
+}
+
+static logical debugIns(opCode op)
+{
+  switch(op){
+  case line_d:
+  case entry_d:
+  case exit_d:
+  case assign_d:
+  case return_d:
+  case accept_d:
+  case die_d:
+  case send_d:
+  case fork_d:
+  case scope_d:
+  case suspend_d:
+  case error_d:
+  case debug_d:
+    return True;
+  default:
+    return False;
+  }
+}
+
+/* Where a site goes to when we are not debugging */
+static long siteNext(insPo pc,long off)
+{
+  switch(op_cde(pc[off])){
+  case line_d:
+    return off+2;		/* step over the file name */
+  case debug_d:
+    return off+1+op_so_val(pc[off]);
+  default:
+    return off+1;
+  }
+}
+
+static long findSite(sitePo sites,long count,unsigned long off)
+{
+  long lo = 0, hi = count-1;
+
+  while(lo<=hi){
+    long mid = (lo+hi)/2;
+
+    if(sites[mid].off==off)
+      return mid;
+    else if(sites[mid].off<off)
+      lo = mid+1;
+    else
+      hi = mid-1;
+  }
+  return -1;
+}
+
+/* Overwrite the debugging instructions in freshly loaded code */
+void disableDebugSites(objPo code)
+{
+  insPo pc = CodeCode(code);
+  long size = CodeSize(code);
+  long count = 0;
+  long i,k;
+  sitePo sites;
+  long *tgts;
+
+  if(SymbolDebug || findSeg(code)!=NULL)
+    return;
+
+  for(i=0;i<size;i++){
+    opCode op = op_cde(pc[i]);
+
+    if(debugIns(op))
+      count++;
+    if(op==line_d)
+      i++;
+  }
+
+  if(count==0)
+    return;
+
+  sites = (sitePo)malloc(count*sizeof(SiteRec));
+  tgts = (long*)malloc(count*sizeof(long));
+
+  if(sites==NULL || tgts==NULL){
+    free(sites);
+    free(tgts);
+    return;			/* leave the code as it is */
+  }
+
+  for(i=k=0;i<size;i++){
+    opCode op = op_cde(pc[i]);
+
+    if(debugIns(op)){
+      sites[k].off = i;
+      sites[k++].ins = pc[i];
+    }
+    if(op==line_d)
+      i++;
+  }
+
+  /* Later sites are resolved first, so a jump can skip a run of them */
+  for(k=count-1;k>=0;k--){
+    long nxt = siteNext(pc,sites[k].off);
+    long s;
+
+    if(nxt>(long)sites[k].off && (s=findSite(sites,count,nxt))>k)
+      tgts[k] = tgts[s];
+    else
+      tgts[k] = nxt;
+  }
+
+  if(segCount>=segMax){
+    segMax = (segMax==0?SITESINIT:segMax<<1);
+    segs = (SegRec*)realloc(segs,segMax*sizeof(SegRec));
+  }
+
+  segs[segCount].code = code;
+  segs[segCount].count = count;
+  segs[segCount].sites = sites;
+
+  if(indexSize<2*(segCount+1))
+    reIndex();
+  indexSeg(segCount++);
+
+  for(k=0;k<count;k++){
+    long off = sites[k].off;
+
+    pc[off] = jmp|(((tgts[k]-(off+1))<<8)&vl_O_mask);
+  }
+
+  free(tgts);
+}
+
+/* A debugger has been attached: put back all the debugging instructions */
+void enableDebugSites(void)
+{
+  long i,k;
+
+  for(i=0;i<segCount;i++){
+    insPo pc = CodeCode(segs[i].code);
+
+    for(k=0;k<segs[i].count;k++)
+      pc[segs[i].sites[k].off] = segs[i].sites[k].ins;
+    free(segs[i].sites);
+  }
+
+  if(segCount>0){
+    segCount = 0;
+    reIndex();
+  }
+}
+
+/* The instruction that was loaded at off, before it was disabled */
+unsigned WORD32 loadedIns(objPo code,unsigned long off)
+{
+  segPo seg = findSeg(code);
+
+  if(seg!=NULL){
+    long k = findSite(seg->sites,seg->count,off);
+
+    if(k>=0)
+      return seg->sites[k].ins;
+  }
+  return CodeCode(code)[off];
+}
+
+/* The garbage collector has moved, or dropped, some code */
+void sweepDebugSites(objPo (*alive)(objPo o))
+{
+  long i,j;
+
+  if(segCount==0)
+    return;
+
+  for(i=j=0;i<segCount;i++){
+    objPo n = alive(segs[i].code);
+
+    if(n!=NULL){
+      segs[j] = segs[i];
+      segs[j++].code = n;
+    }
+    else
+      free(segs[i].sites);
+  }
+  segCount = j;
+  reIndex();
+}
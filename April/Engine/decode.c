@@ -36,6 +36,8 @@
 #include "ioP.h"
 #include "encoding.h"
 #include "labels.h"
+#include "opcodes.h"
+#include "debug.h"
 
 /* Decode an ICM message ... from the file stream */
 
@@ -43,39 +45,109 @@ static retCode decode(ioPo in,WORD64 lbl,objPo *tgt,logical verify);
 
 static objPo *lbls=NULL;	/* these labels are for circular refs ... */
 static WORD32 maxlbl = 0;
+static WORD32 toplbl = 0;	/* labels used by this message */
+
+static objPo *tvars=NULL;	/* type variables, indexed by their number */
+static WORD32 maxtv = 0;
+static WORD32 toptv = 0;
+
+static icmDictPo dict = NULL;	/* the dictionary of the stream being read */
+static icmDictPo scratch = NULL; /* used when the stream does not have one */
+
+static logical lazyLoad = False; /* are nested code segments loaded lazily? */
+static int codeDepth = 0;	/* how deeply nested the current code is */
+
+#define LAZY_OPAQUE 'Z'
+#define LAZY_TEXT 0		/* the literal holding the segment's text */
+#define LAZY_CODE 1		/* the literal holding the loaded code */
+
+typedef struct {
+  byte *data;			/* The text of the code segment */
+  integer len;
+  integer sigOff;		/* Where its signatures start */
+  logical verify;		/* verify it when it is loaded? */
+} LazyRec, *lazyPo;
 
 #define ICM_VAL_MASK 0x0f
 #define ICM_TAG_MASK 0xf0
 
 #define try(S) {retCode ret = S; if(ret!=Ok) return ret;}
 
-static lblPo tvars = NULL;
-static lblPo refs = NULL;
-/* 
- * Decode a structure from an input stream
- */
-retCode decodeICM(ioPo in,objPo *tgt,logical verify)
+/* Make sure that a label table has room for entry ix */
+static retCode labelRoom(objPo **tbl,WORD32 *max,integer ix)
 {
-  retCode ret = Ok;
-  
-  if(lbls==NULL){
-    lbls = (objPo *)malloc(sizeof(objPo)*128);
-    if(lbls==NULL)
-      return Error;
-    else
-      maxlbl = 128;
+  if(ix<0)
+    return Error;
+  else if(ix>=*max){
+    WORD32 newmax = ix+(*max>>1)+1; /* 50% growth */
+    objPo *newlabels = (objPo *)realloc(*tbl,sizeof(objPo)*newmax);
+
+    if(newlabels==NULL)
+      return Space;
+
+    memset(&newlabels[*max],0,sizeof(objPo)*(newmax-*max));
+    *tbl = newlabels;
+    *max = newmax;
   }
+  return Ok;
+}
+
+/* Set up the tables for a new message */
+static retCode startMessage(icmDictPo streamDict)
+{
+  if(labelRoom(&lbls,&maxlbl,127)!=Ok || labelRoom(&tvars,&maxtv,15)!=Ok)
+    return Error;
   
   strMsg(errorMsg,NumberOf(errorMsg),"");
-  
-  memset(lbls,0,sizeof(objPo)*maxlbl); /* clear the label table */
-  tvars = NULL;
-  refs = NULL;
-  ret = decode(in,-1,tgt,verify);
-  
-  tvars = freeAllLabels(tvars);
-  refs = freeAllLabels(refs);
-  
+
+  if(streamDict!=NULL)
+    dict = streamDict;
+  else{
+    if(scratch==NULL)
+      scratch = newIcmDict();
+    dict = scratch;
+  }
+  return Ok;
+}
+
+static void endMessage(void)
+{
+  memset(lbls,0,sizeof(objPo)*toplbl); /* clear the parts of the tables we used */
+  memset(tvars,0,sizeof(objPo)*toptv);
+  toplbl = toptv = 0;
+
+  if(dict==scratch)
+    clearIcmDict(scratch);
+  dict = NULL;
+}
+
+/* 
+ * Decode a structure from an input stream. Dictionary entries are kept in
+ * the stream's dictionary, if it has one, so that later messages can
+ * refer to them; otherwise they only last for this message.
+ */
+retCode decodeICM(ioPo in,objPo *tgt,logical verify,icmDictPo streamDict)
+{
+  retCode ret = startMessage(streamDict);
+
+  if(ret==Ok){
+    ret = decode(in,-1,tgt,verify);
+    endMessage();
+  }
+  return ret;
+}
+
+/*
+ * Decode a code module, leaving its nested code segments to be decoded --
+ * and verified -- when they are first called.
+ */
+retCode decodeLazyICM(ioPo in,objPo *tgt,logical verify)
+{
+  retCode ret;
+
+  lazyLoad = True;
+  ret = decodeICM(in,tgt,verify,NULL);
+  lazyLoad = False;
   return ret;
 }
 
@@ -105,6 +177,52 @@ retCode decInt(ioPo in,integer *ii,uniChar tag)
 }
 
 static retCode decodeCode(ioPo str,objPo *tgt,logical verify);
+static integer lazyText(byte *b,integer len);
+static retCode decodeStub(ioPo in,byte *text,integer len,integer sigOff,
+			  objPo *tgt,logical verify);
+
+/* Read a block of bytes, however many reads it takes */
+static retCode readBlock(ioPo in,byte *buff,integer len)
+{
+  integer got = 0;
+
+  while(got<len){
+    integer actual;
+    retCode res = inBytes(in,buff+got,len-got,&actual);
+
+    if(res!=Ok)
+      return res;
+    else if(actual==0)
+      return Eof;
+    got += actual;
+  }
+  return Ok;
+}
+
+static retCode decodeSym(ioPo in,uniChar ch,objPo *tgt)
+{
+  integer len;
+  retCode res;
+
+  if((res=decInt(in,&len,ch))!=Ok)
+    return res;
+  else{
+    char sbuff[MAX_SYMB_LEN];
+    char *sym = (len<NumberOf(sbuff)?sbuff:(char*)malloc((len+1)*sizeof(char)));
+
+    if((res=readBlock(in,(byte*)sym,len))==Ok){
+      objPo el;
+
+      sym[len]='\0';
+      el = newSymbol(sym);
+      *tgt = el;		/* we do this to ensure correct order of evaluation */
+    }
+
+    if(sym!=sbuff)
+      free(sym);
+    return res;
+  }
+}
 
 /*
   Warning: caller assumes responsibility for ensuring that tgt is a valid rot
@@ -123,16 +241,18 @@ static retCode decode(ioPo in,integer lbl,objPo *tgt,logical verify)
     
     if((res=decInt(in,&v,ch))!=Ok)
       return res;
+    else if((res=labelRoom(&tvars,&maxtv,v))!=Ok)
+      return res==Space?SpaceErr():res;
     else{
-      objPo ref = findObj(v,tvars);
-      
-      if(ref==NULL){
-        ref = allocateVariable();
-        
-        tvars = createLabel(ref,v,tvars);
+      if(tvars[v]==NULL){
+        objPo ref = allocateVariable();
+
+        tvars[v] = ref;
+        if(v>=toptv)
+          toptv = v+1;
       }
       
-      *tgt = ref;
+      *tgt = tvars[v];
       return Ok;
     }
   }
@@ -188,35 +308,8 @@ static retCode decode(ioPo in,integer lbl,objPo *tgt,logical verify)
     return Ok;
   }
 
-  case trmSym:{
-    integer len;
-
-    if((res=decInt(in,&len,ch))!=Ok)
-      return res;
-    else{
-      char sbuff[MAX_SYMB_LEN];
-      char *sym = (len<NumberOf(sbuff)?sbuff:(char*)malloc((len+1)*sizeof(char)));
-      int i;
-      
-      for(i=0;i<len;i++){
-        ch = inCh(in);
-        
-        if(ch==uniEOF)
-          return Eof;
-        sym[i]=ch;
-      }
-      sym[i]='\0';
-      
-      {
-        objPo el = newSymbol(sym);
-        *tgt = el;                      /* we do this to ensure correct order of evaluation */
-      }
-
-      if(sym!=sbuff)
-        free(sym);
-      return Ok;
-    }
-  }
+  case trmSym:
+    return decodeSym(in,ch,tgt);
   
   case trmChar:{
     integer k;
@@ -283,18 +376,33 @@ static retCode decode(ioPo in,integer lbl,objPo *tgt,logical verify)
     else{
       uniChar buffBlock[2048];
       uniChar *buff = (len<NumberOf(buffBlock)?buffBlock:(uniChar*)malloc(sizeof(uniChar)*len));
-      int i;
+      byte *bytes = (byte*)buff;	/* read the bytes into the front of buff */
+      byte *text = NULL;
+      integer sigOff = -1;
+      integer i;
+      ioPo str;
+
+      if((res=readBlock(in,bytes,len))==Ok){
+        if(lazyLoad && codeDepth>0 && (sigOff=lazyText(bytes,len))>=0){
+          if((text=(byte*)malloc(len))==NULL)
+            sigOff = -1;		/* it will have to be loaded now */
+          else
+            memcpy(text,bytes,len);
+        }
 
-      res = Ok;
-      for(i=0;res==Ok && i<len;i++){     /* read in a block of bytes */
-        byte b;
-        res = inByte(in,&b);
-        buff[i]=b&0xff;
-      }
+        for(i=len;i--;)		/* widen them from the back */
+          buff[i] = bytes[i];
 
-      if(res==Ok){
-        ioPo str = openInStr(buff,len,rawEncoding);
-        res = decodeCode(str,tgt,verify);
+        if(sigOff>=0){		/* just the signatures are read now */
+          str = openInStr(buff+sigOff,len-sigOff,rawEncoding);
+          res = decodeStub(str,text,len,sigOff,tgt,verify);
+        }
+        else{
+          str = openInStr(buff,len,rawEncoding);
+          codeDepth++;
+          res = decodeCode(str,tgt,verify);
+          codeDepth--;
+        }
         closeFile(str);
       }
       else
@@ -482,17 +590,11 @@ static retCode decode(ioPo in,integer lbl,objPo *tgt,logical verify)
     if((res=decInt(in,&lbl,ch))!=Ok)
       return res;
 
-    if(lbl>maxlbl){
-      WORD32 newmax = lbl+(maxlbl>>1); /* 50% growth */
-      objPo *newlabels = (objPo *)realloc(lbls,sizeof(objPo)*newmax);
+    if((res=labelRoom(&lbls,&maxlbl,lbl))!=Ok)
+      return res==Space?SpaceErr():res;
 
-      if(newlabels==NULL)
-	return SpaceErr();
-      else{
-	lbls = newlabels;
-	maxlbl = newmax;
-      }
-    }
+    if(lbl>=toplbl)
+      toplbl = lbl+1;
 
     return decode(in,lbl,tgt,verify); /* decode the defined structure */
   }
@@ -502,38 +604,142 @@ static retCode decode(ioPo in,integer lbl,objPo *tgt,logical verify)
 
     if((res=decInt(in,&lbl,ch))!=Ok)
       return res;
+    else if(lbl<0 || lbl>=toplbl || lbls[lbl]==NULL)
+      return Error;		/* a reference to an undefined label */
     *tgt = lbls[lbl];
     return Ok;
   }
+
+  case trmDict:{
+    integer ix;
+
+    if((res=decInt(in,&ix,ch))!=Ok)
+      return res;
+    else if(ix<0 || ix>=ICMDICTMAX)
+      return Error;
+    else if((res=decode(in,-1,tgt,verify))!=Ok)
+      return res;
+    else if((res=setDictValue(dict,ix,*tgt))!=Ok)
+      return res==Space?SpaceErr():res;
+    return Ok;
+  }
+
+  case trmDictRef:{
+    integer ix;
+    objPo el;
+
+    if((res=decInt(in,&ix,ch))!=Ok)
+      return res;
+    else if((el=dictValue(dict,ix))==NULL)
+      return Error;		/* a reference to an undefined entry */
+    *tgt = el;
+    return Ok;
+  }
+
   default:
     return Error;
   }
 }
 
 
-/* swap bytes in the little endian game */
-static inline void SwapBytes(unsigned WORD32 *x)
+static inline unsigned WORD32 bigWord(byte *b)
 {
-  *x=((*x&0xff)<<8)|((*x>>8)&0xff)|((*x&0x00ff0000L)<<8)|((*x&0xff000000L)>>8);
+  return (unsigned WORD32)b[0]<<24|b[1]<<16|b[2]<<8|b[3];
 }
 
-static inline void SwapWords(unsigned WORD32 *x)
+/*
+ * Read the instructions in one block and convert them, in place, to
+ * native words. Each loop is simple enough for the compiler to turn into
+ * vector byte shuffles.
+ */
+static retCode decodeInstructions(ioPo in,insPo cd,integer size,unsigned WORD32 signature)
 {
-  *x = (*x&0x0000ffffL)<<16 | (*x&0xffff0000L)>>16;
+  byte *b = (byte*)cd;
+  retCode res = readBlock(in,b,size*sizeof(instruction));
+  integer i;
+
+  if(res!=Ok)
+    return res;
+
+  switch(signature){
+  case SIGNATURE:		/* endian load same as endian save */
+    for(i=0;i<size;i++)
+      cd[i] = bigWord(b+4*i);
+    break;
+  case SIGNBSWAP:		/* swap bytes keep words */
+    for(i=0;i<size;i++){
+      unsigned WORD32 x = bigWord(b+4*i);
+      cd[i] = (x&0x00ff00ffL)<<8|(x&0xff00ff00L)>>8;
+    }
+    break;
+  case SIGNWSWAP:		/* swap words keep bytes */
+    for(i=0;i<size;i++){
+      unsigned WORD32 x = bigWord(b+4*i);
+      cd[i] = x<<16|x>>16;
+    }
+    break;
+  case SIGNBWSWP:		/* swap words and bytes */
+    for(i=0;i<size;i++)
+      cd[i] = (unsigned WORD32)b[4*i+3]<<24|b[4*i+2]<<16|b[4*i+1]<<8|b[4*i];
+    break;
+  }
+  return Ok;
+}
+
+/* Decode the type signature and free type signature of code */
+static retCode decodeSigs(ioPo in,objPo pc,logical verify)
+{
+  objPo el = kvoid;
+  void *root = gcAddRoot(&pc);
+  entrytype atype;
+  unsigned WORD32 arity;
+  retCode res;
+
+  gcAddRoot(&el);
+
+  if((res=decode(in,-1,&el,verify))==Ok){
+    objPo type;
+
+    updateCodeSig(pc,el);
+    type = CodeSig(pc);
+    
+    while(isBinCall(type=deRefVar(type),kallQ,NULL,&type))
+      ;
+      
+    if(isBinCall(type,kfunTp,&type,NULL)){
+      atype = function;
+      arity = consArity(type);
+    }
+    else if(isConstructor(type,kprocTp)){
+      atype = procedure;
+      arity = consArity(type);
+    }
+    else
+      res = Error;
+
+    if(res==Ok){
+      SetCodeFormArity(pc,atype,arity);
+
+      if((res=decode(in,-1,&el,verify))==Ok)
+        updateCodeFrSig(pc,el);
+    }
+  }
+
+  gcRemoveRoot(root);
+  return res;
 }
 
 static retCode decodeCode(ioPo in,objPo *tgt,logical verify)
 {
   integer size;
   integer litcnt;
-  unsigned WORD32 arity,i;
+  unsigned WORD32 i;
   unsigned WORD32 signature = (inCh(in)&0xff)<<24|
     (inCh(in)&0xff)<<16|
     (inCh(in)&0xff)<<8|
     (inCh(in)&0xff);
   objPo pc=kvoid;
   objPo el=kvoid;
-  entrytype atype;
   objPo *tmp;
   retCode res;
   void *root = gcAddRoot(&pc);	/* in case of GC ... */
@@ -567,130 +773,429 @@ static retCode decodeCode(ioPo in,objPo *tgt,logical verify)
   ((codePo)pc)->frtype = kvoid;
 
   /* get the instructions */
-  {
-    int i;
-    insPo cd = CodeCode(pc);
-    
-    for(i=0;i<size;i++)
-      cd[i]=(inCh(in)&0xff)<<24| (inCh(in)&0xff)<<16|
-	  (inCh(in)&0xff)<<8| (inCh(in)&0xff);
-  }
-  
-  /* Now convert the main code to handle little endians etc */
-  if(signature==SIGNATURE){}	/* endian load same as endian save */
-  else if(signature==SIGNBSWAP){ /* swap bytes keep words */
-    unsigned WORD32 *xx=(unsigned WORD32*)CodeCode(pc);
-    WORD32 cnt = size;
-    for(;cnt--;xx++) 
-      SwapBytes(xx);
-  }
-  else if(signature==SIGNWSWAP){ /* swap words keep bytes */
-    unsigned WORD32 *xx=(unsigned WORD32*)CodeCode(pc);
-    WORD32 cnt = size;
-    for(;cnt--;xx++) 
-      SwapWords(xx);
-  }
-  else if(signature==SIGNBWSWP){ /* swap words and bytes */
-    unsigned WORD32 *xx=(unsigned WORD32*)CodeCode(pc);
-    WORD32 cnt = size;
-    for(;cnt--;xx++){
-      SwapWords(xx);
-      SwapBytes(xx);
-    }
-  }
+  if((res=decodeInstructions(in,CodeCode(pc),size,signature))!=Ok)
+    return res;
+
+  ((codePo)pc)->spacereq = scanSpaceReq(CodeCode(pc),size);
   
   /* Now get the code's literals and type signatures */
-  for(i=0;i<litcnt;i++)
-    if((res=decode(in,-1,&el,verify))!=Ok)
-      return res;
-    else
-      updateCodeLit(pc,i,el);
+  for(i=0;i<litcnt;i++){
+    uniChar ch = inCh(in);
 
-  /* decode the type signature */
-  if((res=decode(in,-1,&el,verify))!=Ok)
-    return res;
-  else
-    updateCodeSig(pc,el);
+    switch(ch&ICM_TAG_MASK){	/* the common literals are read directly */
+    case trmInt:{
+      integer ii;
 
-  {
-    objPo type = CodeSig(pc);
-    
-    while(isBinCall(type=deRefVar(type),kallQ,NULL,&type))
-      ;
-      
-    if(isBinCall(type,kfunTp,&type,NULL)){
-      atype = function;
-      arity = consArity(type);
+      if((res=decInt(in,&ii,ch))==Ok)
+	el = allocateInteger(ii);
+      break;
     }
-    else if(isConstructor(type,kprocTp)){
-      atype = procedure;
-      arity = consArity(type);
+    case trmSym:
+      res = decodeSym(in,ch,&el);
+      break;
+    default:
+      if(ch==uniEOF)
+	return Eof;
+      unGetChar(in,ch);
+      res = decode(in,-1,&el,verify);
     }
+
+    if(res!=Ok)
+      return res;
     else
-      return Error;
+      updateCodeLit(pc,i,el);
   }
 
-  SetCodeFormArity(pc,atype,arity);
-
-  /* decode the free type signature */
-  if((res=decode(in,-1,&el,verify))!=Ok)
+  if((res=decodeSigs(in,pc,verify))!=Ok)
     return res;
-  else
-    updateCodeFrSig(pc,el);
 
   gcRemoveRoot(root);		/* now for the verification */
   
   if(verify){
-    char *msg = codeVerify(*tgt,True);
+    char *msg = verifyCached(*tgt,True);
     
     if(msg!=NULL){
       strMsg(errorMsg,NumberOf(errorMsg),"error in code: %s",msg);
       return Error;
     }
   }
+
+  disableDebugSites(*tgt);	/* unless there is a debugger */
   
   return Ok;                    // Now we're done
 }
 
+/*
+ * Lazily loaded code
+ *
+ * A nested code segment can be left as a stub, whose only instruction
+ * (lazy) decodes and verifies the segment's text the first time the stub
+ * is entered. The stub has the segment's signatures, so its form and arity
+ * are known straight away. Only segments that stand on their own are left
+ * for later: their literals may not refer to labels, dictionary entries or
+ * type variables of the message they are in.
+ */
+
+static logical skipTerm(byte **p,byte *end,logical vars);
+
+static logical skipBytes(byte **p,byte *end,integer len)
+{
+  if(len<0 || len>end-*p)
+    return False;
+  *p += len;
+  return True;
+}
+
+static logical skipInt(byte **p,byte *end,byte tag,integer *val)
+{
+  integer len = tag&ICM_VAL_MASK;
+  integer result = 0;
+  integer i;
+
+  if(len==0){			/* recursive length */
+    if(*p>=end)
+      return False;
+    tag = *(*p)++;
+    if(!skipInt(p,end,tag,&len))
+      return False;
+  }
+
+  if(len<0 || len>end-*p)
+    return False;
+
+  for(i=0;i<len;i++){
+    byte ch = *(*p)++;
+
+    if(i==0)
+      result = (signed char)ch;
+    else
+      result = (result<<8)|ch;
+  }
+
+  if(val!=NULL)
+    *val = result;
+  return True;
+}
+
+static logical nextInt(byte **p,byte *end,integer *val)
+{
+  byte tag;
+
+  if(*p>=end)
+    return False;
+  tag = *(*p)++;
+  return skipInt(p,end,tag,val);
+}
+
+/*
+ * Step over a term, as long as it does not depend on the rest of its
+ * message. Type variables are allowed only if vars is set.
+ */
+static logical skipTerm(byte **p,byte *end,logical vars)
+{
+  integer len;
+  byte ch;
+
+  if(*p>=end)
+    return False;
+
+  ch = *(*p)++;
+
+  switch(ch&ICM_TAG_MASK){
+  case trmVariable:
+    return vars && skipInt(p,end,ch,NULL);
+
+  case trmInt:
+  case trmChar:
+    return skipInt(p,end,ch,NULL);
+
+  case trmFlt:
+  case trmNegFlt:
+    return nextInt(p,end,NULL) && skipBytes(p,end,ch&ICM_VAL_MASK);
+
+  case trmSym:
+  case trmString:
+    return skipInt(p,end,ch,&len) && skipBytes(p,end,len);
+
+  case trmCode:
+    if(!skipInt(p,end,ch,&len) || len<0 || len>end-*p || lazyText(*p,len)<0)
+      return False;
+    *p += len;
+    return True;
+
+  case trmNil:
+    if(ch==trmNil)
+      return True;
+    else if(ch==trmList){
+      while(ch==trmList){
+        if(!skipTerm(p,end,vars) || *p>=end)
+          return False;
+        ch = *(*p)++;
+      }
+      if(ch!=trmNil){
+        (*p)--;
+        return skipTerm(p,end,vars);
+      }
+      return True;
+    }
+    else if(ch==trmHdl || ch==trmSigned)
+      return skipTerm(p,end,vars) && skipTerm(p,end,vars);
+    else
+      return False;
+
+  case trmStruct:{
+    integer i;
+
+    if(!skipInt(p,end,ch,&len) || !skipTerm(p,end,vars))
+      return False;
+
+    for(i=0;i<len;i++)
+      if(!skipTerm(p,end,vars))
+        return False;
+    return True;
+  }
+
+  default:			/* variables, labels and dictionary entries */
+    return False;
+  }
+}
+
+/*
+ * Check that a code segment stands on its own. Returns the offset of its
+ * signatures -- which are decoded straight away -- or -1.
+ */
+static integer lazyText(byte *b,integer len)
+{
+  byte *p = b+4;
+  byte *end = b+len;
+  unsigned WORD32 signature;
+  integer size,litcnt,i,sigOff;
+
+  if(len<4)
+    return -1;
+
+  signature = bigWord(b);
+
+  if(signature!=SIGNATURE && signature!=SIGNBSWAP &&
+     signature!=SIGNWSWAP && signature!=SIGNBWSWP)
+    return -1;
+
+  if(!nextInt(&p,end,&size) || !nextInt(&p,end,&litcnt) || size<0 ||
+     size>(end-p)/sizeof(instruction))
+    return -1;
+
+  p += size*sizeof(instruction);
+
+  for(i=0;i<litcnt;i++)
+    if(!skipTerm(&p,end,False))
+      return -1;
+
+  sigOff = p-b;
+
+  for(i=0;i<2;i++)		/* the signatures may use type variables */
+    if(!skipTerm(&p,end,True))
+      return -1;
+
+  return sigOff;
+}
+
+static retCode lazyOpaqueHdlr(opaqueEvalCode code,void *p,void *cd,void *cl)
+{
+  lazyPo l = (lazyPo)p;
+
+  switch(code){
+  case showOpaque:{
+    ioPo f = (ioPo)cd;
+    outMsg(f,"<<code text of %d bytes>>",l->len);
+    return Ok;
+  }
+  case finaliseOpaque:
+    if(l->data!=NULL)
+      free(l->data);
+    free(l);
+    return Ok;
+  default:
+    return Error;
+  }
+}
+
+/* Build a stub for a code segment, whose signatures are read from in */
+static retCode decodeStub(ioPo in,byte *text,integer len,integer sigOff,
+			  objPo *tgt,logical verify)
+{
+  static logical registered = False;
+  lazyPo l = (lazyPo)malloc(sizeof(LazyRec));
+  objPo o = kvoid;
+  objPo pc = kvoid;
+  void *root = gcAddRoot(&o);
+  retCode res;
+
+  gcAddRoot(&pc);
+
+  if(!registered){
+    registerOpaqueType(lazyOpaqueHdlr,LAZY_OPAQUE,NULL);
+    registered=True;
+  }
+
+  if(l==NULL){
+    free(text);
+    gcRemoveRoot(root);
+    return SpaceErr();
+  }
+
+  l->data = text;
+  l->len = len;
+  l->sigOff = sigOff;
+  l->verify = verify;
+
+  o = allocateOpaque(LAZY_OPAQUE,(void*)l);
+  finaliseOnDeath(o);
+
+  if((pc=allocateCode(1,2))==NULL){
+    gcRemoveRoot(root);
+    return SpaceErr();
+  }
+  else{
+    codePo cd = CodeVal(pc);
+
+    cd->size = 1;
+    cd->litcnt = 2;
+    cd->type = kvoid;
+    cd->frtype = kvoid;
+    CodeCode(pc)[0] = lazy;
+    cd->spacereq = MAXFRAME+FRAMESLACK; /* the real code is not known yet */
+    CodeLits(pc)[LAZY_TEXT] = kvoid;
+    CodeLits(pc)[LAZY_CODE] = kvoid;
+  }
+
+  updateCodeLit(pc,LAZY_TEXT,o);
+  *tgt = pc;
+
+  res = decodeSigs(in,pc,verify);
+
+  gcRemoveRoot(root);
+  return res;
+}
+
+logical isLazyCode(objPo code)
+{
+  if(IsCode(code) && CodeSize(code)==1 && CodeLitcnt(code)==2 &&
+     op_cde(CodeCode(code)[0])==lazy){
+    objPo text = CodeLits(code)[LAZY_TEXT];
+
+    return IsOpaque(text) && OpaqueType(text)==LAZY_OPAQUE;
+  }
+  else
+    return False;
+}
+
+/* Decode and verify the code a stub stands for, if that has not been done */
+retCode loadLazyCode(objPo stub,objPo *tgt)
+{
+  if(!isLazyCode(stub))
+    return Error;
+  else if(CodeLits(stub)[LAZY_CODE]!=kvoid){
+    *tgt = CodeLits(stub)[LAZY_CODE];
+    return Ok;
+  }
+  else{
+    lazyPo l = (lazyPo)OpaqueVal(CodeLits(stub)[LAZY_TEXT]);
+    uniChar *buff = (uniChar*)malloc(sizeof(uniChar)*l->len);
+    logical wasLazy = lazyLoad;
+    int depth = codeDepth;
+    objPo code = kvoid;
+    void *root;
+    retCode res;
+    integer i;
+
+    if(buff==NULL)
+      return Space;
+
+    for(i=0;i<l->len;i++)
+      buff[i] = l->data[i];
+
+    root = gcAddRoot(&stub);
+    gcAddRoot(&code);
+
+    if((res=startMessage(NULL))==Ok){
+      ioPo str = openInStr(buff,l->len,rawEncoding);
+
+      lazyLoad = True;		/* its own nested code is left for later too */
+      codeDepth = 1;
+      res = decodeCode(str,&code,l->verify);
+      lazyLoad = wasLazy;
+      codeDepth = depth;
+
+      closeFile(str);
+      endMessage();
+    }
+
+    free(buff);
+
+    if(res==Ok){
+      free(l->data);		/* the text is not needed any more */
+      l->data = NULL;
+      updateCodeLit(stub,LAZY_CODE,code);
+      *tgt = code;
+    }
+
+    gcRemoveRoot(root);
+    return res;
+  }
+}
+
+/*
+ * The text of a stub's segment up to its signatures, or NULL -- and the
+ * loaded code -- if it has been loaded
+ */
+unsigned char *lazyCodeText(objPo stub,integer *len,objPo *loaded)
+{
+  lazyPo l = (lazyPo)OpaqueVal(CodeLits(stub)[LAZY_TEXT]);
+
+  *loaded = CodeLits(stub)[LAZY_CODE];
+
+  if(l->data==NULL)
+    return NULL;
+  *len = l->sigOff;
+  return l->data;
+}
+
 void scanLabels(void)
 {
   WORD32 i;
-  lblPo tv = tvars;
   
-  for(i=0;i<maxlbl;i++)
+  for(i=0;i<toplbl;i++)
     lbls[i] = scanCell(lbls[i]);
     
-  while(tv!=NULL){
-    tv->term = scanCell(tv->term);
-    tv = tv->prev;
-  }
+  for(i=0;i<toptv;i++)
+    tvars[i] = scanCell(tvars[i]);
+
+  scanIcmDicts();
 }
 
 void markLabels(void)
 {
   WORD32 i;
-  lblPo tv = tvars;
 
-  for(i=0;i<maxlbl;i++)
+  for(i=0;i<toplbl;i++)
     markCell(lbls[i]);
     
-  while(tv!=NULL){
-    markCell(tv->term);
-    tv = tv->prev;
-  }
+  for(i=0;i<toptv;i++)
+    markCell(tvars[i]);
+
+  markIcmDicts();
 }
 
 void adjustLabels(void)
 {
   WORD32 i;
-  lblPo tv = tvars;
 
-  for(i=0;i<maxlbl;i++)
+  for(i=0;i<toplbl;i++)
     lbls[i] = adjustCell(lbls[i]);
     
-  while(tv!=NULL){
-    tv->term = adjustCell(tv->term);
-    tv = tv->prev;
-  }
+  for(i=0;i<toptv;i++)
+    tvars[i] = adjustCell(tvars[i]);
+
+  adjustIcmDicts();
 }
 
@@ -43,6 +43,7 @@ objPo ktplTp, kanyTp, kfunTp, kprocTp, klstTp,kallQ;
 objPo knumberTp, ksymbolTp, kcharTp, khandleTp, kstringTp, klogicalTp, kqueryTp, kopaqueTp;
 
 objPo msgTp;                    // Standard message type
+objPo mcastTp;                  // Multicast message type
 objPo monitorTp;                // Standard monitor type
 objPo debugTp;		// Standard debugging message type
 
@@ -135,6 +136,19 @@ void installSymbol(objPo s)
   }
 }
 
+/* The dictionary's symbol with the same name as s, which is installed if new */
+objPo internSymbol(objPo s)
+{
+  objPo sym = Search(SymVal(s),dictionary);
+
+  if(sym==NULL){
+    Install(SymVal(s),s,dictionary);
+    return s;
+  }
+  else
+    return sym;
+}
+
 void init_dict()		/* Initialize the dictionary */
 {
   dictionary = NewHash(512,NULL,(compFun)uniCmp, NULL);
@@ -248,6 +262,18 @@ void init_dict()		/* Initialize the dictionary */
     updateConsEl(msgTp,1,khandleTp);
     updateConsEl(msgTp,2,elTp);
     updateConsEl(msgTp,3,kanyTp);
+
+    elTp = allocateConstructor(1);
+    mcastTp = allocateConstructor(4);             // (handle[],handle,msgAttr[],any)
+
+    updateConsFn(elTp,klstTp);
+    updateConsEl(elTp,0,khandleTp);
+
+    updateConsFn(mcastTp,ktplTp);
+    updateConsEl(mcastTp,0,elTp);
+    updateConsEl(mcastTp,1,khandleTp);
+    updateConsEl(mcastTp,2,consEl(msgTp,2));
+    updateConsEl(mcastTp,3,kanyTp);
   }
 
   ematcherr = newSymbol("'matcherr");
@@ -341,6 +367,7 @@ void scanDict(objPo base,objPo limit)
 
   debugTp = scanCell(debugTp);
   msgTp = scanCell(msgTp);
+  mcastTp = scanCell(mcastTp);
   monitorTp = scanCell(monitorTp);
   kbreakdebug = scanCell(kbreakdebug);
   ematcherr = scanCell(ematcherr);
@@ -440,6 +467,7 @@ void markDict(void)
 
   markCell(debugTp);
   markCell(msgTp);
+  markCell(mcastTp);
   markCell(monitorTp);
   markCell(kbreakdebug);
   markCell(ematcherr);
@@ -536,6 +564,7 @@ void adjustDict(void)
   kbreakdebug = adjustCell(kbreakdebug);
   debugTp = adjustCell(debugTp);
   msgTp = adjustCell(msgTp);
+  mcastTp = adjustCell(mcastTp);
   monitorTp = adjustCell(monitorTp);
   ematcherr = adjustCell(ematcherr);
   eprivileged = adjustCell(eprivileged);
@@ -47,6 +47,88 @@
 #include "fileio.h"
 #include "term.h"
 #include "sign.h"
+#include "async.h"
+
+/*
+ * stat and readdir may block on slow file systems, so they are handed
+ * to a worker thread
+ */
+typedef struct {
+  char fn[MAX_SYMB_LEN];	/* The file in question */
+  struct stat buf;		/* What stat had to say about it */
+  WORD32 count;			/* Number of directory entries */
+  WORD32 size;			/* Space used by the names */
+  char names[1];		/* NUL separated directory entries */
+} fileJobRec, *fileJobPo;
+
+static retCode statJob(asyncPo job)
+{
+  fileJobPo f = (fileJobPo)job->data;
+
+  if(stat(f->fn,&f->buf)==-1)
+    return Error;
+  else
+    return Ok;
+}
+
+static retCode lsJob(asyncPo job)
+{
+  fileJobPo f = (fileJobPo)job->data;
+  DIR *directory = opendir(f->fn);
+  struct dirent *ent;
+  WORD32 avail = 0;
+
+  if(directory==NULL)
+    return Error;
+
+  while((ent=readdir(directory)) != NULL){
+    /* skip special entries "." and ".." */
+    if(strcmp(ent->d_name, ".")!=0 && strcmp(ent->d_name, "..")!=0){
+      WORD32 len = strlen(ent->d_name)+1;
+
+      if(f->size+len>avail){
+	fileJobPo nf;
+
+	avail = (avail+len)*2;
+	if((nf=(fileJobPo)realloc(f,sizeof(fileJobRec)+avail))==NULL){
+	  closedir(directory);
+	  return Space;
+	}
+	job->data = f = nf;
+      }
+      strcpy(&f->names[f->size],ent->d_name);
+      f->size += len;
+      f->count++;
+    }
+  }
+
+  closedir(directory);	/* Close the directory stream */
+  return Ok;
+}
+
+/* Pick up a finished file job, or start one -- *ret is Suspend if we did */
+static asyncPo fileJob(processpo p,char *fn,asyncFun fun,retCode *ret)
+{
+  asyncPo job = asyncResult(p,fun);
+
+  *ret = Ok;
+
+  if(job==NULL){
+    fileJobPo f = (fileJobPo)malloc(sizeof(fileJobRec));
+
+    if(f==NULL){
+      *ret = Space;
+      return NULL;
+    }
+
+    strncpy(f->fn,fn,NumberOf(f->fn));
+    f->count = f->size = 0;
+
+    if((*ret=asyncEscape(p,fun,f))==Ok)
+      job = asyncResult(p,fun);
+  }
+  return job;
+}
 
 /*
  *************************
@@ -410,8 +492,6 @@ retCode m_fls(processpo p,objPo *args)
   else if(!isListOfChars(args[0]))
     return liberror("__ls",1,"argument should be a string",einval);
   else{
-    DIR *directory;
-    struct dirent  *ent;
     WORD32 len = ListLen(args[0])+1;
     uniChar ufn[len];
     uniChar user[MAX_SYMB_LEN],pass[MAX_SYMB_LEN];
@@ -431,32 +511,40 @@ retCode m_fls(processpo p,objPo *args)
       
       _utf(path,(unsigned char *)dir,NumberOf(dir)); // Convert unicode string to regular chars
 
-      if((directory=opendir(dir)) == NULL)
+      retCode ret;
+      asyncPo job = fileJob(p,dir,lsJob,&ret);
+
+      if(job==NULL)
+        return ret==Space?liberror("__ls",1,"out of memory",esystem):ret;
+      else if(job->ret!=Ok){
+        asyncFree(job);
         return liberror("__ls", 1,"cant access directory",efail);
+      }
       else{
+        fileJobPo f = (fileJobPo)job->data;
+        char *name = f->names;
+        WORD32 i;
         objPo last = emptyList;
         objPo dirEntry = emptyList;
         void *root = gcAddRoot(&last);
 
         gcAddRoot(&dirEntry);
+
+        args[0] = emptyList;
     
-        while((ent=readdir(directory)) != NULL){
-        /* skip special entries "." and ".." */
-          if(strcmp(ent->d_name, ".")!=0 && strcmp(ent->d_name, "..")!=0){
-	    dirEntry = allocateCString(ent->d_name);
-	    if(last==emptyList)
-	      last = args[0] = allocatePair(&dirEntry,&emptyList);
-	    else{
-	      objPo tail = allocatePair(&dirEntry,&emptyList);
-	      updateListTail(last,tail);
-	      last = tail;
-	    }
-          }
+        for(i=0;i<f->count;i++,name+=strlen(name)+1){
+	  dirEntry = allocateCString(name);
+	  if(last==emptyList)
+	    last = args[0] = allocatePair(&dirEntry,&emptyList);
+	  else{
+	    objPo tail = allocatePair(&dirEntry,&emptyList);
+	    updateListTail(last,tail);
+	    last = tail;
+	  }
         }
 
-        closedir(directory);	/* Close the directory stream */
-
         gcRemoveRoot(root);
+        asyncFree(job);
         return Ok;
       }
     }
@@ -523,8 +611,6 @@ retCode m_file_type(processpo p,objPo *args)
 
 retCode m_fstat(processpo p,objPo *args)
 {
-  struct stat buf;
-
   if(!p->priveleged)
     return liberror("__stat",1,"permission denied",eprivileged);
   else if(!isListOfChars(args[0]))
@@ -549,12 +635,19 @@ retCode m_fstat(processpo p,objPo *args)
       
       _utf(path,(unsigned char *)fn,NumberOf(fn)); // Convert unicode string to regular chars
 
-      if(stat(fn, &buf) == -1){
+      retCode ret;
+      asyncPo job = fileJob(p,fn,statJob,&ret);
+
+      if(job==NULL)
+        return ret==Space?liberror("__stat",1,"out of memory",esystem):ret;
+      else if(job->ret!=Ok){
         uniChar msg[MAX_SYMB_LEN];
         strMsg(msg,NumberOf(msg),"cant stat file: `%U'",path);
+        asyncFree(job);
         return Uliberror("__stat",1,msg,efail);
       }
       else{
+        struct stat buf = ((fileJobPo)job->data)->buf;
         objPo fstat = allocateConstructor(13);
         void *root = gcAddRoot(&fstat);
         objPo val = kvoid;
@@ -595,6 +688,7 @@ retCode m_fstat(processpo p,objPo *args)
         args[0] = fstat;
 
         gcRemoveRoot(root);
+        asyncFree(job);
         return Ok;
       }
     }
@@ -610,15 +704,27 @@ retCode m_ffile(processpo p,objPo *args)
 {
   WORD32 len = ListLen(args[0]);
   uniChar fn[len+1];
+  char lfn[MAX_SYMB_LEN];
 
   if(!p->priveleged)
     return liberror("__ffile",1,"permission denied",eprivileged);
 
-  if(urlPresent(aprilSysPath,StringText(args[0],fn,len+1)))
+  StringText(args[0],fn,len+1);
+
+  if(localFileName(aprilSysPath,fn,lfn,NumberOf(lfn))==Ok){
+    retCode ret;
+    asyncPo job = fileJob(p,lfn,statJob,&ret);
+
+    if(job==NULL)
+      return ret==Space?liberror("__ffile",1,"out of memory",esystem):ret;
+
+    args[0] = (job->ret==Ok?ktrue:kfalse);
+    asyncFree(job);
+  }
+  else if(urlPresent(aprilSysPath,fn))
     args[0]=ktrue;
   else
     args[0]=kfalse;
 
   return Ok;
 }
-
@@ -33,10 +33,20 @@
 #include "astring.h"		/* String handling interface */
 #include "encoding.h"
 #include "labels.h"             // Support for label management
+#include "debug.h"
 
-static retCode encode(ioPo out,objPo input,lblPo chain,lblPo tvars);
+typedef struct {
+  lblTablePo seen;		/* how often each structure is referenced */
+  lblTablePo labels;		/* structures written out with a label */
+  lblTablePo tvars;		/* type variables and their numbers */
+  int nextLabel;		/* next label to hand out */
+  icmDictPo dict;		/* the stream's dictionary, if it has one */
+} EncodeRec, *encPo;
+
+static retCode encode(ioPo out,objPo input,encPo enc);
 static logical IsTupleOfCode(objPo input);
-static lblPo collectTvars(objPo input,lblPo stack,lblPo chain);
+static logical groundSig(objPo sig);
+static void countRefs(objPo input,lblTablePo seen);
 
 #define ICM_VAL_MASK 0x0f
 #define ICM_TAG_MASK 0xf0
@@ -44,15 +54,46 @@ static lblPo collectTvars(objPo input,lblPo stack,lblPo chain);
 #define try(S) {retCode ret = S; if(ret!=Ok) return ret;}
 
 
-retCode encodeICM(ioPo out,objPo input)
+/*
+ * Encode a term. If share is set, structures that are referenced more
+ * than once are written once and referred to by label; callers that know
+ * their data is a tree can skip the scan that finds them. Closures are
+ * always labelled, since they may be circular.
+ *
+ * If dict is not NULL, symbols and ground type signatures are entered
+ * into it the first time they are written and referred to by index
+ * after that. The dictionary belongs to the stream, and so lasts across
+ * messages; only pass one if the reader has agreed to use it.
+ */
+retCode encodeICM(ioPo out,objPo input,logical share,icmDictPo dict)
 {
 #ifdef MEMTRACE
   logical allowed = permitGC(False);
 #endif
-  lblPo tVars = collectTvars(input,NULL,NULL);
-  retCode ret = encode(out,input,NULL,tVars);
-  
-  tVars = freeAllLabels(tVars);
+  EncodeRec enc;
+  retCode ret;
+  int mark = (dict!=NULL?icmDictCount(dict):0);
+
+  enc.seen = NULL;
+  enc.labels = newLabelTable(16);
+  enc.tvars = newLabelTable(16);
+  enc.nextLabel = 0;
+  enc.dict = dict;
+
+  if(share){
+    enc.seen = newLabelTable(256);
+    countRefs(input,enc.seen);
+  }
+
+  ret = encode(out,input,&enc);
+
+  if(ret!=Ok && dict!=NULL)	/* the reader will never see these keys */
+    truncIcmDict(dict,mark);
+
+  if(enc.seen!=NULL)
+    freeLabelTable(enc.seen);
+  freeLabelTable(enc.labels);
+  freeLabelTable(enc.tvars);
   
 #ifdef MEMTRACE
   permitGC(allowed);
@@ -84,30 +125,100 @@ retCode encodeInt(ioPo out,WORD32 val,int tag)
   return Ok;
 }
 
-static retCode encode(ioPo out,objPo input,lblPo chain,lblPo tvars)
+/*
+ * Has this structure already been written? If so, return its label.
+ * Otherwise, if it needs one, give it a label before it is written.
+ */
+static int structLabel(ioPo out,objPo input,encPo enc,logical cyclic)
 {
-  lblPo links = chain;
-  
-  while(links!=NULL){
-    if(links->term==input)
-      return encodeInt(out,links->ref,trmRef);
-    links=links->prev;
+  int ref = findLabel(enc->labels,input);
+
+  if(ref>=0)
+    return ref;
+  else if(cyclic || (enc->seen!=NULL && findLabel(enc->seen,input)>1)){
+    setLabel(enc->labels,input,enc->nextLabel);
+    encodeInt(out,enc->nextLabel++,trmTag);
   }
+  return -1;
+}
+
+/*
+ * Is this key already in the stream's dictionary? If so, refer to it.
+ * Otherwise, if there is room, the caller's term becomes a new entry.
+ */
+static logical dictRef(ioPo out,encPo enc,int kind,unsigned char *key,int len)
+{
+  unsigned char *k = (unsigned char*)malloc(len+1);
+  int ix;
+
+  k[0] = kind;			/* keep symbols and signatures apart */
+  memcpy(&k[1],key,len);
+
+  if((ix=findDictKey(enc->dict,k,len+1))>=0)
+    encodeInt(out,ix,trmDictRef);
+  else if((ix=addDictKey(enc->dict,k,len+1))>=0){
+    encodeInt(out,ix,trmDict);
+    ix = -1;
+  }
+
+  free(k);
+  return ix>=0;
+}
+
+/* Signatures are entered into the dictionary by their plain encoding */
+static retCode encodeSig(ioPo out,objPo sig,encPo enc)
+{
+  if(enc->dict!=NULL && groundSig(sig)){
+    ioPo tmp = openOutStr(rawEncoding);
+    EncodeRec plain;
+    WORD32 blen,i;
+    uniChar *text;
+    unsigned char *key;
+    logical found;
+
+    plain.seen = NULL;
+    plain.labels = newLabelTable(16);
+    plain.tvars = newLabelTable(16);
+    plain.nextLabel = 0;
+    plain.dict = NULL;
+
+    encode(tmp,sig,&plain);
+    freeLabelTable(plain.labels);
+    freeLabelTable(plain.tvars);
 
+    text = getStrText(O_STRING(tmp),&blen);
+    key = (unsigned char*)malloc(blen+1);
+
+    for(i=0;i<blen;i++)
+      key[i] = text[i]&0xff;
+
+    found = dictRef(out,enc,trmSigned,key,blen);
+
+    free(key);
+    closeFile(tmp);
+
+    if(found)
+      return Ok;
+  }
+  return encode(out,sig,enc);
+}
+
+static retCode encode(ioPo out,objPo input,encPo enc)
+{
   switch(Tag(input)){
   case variableMarker:{
     input = deRefVar(input);
     
     if(Tag(input)==variableMarker){
-      int ref = searchLabels(input,tvars);
+      int ref = findLabel(enc->tvars,input);
       
-      if(ref>=0)
-        return encodeInt(out,ref,trmVariable);
-      else
-        return Error;
+      if(ref<0)			/* number the variables as we meet them */
+	setLabel(enc->tvars,input,ref=labelCount(enc->tvars));
+
+      return encodeInt(out,ref,trmVariable);
     }
     else
-      return encode(out,input,chain,tvars);
+      return encode(out,input,enc);
   }
   
   case integerMarker:
@@ -153,7 +264,10 @@ static retCode encode(ioPo out,objPo input,lblPo chain,lblPo tvars)
     WORD32 ulen = uni_utf8(sym,len,buff,3*len+1);
     int i;
 
-    encodeInt(out,ulen,trmSym);	/* the exponent */
+    if(enc->dict!=NULL && dictRef(out,enc,trmSym,buff,ulen))
+      return Ok;
+
+    encodeInt(out,ulen,trmSym);	/* the length of the symbol */
     for(i=0;i<ulen;i++)
       outByte(out,buff[i]);
 
@@ -161,37 +275,55 @@ static retCode encode(ioPo out,objPo input,lblPo chain,lblPo tvars)
   }
   
   case codeMarker:{
-    ioPo tmpFile = openOutStr(rawEncoding);
+    ioPo tmpFile;
     objPo *tmp;
     WORD32 i,size,litcnt;
     WORD32 signature = SIGNATURE;	/* A special signature word */
-    insPo PC = CodeCode(input);
-
-    /* write out a signature to handle little endians and big endians */
-    outByte(tmpFile,((signature>>24)&0xff));
-    outByte(tmpFile,((signature>>16)&0xff));
-    outByte(tmpFile,((signature>>8)&0xff));
-    outByte(tmpFile,(signature&0xff));
-
-    size = CodeSize(input);	/* Compute the size of the code section */
-    litcnt = CodeLitcnt(input);
-
-    encodeInt(tmpFile,size,trmInt); /* code size */
-    encodeInt(tmpFile,litcnt,trmInt); /* number of literal values */
-
-    /* write out the code */
-    for(i=0;i<size;i++){
-      outByte(tmpFile,((PC[i]>>24)&0xff));
-      outByte(tmpFile,((PC[i]>>16)&0xff));
-      outByte(tmpFile,((PC[i]>>8)&0xff));
-      outByte(tmpFile,(PC[i]&0xff));
+    unsigned char *text = NULL;
+    integer tlen;
+
+    if(isLazyCode(input)){	/* code that has not been loaded yet */
+      objPo loaded;
+
+      if((text=lazyCodeText(input,&tlen,&loaded))==NULL)
+	return encode(out,loaded,enc);
     }
 
-    tmp = CodeLits(input);		/* write out the literals in the code */
-    for(;litcnt--;)		
-      encode(tmpFile,*tmp++,NULL,tvars);
-    encode(tmpFile,CodeSig(input),NULL,tvars); /* write out the type signature */
-    encode(tmpFile,CodeFrSig(input),NULL,tvars);	/* write out the free type signature */
+    tmpFile = openOutStr(rawEncoding);
+
+    if(text!=NULL){		/* the segment is copied as it was read */
+      for(i=0;i<tlen;i++)
+	outByte(tmpFile,text[i]);
+    }
+    else{
+      /* write out a signature to handle little endians and big endians */
+      outByte(tmpFile,((signature>>24)&0xff));
+      outByte(tmpFile,((signature>>16)&0xff));
+      outByte(tmpFile,((signature>>8)&0xff));
+      outByte(tmpFile,(signature&0xff));
+
+      size = CodeSize(input);	/* Compute the size of the code section */
+      litcnt = CodeLitcnt(input);
+
+      encodeInt(tmpFile,size,trmInt); /* code size */
+      encodeInt(tmpFile,litcnt,trmInt); /* number of literal values */
+
+      /* write out the code, as it was loaded */
+      for(i=0;i<size;i++){
+	unsigned WORD32 ins = loadedIns(input,i);
+
+	outByte(tmpFile,((ins>>24)&0xff));
+	outByte(tmpFile,((ins>>16)&0xff));
+	outByte(tmpFile,((ins>>8)&0xff));
+	outByte(tmpFile,(ins&0xff));
+      }
+
+      tmp = CodeLits(input);		/* write out the literals in the code */
+      for(;litcnt--;)		
+	encode(tmpFile,*tmp++,enc);
+    }
+    encode(tmpFile,CodeSig(input),enc); /* write out the type signature */
+    encode(tmpFile,CodeFrSig(input),enc);	/* write out the free type signature */
     
     {
       WORD32 blen;
@@ -262,8 +394,8 @@ static retCode encode(ioPo out,objPo input,lblPo chain,lblPo tvars)
     }
     else{
       outByte(out,trmList);
-      encode(out,ListHead(input),chain,tvars);	/* Encode the head of the list */
-      return encode(out,ListTail(input),chain,tvars); /* And the tail */
+      encode(out,ListHead(input),enc);	/* Encode the head of the list */
+      return encode(out,ListTail(input),enc); /* And the tail */
     }
 
   case consMarker:{
@@ -272,25 +404,22 @@ static retCode encode(ioPo out,objPo input,lblPo chain,lblPo tvars)
 
       outByte(out,trmHdl);	/* we write a handle */
       
-      encode(out,*ptr++,chain,tvars);       /* The target of the handle */
-      return encode(out,*ptr++,chain,tvars);/* The name of the handle */
+      encode(out,*ptr++,enc);       /* The target of the handle */
+      return encode(out,*ptr++,enc);/* The name of the handle */
     }
     else{
       unsigned int ar = consArity(input);
       objPo *ptr = consData(input);
-      LabelRec link = { input, (chain==NULL?0:chain->ref+1), chain};
-    
-    /* Do we need to handle circular structures? */
-      if(isClosure(input)){
-        chain = &link;
-        encodeInt(out,chain->ref,trmTag);
-      }
+      int ref = structLabel(out,input,enc,isClosure(input));
+
+      if(ref>=0)
+	return encodeInt(out,ref,trmRef);
     
       encodeInt(out,ar,trmStruct); /* write out the marker+arity */
-      encode(out,((consPo)input)->fn,NULL,tvars);
+      encode(out,((consPo)input)->fn,enc);
     
       for(;ar-->0;)
-        try(encode(out,*ptr++,chain,tvars));
+        try(encode(out,*ptr++,enc));
       return Ok;
     }
   }
@@ -298,26 +427,23 @@ static retCode encode(ioPo out,objPo input,lblPo chain,lblPo tvars)
   case tupleMarker:{
     int ar = tupleArity(input);
     objPo *ptr = tupleData(input);
-    LabelRec link = { input, (chain==NULL?0:chain->ref+1), chain};
-    
-    /* Do we need to handle circular structures? */
-    if(IsTupleOfCode(input)){
-      chain = &link;
-      encodeInt(out,chain->ref,trmTag);
-    }
+    int ref = structLabel(out,input,enc,IsTupleOfCode(input));
+
+    if(ref>=0)
+      return encodeInt(out,ref,trmRef);
     
     encodeInt(out,ar,trmStruct); /* write out the marker+arity */
-    encode(out,ktpl,NULL,NULL);
+    encode(out,ktpl,enc);
     
     for(;ar--;)
-      try(encode(out,*ptr++,chain,tvars));
+      try(encode(out,*ptr++,enc));
     return Ok;
   }
   
   case anyMarker:
     outByte(out,trmSigned);
-    encode(out,AnySig(input),chain,tvars); /* Encode the signature */
-    return encode(out,AnyData(input),chain,tvars); /* and the value itself */
+    encodeSig(out,AnySig(input),enc); /* Encode the signature */
+    return encode(out,AnyData(input),enc); /* and the value itself */
 
   default:			/* in particular, opaque types not allowed */
     return Error;
@@ -337,71 +463,99 @@ static logical IsTupleOfCode(objPo input)
   return False;
 }
 
-static lblPo collectTvars(objPo input,lblPo stack,lblPo chain)
+/* Signatures with type variables cannot be shared across messages */
+static logical groundSig(objPo sig)
 {
-  input = deRefVar(input);
-  LabelRec deeper = { input,-1,stack};
+  sig = deRefVar(sig);
 
-  while(stack!=NULL){
-    if(stack->term==input)
-      return chain;
-    else
-      stack = stack->prev;
+  switch(Tag(sig)){
+  case variableMarker:
+    return False;
+
+  case listMarker:
+    while(isNonEmptyList(sig)){
+      if(!groundSig(ListHead(sig)))
+	return False;
+      sig = deRefVar(ListTail(sig));
+    }
+    return Tag(sig)!=variableMarker;
+
+  case consMarker:{
+    WORD32 ar = consArity(sig);
+    objPo *ptr = consData(sig);
+
+    if(!groundSig(consFn(sig)))
+      return False;
+
+    for(;ar-->0;)
+      if(!groundSig(*ptr++))
+	return False;
+    return True;
   }
-  
-  switch(Tag(input)){
-    case variableMarker:{
-      objPo in = deRefVar(input);
-       
-      if(in==input){
-        lblPo ch = chain;
-        int vNo = 0;
-      
-        while(ch!=NULL){
-          if(ch->term==in)
-            return chain;
-          if(ch->ref>vNo)
-            vNo = ch->ref+1;
-          ch = ch->prev;
-        }
-        
-        return createLabel(input,vNo++,chain);
+
+  case tupleMarker:{
+    WORD32 ar = tupleArity(sig);
+    objPo *ptr = tupleData(sig);
+
+    for(;ar-->0;)
+      if(!groundSig(*ptr++))
+	return False;
+    return True;
+  }
+
+  default:
+    return True;
+  }
+}
+
+/*
+ * Count the references to each structure that could be shared. A
+ * structure is only explored the first time it is met, so this is linear
+ * in the size of the term even if it is circular.
+ */
+static void countRefs(objPo input,lblTablePo seen)
+{
+  for(;;){
+    input = deRefVar(input);
+
+    switch(Tag(input)){
+    case listMarker:
+      if(!isNonEmptyList(input))
+	return;
+      countRefs(ListHead(input),seen);
+      input = ListTail(input);
+      continue;
+
+    case consMarker:
+    case tupleMarker:{
+      int count = findLabel(seen,input);
+      WORD32 ar,i;
+
+      setLabel(seen,input,count<0?1:count+1);
+
+      if(count>=0 || (Tag(input)==consMarker && IsHandle(input)))
+	return;
+
+      if(Tag(input)==consMarker){
+	ar = consArity(input);
+	for(i=0;i<ar;i++)
+	  countRefs(consEl(input,i),seen);
       }
-      else
-        return collectTvars(in,&deeper,chain);
-    }
-    case listMarker:{
-      while(isNonEmptyList(input)){
-        chain = collectTvars(ListHead(input),&deeper,chain);
-        input = ListTail(input);
+      else{
+	ar = tupleArity(input);
+	for(i=0;i<ar;i++)
+	  countRefs(tupleArg(input,i),seen);
       }
-      if(!isEmptyList(input))
-        return collectTvars(input,&deeper,chain);
-      else
-        return chain;
-    }
-    case consMarker:{
-      unsigned WORD32 ar = consArity(input);
-      unsigned WORD32 i;
-      
-      for(i=0;i<ar;i++)
-        chain = collectTvars(consEl(input,i),&deeper,chain);
-      return chain;
+      return;
     }
 
-    case tupleMarker:{
-      WORD32 ar = tupleArity(input);
-      WORD32 i;
-      
-      for(i=0;i<ar;i++)
-        chain = collectTvars(tupleArg(input,i),&deeper,chain);
-      return chain;
-    }
     case anyMarker:
-      return collectTvars(AnyData(input),&deeper,
-                          collectTvars(AnySig(input),&deeper,chain));
+      countRefs(AnySig(input),seen);
+      input = AnyData(input);
+      continue;
+
     default:
-      return chain;
+      return;
+    }
   }
 }
-
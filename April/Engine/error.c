@@ -27,8 +27,12 @@
 #include "dict.h"
 #include "symbols.h"
 #include "process.h"
+#include "async.h"
+#include "msg.h"
 #include "astring.h"
 #include "debug.h"
+#include "image.h"
+#include "profile.h"
 
 /* Fatal system error */
 void syserr(char *msg)
@@ -40,6 +44,11 @@ void syserr(char *msg)
 /* Raise an error in a process */
 void raiseError(processpo P,objPo errval)
 {
+  awakenProcess(P);		/* we need its stack */
+  asyncCancel(P);		/* abandon any pending asynchronous escape */
+  P->mcursor = NULL;		/* and any selective receive */
+  cancelMailboxWait(P);		/* and any wait for room in a mailbox */
+
   if(P->er<P->sb){		/* we have an error handler in place... */
     objPo *er = (objPo*)P->er[0];
     objPo *FP = P->fp;
@@ -191,6 +200,13 @@ void april_exit(int code)
 
   reset_stdin();		/* reset the standard input to be blocking */
 
+  saveImage();			/* if we were asked to */
+  dumpProfile();		/* write out the cpu samples */
+
+#ifdef STATISTICS
+  dump_stats();			/* write out the execution profile */
+#endif
+
   exit(code);
 }
 
@@ -35,7 +35,7 @@ typedef struct {
   int arity;			/* What is the arity of the escape? */
   entrytype mode;		/* What kind of object is this? */
   logical priv;			/* Execute in privilidged mode only? */
-#ifdef EXECTRACE
+#if defined(EXECTRACE) || defined(STATISTICS)
   char *name;		        /* Name of this escape function */
 #endif
 } EscapeTemplate, *escpo;
@@ -97,7 +97,7 @@ static void install_pescape(char *escape_fn,funpo escape_code,int code,
     e->escape_code = escape_code;
     e->priv = pr;
     e->mode = procedure;
-#ifdef EXECTRACE
+#if defined(EXECTRACE) || defined(STATISTICS)
     e->name = strdup(escape_fn);
 #endif
     e->arity = sigAr(spec);
@@ -114,7 +114,7 @@ static void install_fescape(char *escape_fn,funpo escape_code,int code,
     e->escape_code = escape_code;
     e->priv = pr;
     e->mode = function;
-#ifdef EXECTRACE
+#if defined(EXECTRACE) || defined(STATISTICS)
     e->name = strdup(escape_fn);
 #endif
     e->arity = sigAr(spec);
@@ -126,7 +126,7 @@ funpo escapeCode(unsigned int code)
   return escFuns[code].escape_code;
 }
 
-#ifdef EXECTRACE
+#if defined(EXECTRACE) || defined(STATISTICS)
 char *escapeName(int code)
 {
   if(code<0 || code>=MAXESC)
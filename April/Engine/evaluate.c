@@ -39,6 +39,7 @@
 #include "hash.h"		/* we need access to the hash functions */
 #include "debug.h"		/* Debugger access functions */
 #include "types.h"
+#include "profile.h"		/* the sampling profiler */
 
 extern logical debugging;	/* Level of debugging */
 extern logical SymbolDebug;	/* Symbolic debugging switched on? */
@@ -50,17 +51,23 @@ WORD32 pcCount = 0;
 
 #ifdef PROCTRACE
 #define tickle(SP) {\
-  if(stressSuspend||wakeywakey){\
+  if(stressSuspend||wakeywakey||sampleDue){\
       save_regs(SP,PC);\
-      P=ps_pause(P);\
+      if(sampleDue)\
+        profileSample(P);\
+      if(stressSuspend||wakeywakey)\
+        P=ps_pause(P);\
       restore_regs();\
     }\
   }
 #else
 #define tickle(SP) {\
-  if(wakeywakey){\
+  if(wakeywakey||sampleDue){\
       save_regs(SP,PC);\
-      P=ps_pause(P);\
+      if(sampleDue)\
+        profileSample(P);\
+      if(wakeywakey)\
+        P=ps_pause(P);\
       restore_regs();\
     }\
   }
@@ -108,6 +115,10 @@ void emulate(register processpo P)
 
     PCX=*PC++;
 
+#ifdef STATISTICS
+    stat_ins_usage(op_cde(PCX));
+#endif
+
     switch(op_cde(PCX)){
     case halt:			/* Stop execution */
       if(!P->priveleged){
@@ -199,7 +210,8 @@ void emulate(register processpo P)
       continue;
     }
 
-    case esc_fun:{		/* escape into 1st level builtins */
+    case esc_fun:		/* escape into 1st level builtins */
+    esc_fun_ins:{
       register retCode ret;
       funpo ef = escapeCode(op_o_val(PCX));
 
@@ -219,7 +231,11 @@ void emulate(register processpo P)
       }
 #endif
 
+#ifdef STATISTICS
+      ret = stat_escape(ef,op_o_val(PCX),P,SP);
+#else
       ret = (*ef)(P,SP);
+#endif
 
       restore_regs();		/* restore registers in case of g/c */
 
@@ -257,7 +273,8 @@ void emulate(register processpo P)
       continue;
     }
 
-    case call:{			/* Call a local procedure */
+    case call:			/* Call a local procedure */
+    call_ins:{
       register objPo pr = FP[op_sl_val(PCX)]; /* pick up procedure from locals */
       register objPo *nEnv = codeFreeVector(pr);
 
@@ -283,7 +300,8 @@ void emulate(register processpo P)
       continue;
     }
 
-    case ecall:{		/* Call a procedure from env */
+    case ecall:			/* Call a procedure from env */
+    ecall_ins:{
       register objPo pr = E[op_sl_val(PCX)]; /* pick up procedure from env */
       register objPo *nEnv = codeFreeVector(pr);
 
@@ -308,11 +326,64 @@ void emulate(register processpo P)
       continue;
     }
 
+    case tcall:			/* Tail call a local procedure */
+    case etcall:{		/* Tail call a procedure from env */
+      register objPo pr = op_cde(PCX)==tcall?FP[op_sl_val(PCX)]:E[op_sl_val(PCX)];
+
+      if(P->er<FP){		/* an error block in this frame must be kept */
+	if(op_cde(PCX)==tcall)
+	  goto call_ins;
+	else
+	  goto ecall_ins;
+      }
+      else if(isClosure(pr)){
+	register objPo cp = consFn(pr);
+	register int ar = op_m_val(PCX);
+	objPo *oFP = (objPo*)FP[0];	/* the caller's return linkage */
+	objPo oEnv = FP[1];
+	objPo oPC = FP[2];
+	/* the result must land where the caller's result would have gone */
+	register objPo *nFP = FP+CodeArity(consFn(env))-ar;
+
+	memmove(nFP+3,FP+op_sh_val(PCX),ar*sizeof(objPo)); /* slide the arguments up */
+	nFP[2] = oPC;
+	nFP[1] = oEnv;
+	nFP[0] = (objPo)oFP;
+
+	SP = FP = nFP;		/* the caller's frame is gone */
+	env = pr;
+	E = codeFreeVector(pr);
+	PC = CodeCode(cp);
+	Lits = CodeLits(cp);
+      }
+      else
+	RunErr("illegal procedure code",eexec);
+
+      continue;
+    }
+
+    case lazy:{			/* First call of code that is not loaded */
+      objPo code;
+      retCode ret;
+
+      save_regs(SP,PC);
+      ret = loadLazyCode(consFn(env),&code);
+      restore_regs();
+
+      if(ret!=Ok)
+	RunErr("cant load code",eexec);
+
+      updateConsFn(env,code);	/* later calls go straight to the code */
+      PC = CodeCode(code);
+      Lits = CodeLits(code);
+      continue;
+    }
+
     case allocv:{		/* Establish a new frame pointer */
       register WORD32 amnt = op_so_val(PCX);
       if(SP-4+amnt<=P->stack){	/* allow for an extra call */
 	save_regs(SP,PC);
-	if(grow_stack(P,2)==Space) /* Double this stack */
+	if(extend_stack(P,4-amnt)==Space) /* at least double this stack */
 	  RunErr("cant extend process stack",esystem);
 	restore_regs();
       }
@@ -791,7 +862,8 @@ void emulate(register processpo P)
     }
 
     /* List manipulation instructions */
-    case lstpr:{			/* Construct a list pair */
+    case lstpr:			/* Construct a list pair */
+    lstpr_ins:{
       int hi = op_sh_val(PCX);
       int mid = op_sm_val(PCX);
       int low = op_sl_val(PCX);
@@ -1262,12 +1334,86 @@ void emulate(register processpo P)
 	PC+=op_so_val(PCX);	/* skip if false */
       continue;
 
+    /* Superinstructions -- the next instruction is executed here too */
+    case ieqjmp:		/* ieq and its jmp */
+      if(IntVal(FP[op_sm_val(PCX)])==IntVal(FP[op_sl_val(PCX)]))
+	PC+=op_lo_val(*PC)+1;	/* take the jump */
+      else
+	PC++;			/* skip the jump */
+      continue;
+
+    case ineqjmp:		/* ineq and its jmp */
+      if(IntVal(FP[op_sm_val(PCX)])!=IntVal(FP[op_sl_val(PCX)]))
+	PC+=op_lo_val(*PC)+1;
+      else
+	PC++;
+      continue;
+
+    case ilejmp:		/* ile and its jmp */
+      if(IntVal(FP[op_sm_val(PCX)])<=IntVal(FP[op_sl_val(PCX)]))
+	PC+=op_lo_val(*PC)+1;
+      else
+	PC++;
+      continue;
+
+    case igtjmp:		/* igt and its jmp */
+      if(IntVal(FP[op_sm_val(PCX)])>IntVal(FP[op_sl_val(PCX)]))
+	PC+=op_lo_val(*PC)+1;
+      else
+	PC++;
+      continue;
+
+    case mlistjmp:{		/* mlist and its failure jmp */
+      objPo lst = FP[op_sh_val(PCX)];
+
+      if(isNonEmptyList(lst)){
+	FP[op_sm_val(PCX)]=ListHead(lst);
+	FP[op_sl_val(PCX)]=ListTail(lst);
+	PC++;			/* skip the failure jump */
+      }
+      else
+	PC+=op_lo_val(*PC)+1;
+      continue;
+    }
+
+    case movlesc:		/* movl and the esc_fun that uses it */
+      FP[op_sh_val(PCX)]=Lits[op_o_val(PCX)];
+      PCX=*PC++;
+      goto esc_fun_ins;
+
+    case emovecall:		/* emove and the call that uses it */
+      FP[op_sl_val(PCX)]=E[op_sm_val(PCX)];
+      PCX=*PC++;
+      goto call_ins;
+
+    case lstprs:		/* lstpr and the next lstpr in a chain */
+    lstprs_ins:{
+      int hi = op_sh_val(PCX);
+      int mid = op_sm_val(PCX);
+      int low = op_sl_val(PCX);
+      int off = min3(hi,mid,low);
+
+      save_regs(FP+off,PC);
+
+      FP[low]=allocatePair(&FP[hi],&FP[mid]);
+
+      restore_regs();
+
+      PCX=*PC++;
+      if(op_cde(PCX)==lstprs)
+	goto lstprs_ins;
+      goto lstpr_ins;
+    }
+
     /* miscellaneous instructions */
     case snd:{			/* send a message */
       save_regs(FP+op_sh_val(PCX),PC);
 
-      sendAmsg(FP[op_sm_val(PCX)],FP[op_sl_val(PCX)],P->handle,emptyList);
-      
+      if(sendAmsg(FP[op_sm_val(PCX)],FP[op_sl_val(PCX)],P->handle,emptyList)==Error){
+	restore_regs();
+	RunErr("message cannot be sent",efail);
+      }
+
       P=ps_pause(P);
 
       restore_regs();
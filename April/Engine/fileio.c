@@ -37,6 +37,9 @@
 #include <limits.h>
 
 #include <signal.h>
+#ifdef HAVE_SYS_SENDFILE_H
+#include <sys/sendfile.h>
+#endif
 
 #include "april.h"
 #include "process.h"
@@ -48,11 +51,15 @@
 #include "term.h"
 #include "sign.h"
 #include "opaque.h"
+#include "async.h"
 #include "pool.h"
 #include "encoding.h"
+#include "labels.h"
+#include "image.h"
 #include "formioP.h"                    /* need this 'cos we are installing a handler */
 
 #define ICM_TAG_MASK 0xf0
+#define ICM_VAL_MASK 0x0f
 
 
 static retCode fileOpaqueHdlr(opaqueEvalCode code,void *p,void *cd,void *cl);
@@ -556,6 +563,108 @@ retCode m_dupfile(processpo p,objPo *args)
 }
 
 
+/*
+ * ICM dictionaries attached to files. Terms read from a file may always
+ * use its dictionary; terms are only written with one once the reader
+ * has said that it understands them.
+ *
+ * Each file handle has a record here, so that the dictionaries can be
+ * released when the file is closed or when the last handle on it is
+ * garbage.
+ */
+typedef struct _file_dict_ {
+  ioPo file;
+  int handles;			/* how many opaque values refer to file */
+  icmDictPo out;		/* dictionary of terms we write, or NULL */
+  icmDictPo in;			/* dictionary of terms we read, or NULL */
+  struct _file_dict_ *next;
+} FileDictRec, *fileDictPo;
+
+static fileDictPo fileDicts = NULL;
+
+static fileDictPo fileDict(ioPo file,logical create)
+{
+  fileDictPo d = fileDicts;
+
+  while(d!=NULL && d->file!=file)
+    d = d->next;
+
+  if(d==NULL && create){
+    d = (fileDictPo)malloc(sizeof(FileDictRec));
+    d->file = file;
+    d->handles = 0;
+    d->out = d->in = NULL;
+    d->next = fileDicts;
+    fileDicts = d;
+  }
+  return d;
+}
+
+static icmDictPo fileInDict(ioPo file)
+{
+  fileDictPo d = fileDict(file,True);
+
+  if(d->in==NULL)
+    d->in = newIcmDict();
+  return d->in;
+}
+
+/* The file is closed, but there may still be handles on it */
+static void clearFileDict(ioPo file)
+{
+  fileDictPo d = fileDict(file,False);
+
+  if(d!=NULL){
+    if(d->out!=NULL)
+      freeIcmDict(d->out);
+    if(d->in!=NULL)
+      freeIcmDict(d->in);
+    d->out = d->in = NULL;
+  }
+}
+
+/* A handle on a file is garbage */
+static void releaseFileDict(ioPo file)
+{
+  fileDictPo *d = &fileDicts;
+
+  while(*d!=NULL){
+    if((*d)->file==file){
+      fileDictPo f = *d;
+
+      if(--f->handles<=0){
+	clearFileDict(file);
+	*d = f->next;
+	free(f);
+      }
+      return;
+    }
+    d = &(*d)->next;
+  }
+}
+
+/*
+ * icm_dictionary(file)
+ *
+ * encode terms written to file using a dictionary from now on
+ */
+retCode m_icm_dictionary(processpo p,objPo *args)
+{
+  objPo t1 = args[0];
+
+  if(!p->priveleged)
+    return liberror("__icm_dictionary",1,"permission denied",eprivileged);
+  else if(!IsOpaque(t1) || OpaqueType(t1)!=_F_OPAQUE_)
+    return liberror("__icm_dictionary",1,"Invalid argument",einval);
+  else{
+    fileDictPo d = fileDict(opaqueFilePtr(t1),True);
+
+    if(d->out==NULL)
+      d->out = newIcmDict();
+    return Ok;
+  }
+}
+
 /*
  * fclose()
  * 
@@ -574,6 +683,7 @@ retCode m_fclose(processpo p,objPo *args)
     ioPo file = opaqueFilePtr(t1);
 
     detachProcessFromFile(file,p);
+    clearFileDict(file);
 
     closeFile(file);
     return Ok;
@@ -1215,13 +1325,94 @@ retCode m_read(processpo p,objPo *args)
 
 /*
  * Read a coded message from a process file
+ *
+ * A message is a trmString holding the encoded term. Its bytes are
+ * collected as they arrive: the state of a partly read message is kept
+ * with the process, which waits on the file between pieces, and the term
+ * itself is only decoded once the whole message is in.
  */
+typedef enum {decodeTag, decodeLength, decodeBody} decodeStage;
+
+#define MAXDECODE (64*1024*1024) /* Largest message that __decode will take */
+
 typedef struct{
-  ioPo str;
-  WORD64 count;
-  WORD32 len;
+  ioPo file;			/* the file we are reading from */
+  decodeStage stage;		/* which part of the message is next */
+  WORD32 len;			/* length bytes still to be read */
+  WORD64 count;			/* size of the message */
+  WORD64 got;			/* how much of it we have */
+  byte *data;			/* the message itself */
 } decodeData;
 
+static void freeDecodeData(decodeData *d)
+{
+  if(d->data!=NULL)
+    free(d->data);
+  free(d);
+}
+
+/* Read as much of the message as is available */
+static retCode readMessage(ioPo file,decodeData *d)
+{
+  retCode res = Ok;
+
+  while(res==Ok){
+    switch(d->stage){
+    case decodeTag:{
+      byte ch;
+
+      if((res=inByte(file,&ch))==Ok){
+	if((ch&ICM_TAG_MASK)!=trmString)
+	  return Error;
+
+	d->len = ch&ICM_VAL_MASK;
+	d->count = 0;
+	d->stage = decodeLength;
+
+	if(d->len>sizeof(WORD64))
+	  return Error;		/* no such length */
+      }
+      continue;
+    }
+
+    case decodeLength:
+      if(d->len>0){
+	byte ch;
+
+	if((res=inByte(file,&ch))==Ok){
+	  d->count = (d->count<<8)|ch;
+	  d->len--;
+
+	  if(d->count>MAXDECODE)
+	    return Space;	/* do not let the peer size our buffer */
+	}
+      }
+      else if((d->data=(byte*)malloc(d->count+1))==NULL)
+	return Space;
+      else{
+	d->got = 0;
+	d->stage = decodeBody;
+      }
+      continue;
+
+    case decodeBody:{
+      integer actual = 0;
+
+      if(d->got>=d->count)
+	return Ok;
+
+      res = inBytes(file,&d->data[d->got],d->count-d->got,&actual);
+      d->got += actual;		/* keep what we have, even if we must wait */
+
+      if(res==Ok && actual==0)
+	res = Fail;		/* nothing more there yet */
+      continue;
+    }
+    }
+  }
+  return res;
+}
+
 retCode m_decode(processpo p,objPo *args)
 {
   objPo t1 = args[0];
@@ -1239,80 +1430,84 @@ retCode m_decode(processpo p,objPo *args)
     /* input may suspend */
     switch(isInReady(file)){
     case Ok:{
-      objPo el = kvoid;
-      void *root = gcAddRoot(&el);
-      decodeData *ptr = (decodeData*)ps_client(p);
-      retCode res = Ok;
-      WORD64 i;
+      decodeData *d = (decodeData*)ps_client(p);
+      retCode res;
 
       detachProcessFromFile(file,p);
       ps_set_client(p,NULL);
 
-      if(ptr==NULL){
-        int ch = inCh(file);
-
-        if((ch&ICM_TAG_MASK)!=trmString)
-          return liberror("__decode",1,"not legal coded data",einval);
+      if(d!=NULL && d->file!=file){ /* left over from an abandoned read */
+	freeDecodeData(d);
+	d = NULL;
+      }
 
-        ptr = (decodeData*)malloc(sizeof(decodeData));
+      if(d==NULL){
+	d = (decodeData*)malloc(sizeof(decodeData));
 
-        ptr->str = openIoStr(rawEncoding);
-        ptr->len = (ch&0xf);       /* set the count to counting the initial length */
-        ptr->count = 0;
+	if(d==NULL)
+	  return liberror("__decode",1,"out of memory",esystem);
 
-        if(ptr->len>0){               /* We have to read the initial length */
-          while(res==Ok && ptr->len>0){
-            uniChar ch;
-            res = inChar(file,&ch);    /* read one of the length characters */
-            
-            if(res==Ok){
-              ptr->count = (ptr->count<<8)|ch;
-              ptr->len--;
-            }
-          }
-        }
+	d->file = file;
+	d->stage = decodeTag;
+	d->len = 0;
+	d->count = d->got = 0;
+	d->data = NULL;
       }
 
-      for(i=outBPos(ptr->str);res==Ok&&i<ptr->count;i++){
-        byte B;
-
-        res = inByte(file,&B);
-        if(res==Ok)
-          outByte(ptr->str,B); /* collect the data into our temporary string */
-      }
-          
-      switch(res){
-      case Eof:
-        free(ptr);
-        return liberror("__decode",1,"unexpected end of file",eeof);
-      default:
-        free(ptr);
-        return liberror("__decode",1,"problem in decoding",efail);
+      switch(res=readMessage(file,d)){
       case Suspend:
       case Interrupt:
       case Fail:
-        ps_set_client(p,ptr);
-        gcRemoveRoot(root);
-        return attachProcessToFile(file,p,input);
+	ps_set_client(p,d);	/* pick up from here when there is more */
+	return attachProcessToFile(file,p,input);
+
       case Ok:{
-        rewindStr(O_STRING(ptr->str)); /* Rewind the string file for reading */
-          
-        res = decodeICM(ptr->str,&el,verifyCode);
-        closeFile(ptr->str);
-        free(ptr);
+	objPo el = kvoid;
+	void *root = gcAddRoot(&el);
+	uniChar *text = (uniChar*)malloc(sizeof(uniChar)*(d->count+1));
+	ioPo str;
+	WORD64 i;
+
+	if(text==NULL){
+	  freeDecodeData(d);
+	  gcRemoveRoot(root);
+	  return liberror("__decode",1,"out of memory",esystem);
+	}
+
+	for(i=0;i<d->count;i++)
+	  text[i] = d->data[i];
+
+	str = openInStr(text,d->count,rawEncoding);
+	res = decodeICM(str,&el,verifyCode,fileInDict(file));
+	closeFile(str);
+	free(text);
+	freeDecodeData(d);
           
-        args[0]=el;
-        gcRemoveRoot(root);
+	args[0]=el;
+	gcRemoveRoot(root);
           
-        switch(res){
-        case Eof:
-          return liberror("__decode",1,"unexpected end of file",eeof);
-        case Ok:
-          return Ok;
-        default:
-          return liberror("__decode",1,"unexpected error",einval);
-        }
+	switch(res){
+	case Eof:
+	  return liberror("__decode",1,"unexpected end of file",eeof);
+	case Ok:
+	  return Ok;
+	default:
+	  return liberror("__decode",1,"unexpected error",einval);
+	}
       }
+
+      case Eof:
+	freeDecodeData(d);
+	return liberror("__decode",1,"unexpected end of file",eeof);
+      case Error:
+	freeDecodeData(d);
+	return liberror("__decode",1,"not legal coded data",einval);
+      case Space:
+	freeDecodeData(d);
+	return liberror("__decode",1,"message too large",efail);
+      default:
+	freeDecodeData(d);
+	return liberror("__decode",1,"problem in decoding",efail);
       }
     }
     case Suspend:
@@ -1497,6 +1692,121 @@ retCode m_outbytes(processpo p,objPo *args)
   }
 }
 
+/*
+ * sendfile(dst,src,count)
+ * 
+ * copy count bytes -- or the rest of the file if count is negative --
+ * from the plain file src to dst without passing through the heap.
+ * Bytes are taken from src's current read position, which is not advanced.
+ * Returns the number of bytes actually sent.
+ */
+
+static retCode sendBytes(int out,int in,off_t *pos,unsigned WORD32 count,
+			 unsigned WORD32 *sent)
+{
+#ifdef HAVE_SENDFILE
+  ssize_t n = sendfile(out,in,pos,count);
+#else
+  char buff[4096];
+  ssize_t n = pread(in,buff,count<sizeof(buff)?count:sizeof(buff),*pos);
+
+  if(n>0){
+    ssize_t w = write(out,buff,n);
+
+    if(w>=0)
+      *pos += w;
+    n = w;
+  }
+#endif
+
+  if(n>0){
+    *sent = n;
+    return Ok;
+  }
+  else if(n==0)
+    return Eof;
+  else if(errno==EAGAIN || errno==EWOULDBLOCK)
+    return Fail;
+  else if(errno==EINTR)
+    return Interrupt;
+  else
+    return Error;
+}
+
+retCode m_sendfile(processpo p,objPo *args)
+{
+  objPo t1 = args[2];
+  objPo t2 = args[1];
+  objPo t3 = args[0];
+
+  if(!p->priveleged)
+    return liberror("__sendfile",3,"permission denied",eprivileged);
+  else if(!IsOpaque(t1) || OpaqueType(t1)!=_F_OPAQUE_ ||
+	  !IsOpaque(t2) || OpaqueType(t2)!=_F_OPAQUE_)
+    return liberror("__sendfile",3,"Invalid argument",einval);
+  else if(!IsInteger(t3))
+    return liberror("__sendfile",3,"3rd argument should be an integer",einval);
+  else{
+    ioPo dst = opaqueFilePtr(t1);
+    ioPo src = opaqueFilePtr(t2);
+    unsigned WORD32 off = (unsigned WORD32)ps_client(p);
+    int out = fileNumber(O_FILE(dst));
+    int in = fileNumber(O_FILE(src));
+    struct stat buf;
+    unsigned WORD32 count;
+
+    if(isWritingFile(dst)!=Ok || isReadingFile(src)!=Ok)
+      return liberror("__sendfile",3,"permission denied",eprivileged);
+    else if(fstat(in,&buf)!=0 || !S_ISREG(buf.st_mode))
+      return liberror("__sendfile",3,"source should be a plain file",einval);
+
+    if(buf.st_size<=inBPos(src))
+      count = 0;
+    else
+      count = buf.st_size-inBPos(src);
+
+    if(IntVal(t3)>=0 && IntVal(t3)<count)
+      count = IntVal(t3);
+
+    ps_set_client(p,(void*)0);
+    detachProcessFromFile(dst,p);
+
+    switch(flushFile(dst)){	/* anything already buffered goes first */
+    case Ok:
+      break;
+    case Interrupt:
+    case Fail:
+      return attachProcessToFile(dst,p,output);
+    default:
+      return liberror("__sendfile",3,"Problem in writing",eio);
+    }
+
+    while(off<count){
+      off_t pos = inBPos(src)+off;
+      unsigned WORD32 sent;
+
+      switch(sendBytes(out,in,&pos,count-off,&sent)){
+      case Ok:
+	off += sent;
+	continue;
+      case Interrupt:
+	continue;
+      case Fail:		/* destination is full, wait for it */
+	ps_set_client(p,(void*)off);
+	return attachProcessToFile(dst,p,output);
+      case Eof:			/* file has shrunk underneath us */
+	count = off;
+	break;
+      default:
+	return liberror("__sendfile",3,"Problem in writing",eio);
+      }
+    }
+
+    args[2] = allocateInteger(off);
+    return Ok;
+  }
+}
+
 /* Write an encoded term onto a file channel */
 retCode m_encode(processpo p,objPo *args)
 {
@@ -1513,7 +1823,10 @@ retCode m_encode(processpo p,objPo *args)
       return liberror("__encode",2,"permission denied",eprivileged);
     else{
       ioPo tmp = openOutStr(rawEncoding);
-      retCode ret = encodeICM(tmp,args[0]);
+      fileDictPo d = fileDict(file,False);
+      icmDictPo dict = (d!=NULL?d->out:NULL);
+      int mark = (dict!=NULL?icmDictCount(dict):0);
+      retCode ret = encodeICM(tmp,args[0],True,dict);
       WORD32 blen;
       uniChar *buffer = getStrText(O_STRING(tmp),&blen); /* access the block written so far */
 
@@ -1526,6 +1839,9 @@ retCode m_encode(processpo p,objPo *args)
 
       closeFile(tmp);	                /* we are done with the temporary string file */
 
+      if(ret!=Ok && dict!=NULL)
+	truncIcmDict(dict,mark);	/* the message was not written */
+
       if(ret!=Ok)
         return liberror("__encode",1,"error in encoding",efail);
       return Ok;			/* return Ok flag */
@@ -1620,58 +1936,209 @@ retCode m_log_msg(processpo p,objPo *args)
 }
 
 /*
- * Try to load a code module from a named file
+ * Map a file: or sys: URL to the name of a local file
  */
-retCode load_code_file(uniChar *sys,uniChar *url,objPo *tgt,logical verify)
+retCode localFileName(uniChar *sys,uniChar *url,char *fn,WORD32 len)
 {
-  ioPo in = openURL(sys,url,rawEncoding);
-  uniChar ch;
-
-  if(in==NULL)
+  uniChar user[MAX_SYMB_LEN],pass[MAX_SYMB_LEN];
+  uniChar host[MAX_SYMB_LEN],path[MAX_SYMB_LEN];
+  uniChar query[MAX_SYMB_LEN];
+  WORD32 port;
+  urlScheme scheme;
+
+  if(parseURI(url,&scheme,user,NumberOf(user),pass,NumberOf(pass),
+	      host,NumberOf(host),&port,path,NumberOf(path),
+	      query,NumberOf(query))!=Ok)
     return Error;
-  else{
-    configureIo(O_FILE(in),turnOnBlocking);
 
-    ch = inCh(in);
+  switch(scheme){
+  case fileUrl:
+    break;
+  case sysUrl:{
+    uniChar sname[MAX_SYMB_LEN];
+    strMsg(sname,NumberOf(sname),"%U/%U",sys,path);
+
+    if(parseURI(sname,&scheme,user,NumberOf(user),pass,NumberOf(pass),
+		host,NumberOf(host),&port,path,NumberOf(path),
+		query,NumberOf(query))!=Ok ||
+       scheme!=fileUrl)
+      return Error;
+    break;
+  }
+  default:
+    return Fail;		/* not a local file */
+  }
+
+  _utf(path,(unsigned char*)fn,len);
+  return Ok;
+}
 
-    if(ch=='#'){			/* look for standard #!/.... header */
-      if((ch=inCh(in))=='!'){
-        while((ch=inCh(in))!=uniEOF && ch!=NEW_LINE)
-  	  ;			        /* consume the interpreter statement */
-      }
-      else{
-        unGetChar(in,ch);
-        unGetChar(in,'#');
-      }
+/* Load code from a stream, skipping any #! header */
+static retCode loadCode(ioPo in,objPo *tgt,logical verify,logical lazy)
+{
+  uniChar ch = inCh(in);
+
+  if(ch=='#'){			/* look for standard #!/.... header */
+    if((ch=inCh(in))=='!'){
+      while((ch=inCh(in))!=uniEOF && ch!=NEW_LINE)
+	;			/* consume the interpreter statement */
     }
-    else
+    else{
       unGetChar(in,ch);
+      unGetChar(in,'#');
+    }
+  }
+  else
+    unGetChar(in,ch);
       
-    {
-      retCode ret = decodeICM(in,tgt,verify);
+  if(lazy)
+    return decodeLazyICM(in,tgt,verify);
+  else
+    return decodeICM(in,tgt,verify,NULL);
+}
 
-      closeFile(in);
- 
-      return ret;
+/*
+ * Try to load a code module from a named file. Lazily loaded modules are
+ * not saved in the boot image, as their stubs cannot be.
+ */
+retCode load_code_file(uniChar *sys,uniChar *url,objPo *tgt,logical verify,logical lazy)
+{
+  ioPo in;
+
+  if(imageCode(url,tgt)==Ok)
+    return Ok;			/* saved in the boot image */
+  else if((in=openURL(sys,url,rawEncoding))==NULL)
+    return Error;
+  else{
+    retCode ret;
+
+    configureIo(O_FILE(in),turnOnBlocking);
+
+    ret = loadCode(in,tgt,verify,lazy);
+
+    closeFile(in);
+
+    if(ret==Ok && !lazy)
+      imageRecord(url,*tgt);
+    return ret;
+  }
+}
+
+typedef struct {
+  char fn[MAX_SYMB_LEN];	/* The file to read */
+  WORD32 len;			/* How much of it we read */
+  unsigned char text[1];	/* The file's contents */
+} loadJobRec, *loadJobPo;
+
+/* Read a code file into memory -- runs in a worker thread */
+static retCode loadJob(asyncPo job)
+{
+  loadJobPo l = (loadJobPo)job->data;
+  struct stat buf;
+  int fd;
+  retCode ret = Ok;
+
+  if((fd=open(l->fn,O_RDONLY))<0)
+    return Error;
+  else if(fstat(fd,&buf)!=0 ||
+	  (l=(loadJobPo)realloc(l,sizeof(loadJobRec)+buf.st_size))==NULL)
+    ret = Error;		/* job->data is still the old record */
+  else{
+    job->data = l;
+    l->len = 0;
+
+    while(l->len<buf.st_size){
+      ssize_t n = read(fd,&l->text[l->len],buf.st_size-l->len);
+
+      if(n<0 && errno==EINTR)
+	continue;
+      else if(n<=0)
+	break;
+      else
+	l->len += n;
     }
+
+    if(l->len<buf.st_size)
+      ret = Error;		/* never decode part of a file */
   }
+
+  close(fd);
+  return ret;
 }
 
-retCode m_load(processpo p,objPo *args)
+/* Decode a code file that a worker has read into memory */
+static retCode loadJobCode(asyncPo job,objPo *tgt,logical verify,logical lazy)
+{
+  loadJobPo l = (loadJobPo)job->data;
+
+  if(job->ret!=Ok)
+    return Error;
+  else if(l->len==0)
+    return Eof;
+  else{
+    uniChar *buff = (uniChar*)malloc(sizeof(uniChar)*l->len);
+    WORD32 i;
+    retCode ret;
+    ioPo in;
+
+    if(buff==NULL)
+      return Space;
+
+    for(i=0;i<l->len;i++)
+      buff[i] = l->text[i];
+
+    in = openInStr(buff,l->len,rawEncoding);
+    ret = loadCode(in,tgt,verify,lazy);
+    closeFile(in);
+    free(buff);
+    return ret;
+  }
+}
+
+static retCode loadModule(processpo p,objPo *args,char *name,logical lazy)
 {
   objPo t1 = args[0];
 
   if(!isListOfChars(t1))
-    return liberror("_load_code", 1, "argument should be string",einval);
+    return liberror(name, 1, "argument should be string",einval);
   else if(!p->priveleged)
-    return liberror("_load_code", 1, "permission denied",eprivileged);
+    return liberror(name, 1, "permission denied",eprivileged);
   else{
     uniChar url[MAX_SYMB_LEN];
     uniChar em[MAX_SYMB_LEN];
+    asyncPo job = asyncResult(p,loadJob);
+    retCode ret;
     
     StringText(t1,url,NumberOf(url));
 
-    switch(load_code_file(aprilSysPath,url,&args[0],verifyCode)){
+    if(job==NULL && imageCode(url,&args[0])==Ok)
+      return Ok;		/* saved in the boot image */
+    else if(job==NULL){		/* local files are read by a worker */
+      loadJobPo l = (loadJobPo)malloc(sizeof(loadJobRec));
+
+      if(l==NULL)
+	return liberror(name, 1, "out of memory",esystem);
+      else if(localFileName(aprilSysPath,url,l->fn,NumberOf(l->fn))!=Ok){
+	free(l);
+	ret = load_code_file(aprilSysPath,url,&args[0],verifyCode,lazy);
+      }
+      else if((ret=asyncEscape(p,loadJob,l))==Ok)
+	job = asyncResult(p,loadJob);
+      else if(ret==Space)
+	return liberror(name, 1, "out of memory",esystem);
+      else
+	return ret;
+    }
+
+    if(job!=NULL){
+      ret = loadJobCode(job,&args[0],verifyCode,lazy);
+      asyncFree(job);
+
+      if(ret==Ok && !lazy)
+	imageRecord(url,args[0]);
+    }
+
+    switch(ret){
     case Ok:
       return Ok;
     case Error:
@@ -1679,22 +2146,33 @@ retCode m_load(processpo p,objPo *args)
         strMsg(em,NumberOf(em),"code in %U has a problem: %U",url,errorMsg);
       else
         strMsg(em,NumberOf(em),"cant load program from %U",url);
-      return Uliberror("_load_code", 1, em,efail);
+      return Uliberror(name, 1, em,efail);
     case Eof:
       strMsg(em,NumberOf(em),"%U is empty or contains non-april code",url);
-      return Uliberror("_load_code", 1, em,efail);
+      return Uliberror(name, 1, em,efail);
     case Switch:
       return Switch;		/* not very likely */
     case Suspend:
       return Suspend;		/* This could happen */
     case Space:
-      return liberror("_load_code", 1, "no heap space",esystem);
+      return liberror(name, 1, "no heap space",esystem);
     default:
-      return liberror("_load_code",1,"problem in loading",eio);
+      return liberror(name,1,"problem in loading",eio);
     }
   }
 }
 
+retCode m_load(processpo p,objPo *args)
+{
+  return loadModule(p,args,"_load_code",False);
+}
+
+/* Load a module whose functions are decoded when they are first called */
+retCode m_load_lazy(processpo p,objPo *args)
+{
+  return loadModule(p,args,"_load_lazy",True);
+}
+
 /* This must be installed into outMsg */
 static retCode cellMsg(ioPo f,void *data,WORD32 width,WORD32 precision,logical alt)
 {
@@ -1774,6 +2252,9 @@ static retCode fileOpaqueHdlr(opaqueEvalCode code,void *p,void *cd,void *cl)
     outMsg(f,"<<file %U>>",fileName(ff));
     return Ok;
   }
+  case finaliseOpaque:
+    releaseFileDict((ioPo)p);
+    return Ok;
   default:
     return Error;
   }
@@ -1781,7 +2262,11 @@ static retCode fileOpaqueHdlr(opaqueEvalCode code,void *p,void *cd,void *cl)
 
 objPo allocOpaqueFilePtr(ioPo file)
 {
-  return allocateOpaque(_F_OPAQUE_,(void *)file);
+  objPo o = allocateOpaque(_F_OPAQUE_,(void *)file);
+
+  finaliseOnDeath(o);
+  fileDict(file,True)->handles++; /* after any collection */
+  return o;
 }
 
 ioPo opaqueFilePtr(objPo p)
@@ -833,6 +833,17 @@ void adjustRoots(void)
     *roots[i] = adjustCell(*roots[i]);
 }
 
+/* Where has an opaque value gone to? */
+static objPo copiedOpaque(objPo o)
+{
+  if(!currentGeneration(o))
+    return o;			/* not collected this time */
+  else if(Forwarded(o))
+    return FwdVal(o);
+  else
+    return NULL;
+}
+
 /*
  * Basic garbage collection program
  */
@@ -855,6 +866,7 @@ static void gC(objPo base,objPo limit)
     *roots[i]=scanCell(*roots[i]); /* scan the extra roots */
 
   scanLabels();
+  scanImage();
 
   scanOldGen();			/* scan the old generation also */
 
@@ -863,6 +875,9 @@ static void gC(objPo base,objPo limit)
   while(scan!=next)
     scan = scanObject(scan);	/* Second phase -- we scan the main heap */
 
+  sweepOpaques(copiedOpaque);	/* finalise dead opaque values */
+  sweepDebugSites(copiedOpaque); /* forget code that has gone */
+
   resetProcesses();		/* clean up processes */
 }
 
@@ -948,6 +963,8 @@ logical gCollect(integer amount)
     createSpaceEnd = heapEnd;
   }
 
+  shrinkStacks();		/* give back stack space that is no longer used */
+
 #ifdef MEMTRACE
   if(traceMemory){
     verifySpace(heap,oldSpaceEnd);
@@ -0,0 +1,690 @@
+/*
+  Boot images -- loaded code saved as a relocatable heap
+  (c) 1994-2003 Imperial College and F.G.McCabe
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+  Contact: Francis McCabe <fgm@fla.fujitsu.com>
+*/
+
+/*
+ * An engine started with -S remembers each module it loads from a local
+ * file, and when it exits writes the modules -- and everything they refer
+ * to -- to an image file. The image is a copy of those heap objects with
+ * their pointers replaced by offsets into the image.
+ *
+ * An engine started with -B maps the image, copies it into its heap in one
+ * block and relocates it. Symbols are merged with the dictionary, and the
+ * few objects that are compared by address -- such as the empty list --
+ * are replaced by the engine's own. Loading a module then looks in the
+ * image first, and uses the saved code if the file's contents have the
+ * same digest as when it was saved.
+ *
+ * The code in an image is verified as it is loaded, just as if it had come
+ * from its file -- usually the verification cache makes that cheap. Even
+ * so, the image must be ours and writable by nobody else.
+ */
+
+#include "config.h"		/* pick up standard configuration header */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/param.h>
+
+#include "april.h"
+#include "dict.h"
+#include "chars.h"
+#include "astring.h"
+#include "fileio.h"
+#include "image.h"
+#include "process.h"
+#include "debug.h"
+#include "term.h"
+
+#define IMAGEALIGN sizeof(double) /* alignment of numbers in an image */
+#define IMAGEINIT 1024		/* initial size of the tables used to save */
+
+typedef struct {
+  char magic[8];		/* IMAGEMAGIC */
+  char version[128];		/* the engine that wrote the image */
+  long cellSize;		/* size of a heap cell */
+  long cells;			/* number of cells in the image */
+  long root;			/* reference to the list of modules */
+} ImageHeader;
+
+/*
+ * A reference in an image is 0 for NULL, an offset plus one for an object
+ * in the image, or minus the index of a well known object.
+ */
+#define WELLKNOWN 3
+
+static objPo *wellKnown(long ref)
+{
+  switch(ref){
+  case -1:
+    return &emptyList;
+  case -2:
+    return &emptyTuple;
+  case -3:
+    return &kstringTp;
+  default:
+    return NULL;
+  }
+}
+
+char *bootImageFile = NULL;	/* image to start from */
+char *saveImageFile = NULL;	/* image to write when we exit */
+
+static objPo modules = NULL;	/* list of (url,digest,size,code) tuples */
+
+typedef void (*refFun)(objPo *ref,void *cl);
+
+/* Apply fn to each of the pointers in an object */
+static void visitRefs(objPo o,refFun fn,void *cl)
+{
+  long i;
+
+  switch(Tag(o)){
+  case variableMarker:
+    fn(&((variablePo)o)->val,cl);
+    return;
+  case listMarker:
+    fn(&((listPo)o)->data[0],cl);
+    fn(&((listPo)o)->data[1],cl);
+    return;
+  case consMarker:
+    fn(&((consPo)o)->fn,cl);
+    for(i=0;i<SignVal(o);i++)
+      fn(&((consPo)o)->data[i],cl);
+    return;
+  case tupleMarker:
+    for(i=0;i<SignVal(o);i++)
+      fn(&((tuplePo)o)->data[i],cl);
+    return;
+  case anyMarker:
+    fn(&((anyPo)o)->sig,cl);
+    fn(&((anyPo)o)->data,cl);
+    return;
+  case codeMarker:{
+    objPo *lits = CodeLits(o);
+
+    for(i=0;i<CodeLitcnt(o);i++)
+      fn(&lits[i],cl);
+    fn(&((codePo)o)->type,cl);
+    fn(&((codePo)o)->frtype,cl);
+    return;
+  }
+  default:
+    return;
+  }
+}
+
+/* Size of an object, or 0 if it cannot be in an image */
+static long cellCount(objPo o)
+{
+  switch(Tag(o)){
+  case integerMarker:
+    return IntegerCellCount;
+  case variableMarker:
+    return VariableCellCount;
+  case symbolMarker:
+    return SymbCellLength(o);
+  case charMarker:
+    return CharCellCount;
+  case floatMarker:
+    return FloatCellCount;
+  case listMarker:
+    return ListCellCount;
+  case consMarker:
+    return ConsCellCount(SignVal(o));
+  case tupleMarker:
+    return TupleCellCount(SignVal(o));
+  case anyMarker:
+    return AnyCellCount;
+  case codeMarker:
+    return CodeCellCount(CodeSize(o),CodeLitcnt(o));
+  default:
+    return 0;			/* handles and opaque values belong to this engine */
+  }
+}
+
+static logical alignedObject(objPo o)
+{
+  return IMAGEALIGN>CLLSZE && (Tag(o)==integerMarker || Tag(o)==floatMarker);
+}
+
+/* Saving an image */
+
+typedef struct {
+  objPo *objs;			/* objects in the order they are saved */
+  long *offs;			/* the offset of each */
+  long count;
+  long max;
+  objPo *keys;			/* open hash table from objects ... */
+  long *vals;			/* ... to their index plus one */
+  long size;
+  long cells;			/* size of the image so far */
+  logical ok;			/* False if something cannot be saved */
+} SaveRec, *savePo;
+
+static inline unsigned long hashObj(objPo o,long size)
+{
+  return ((((unsigned long)o)>>3)*2654435761ul)&(size-1);
+}
+
+static long findObj(savePo s,objPo o)
+{
+  unsigned long h;
+
+  for(h=hashObj(o,s->size);s->keys[h]!=NULL;h=(h+1)&(s->size-1))
+    if(s->keys[h]==o)
+      return s->vals[h]-1;
+  return -1;
+}
+
+static void installObj(savePo s,objPo o,long ix)
+{
+  unsigned long h;
+
+  for(h=hashObj(o,s->size);s->keys[h]!=NULL;h=(h+1)&(s->size-1))
+    ;
+  s->keys[h] = o;
+  s->vals[h] = ix+1;
+}
+
+static long wellKnownRef(objPo o)
+{
+  long i;
+
+  for(i=1;i<=WELLKNOWN;i++)
+    if(*wellKnown(-i)==o)
+      return -i;
+  return 0;
+}
+
+/* Add an object to the image, if it is not there already */
+static void saveRef(objPo *ref,void *cl)
+{
+  savePo s = (savePo)cl;
+  objPo o = *ref;
+  long size;
+
+  if(o==NULL || wellKnownRef(o)!=0 || findObj(s,o)>=0)
+    return;
+  else if((size=cellCount(o))==0){
+    s->ok = False;
+    return;
+  }
+
+  if(s->count>=s->max){
+    s->max *= 2;
+    s->objs = (objPo*)realloc(s->objs,s->max*sizeof(objPo));
+    s->offs = (long*)realloc(s->offs,s->max*sizeof(long));
+  }
+
+  if((s->count+1)*2>s->size){	/* keep the table half empty */
+    long i;
+
+    s->size *= 2;
+    free(s->keys);
+    free(s->vals);
+    s->keys = (objPo*)calloc(s->size,sizeof(objPo));
+    s->vals = (long*)calloc(s->size,sizeof(long));
+
+    for(i=0;i<s->count;i++)
+      installObj(s,s->objs[i],i);
+  }
+
+  if(alignedObject(o) && (s->cells*CLLSZE)%IMAGEALIGN!=0)
+    s->cells++;			/* a padding cell */
+
+  s->objs[s->count] = o;
+  s->offs[s->count] = s->cells;
+  installObj(s,o,s->count);
+  s->count++;
+  s->cells += size;
+}
+
+/* Replace a pointer in a saved object by a reference */
+static void encodeRef(objPo *ref,void *cl)
+{
+  savePo s = (savePo)cl;
+  objPo o = *ref;
+  long wk;
+
+  if(o==NULL)
+    *ref = (objPo)0;
+  else if((wk=wellKnownRef(o))!=0)
+    *ref = (objPo)wk;
+  else
+    *ref = (objPo)(s->offs[findObj(s,o)]+1);
+}
+
+void saveImage(void)
+{
+  extern char version[];
+  SaveRec s;
+  ImageHeader hdr;
+  objPo root = modules;
+  long *cells;
+  long i;
+
+  if(saveImageFile==NULL || modules==NULL || modules==emptyList)
+    return;
+
+  s.max = s.size = IMAGEINIT;
+  s.count = s.cells = 0;
+  s.objs = (objPo*)malloc(s.max*sizeof(objPo));
+  s.offs = (long*)malloc(s.max*sizeof(long));
+  s.keys = (objPo*)calloc(s.size,sizeof(objPo));
+  s.vals = (long*)calloc(s.size,sizeof(long));
+  s.ok = True;
+
+  saveRef(&root,&s);
+
+  for(i=0;s.ok && i<s.count;i++)	/* the list grows as we go */
+    visitRefs(s.objs[i],saveRef,&s);
+
+  if(!s.ok)
+    logMsg(logFile,"loaded code refers to handles or opaque values, image not saved");
+  else{
+    cells = (long*)malloc(s.cells*CLLSZE);
+
+    for(i=0;i<s.cells;i++)
+      cells[i] = tupleMark(0);	/* padding is an empty tuple */
+
+    for(i=0;i<s.count;i++){
+      objPo copy = (objPo)&cells[s.offs[i]];
+
+      memcpy(copy,s.objs[i],cellCount(s.objs[i])*CLLSZE);
+      visitRefs(copy,encodeRef,&s);
+
+      if(Tag(copy)==codeMarker){	/* save code as it was loaded */
+	unsigned long j;
+
+	for(j=0;j<CodeSize(copy);j++)
+	  CodeCode(copy)[j] = loadedIns(s.objs[i],j);
+      }
+    }
+
+    memset(&hdr,0,sizeof(hdr));
+    memcpy(hdr.magic,IMAGEMAGIC,sizeof(hdr.magic));
+    strncpy(hdr.version,version,sizeof(hdr.version)-1);
+    hdr.cellSize = CLLSZE;
+    hdr.cells = s.cells;
+    encodeRef(&root,&s);
+    hdr.root = (long)root;
+
+    {
+      char tmp[MAXPATHLEN];
+      int fd;
+
+      sprintf(tmp,"%.*s.new",(int)(NumberOf(tmp)-5),saveImageFile);
+
+      if((fd=open(tmp,O_WRONLY|O_CREAT|O_TRUNC,0600))<0 ||
+	 write(fd,&hdr,sizeof(hdr))!=sizeof(hdr) ||
+	 write(fd,cells,s.cells*CLLSZE)!=s.cells*CLLSZE ||
+	 close(fd)!=0 || rename(tmp,saveImageFile)!=0){
+	logMsg(logFile,"cant write image %s",saveImageFile);
+	unlink(tmp);
+      }
+    }
+
+    free(cells);
+  }
+
+  free(s.objs);
+  free(s.offs);
+  free(s.keys);
+  free(s.vals);
+}
+
+/* Loading an image */
+
+typedef struct {
+  objPo base;			/* where the image is in the heap */
+  long cells;
+  unsigned char *starts;	/* bit map of where objects start */
+  long *symOffs;		/* offsets of the symbols, in order ... */
+  objPo *syms;			/* ... and the dictionary's symbols */
+  long symCount;
+  logical ok;
+} LoadRec, *loadPo;
+
+#define isStart(l,off) (((l)->starts[(off)>>3]&(1<<((off)&7)))!=0)
+
+static objPo dictSym(loadPo l,long off)
+{
+  long lo = 0, hi = l->symCount-1;
+
+  while(lo<=hi){
+    long mid = (lo+hi)/2;
+
+    if(l->symOffs[mid]==off)
+      return l->syms[mid];
+    else if(l->symOffs[mid]<off)
+      lo = mid+1;
+    else
+      hi = mid-1;
+  }
+  return NULL;
+}
+
+static void relocRef(objPo *ref,void *cl)
+{
+  loadPo l = (loadPo)cl;
+  long v = (long)*ref;
+
+  if(v==0)
+    *ref = NULL;
+  else if(v<0){
+    objPo *wk = wellKnown(v);
+
+    if(wk!=NULL)
+      *ref = *wk;
+    else
+      l->ok = False;
+  }
+  else if(v>l->cells || !isStart(l,v-1))
+    l->ok = False;
+  else{
+    objPo o = l->base+(v-1);
+
+    if(Tag(o)==symbolMarker)
+      o = dictSym(l,v-1);
+    *ref = o;
+  }
+}
+
+/* Check an object in the image, and find its size */
+static long checkObject(objPo o,long room)
+{
+  long size = (Tag(o)==codeMarker && room*CLLSZE<sizeof(codeRec)?0:cellCount(o));
+
+  if(size<=0 || size>room)
+    return 0;
+  else if(Tag(o)==symbolMarker){	/* the name must be within the symbol */
+    uniChar *s = SymVal(o);
+    long len = (size*CLLSZE-sizeof(symbolRec))/sizeof(uniChar);
+    long i;
+
+    for(i=0;i<len;i++)
+      if(s[i]==0)
+	return size;
+    return 0;
+  }
+  else if(Tag(o)==codeMarker && CodeCellCount(CodeSize(o),CodeLitcnt(o))!=size)
+    return 0;
+  else
+    return size;
+}
+
+static retCode loadImage(char *file)
+{
+  extern char version[];
+  struct stat buf;
+  ImageHeader *hdr;
+  LoadRec l;
+  objPo block;
+  long off;
+  int fd;
+
+  if((fd=open(file,O_RDONLY))<0)
+    return Error;
+  else if(fstat(fd,&buf)!=0 || !S_ISREG(buf.st_mode) ||
+	  buf.st_uid!=geteuid() || (buf.st_mode&(S_IWGRP|S_IWOTH))!=0 ||
+	  buf.st_size<sizeof(ImageHeader) ||
+	  (hdr=(ImageHeader*)mmap(NULL,buf.st_size,PROT_READ,MAP_PRIVATE,fd,0))==MAP_FAILED){
+    close(fd);
+    return Error;
+  }
+
+  close(fd);
+
+  if(memcmp(hdr->magic,IMAGEMAGIC,sizeof(hdr->magic))!=0 ||
+     strncmp(hdr->version,version,sizeof(hdr->version)-1)!=0 ||
+     hdr->cellSize!=CLLSZE || hdr->cells<=0 ||
+     buf.st_size!=sizeof(ImageHeader)+hdr->cells*CLLSZE){
+    munmap(hdr,buf.st_size);
+    return Fail;		/* not an image from this engine */
+  }
+
+  l.cells = hdr->cells;
+
+  /* One spare cell lets us align the image */
+  block = allocate(l.cells+1,tupleMark(0));
+
+  if(ALIGNED(block,IMAGEALIGN)){
+    l.base = block;
+    (block+l.cells)->sign = tupleMark(0);
+  }
+  else
+    l.base = block+1;
+
+  memcpy(l.base,hdr+1,l.cells*CLLSZE);
+  munmap(hdr,buf.st_size);
+
+  l.starts = (unsigned char*)calloc((l.cells+7)/8,1);
+  l.symOffs = (long*)malloc(IMAGEINIT*sizeof(long));
+  l.syms = (objPo*)malloc(IMAGEINIT*sizeof(objPo));
+  l.symCount = 0;
+  l.ok = True;
+
+  /* Find the objects, and merge the symbols with the dictionary */
+  for(off=0;l.ok && off<l.cells;){
+    objPo o = l.base+off;
+    long size = checkObject(o,l.cells-off);
+
+    if(size==0)
+      l.ok = False;
+    else{
+      l.starts[off>>3] |= 1<<(off&7);
+
+      if(Tag(o)==symbolMarker){
+	if(l.symCount%IMAGEINIT==0 && l.symCount>0){
+	  l.symOffs = (long*)realloc(l.symOffs,(l.symCount+IMAGEINIT)*sizeof(long));
+	  l.syms = (objPo*)realloc(l.syms,(l.symCount+IMAGEINIT)*sizeof(objPo));
+	}
+	l.symOffs[l.symCount] = off;
+	l.syms[l.symCount++] = internSymbol(o);
+      }
+      off += size;
+    }
+  }
+
+  /* Relocate the pointers */
+  for(off=0;l.ok && off<l.cells;){
+    objPo o = l.base+off;
+
+    visitRefs(o,relocRef,&l);
+    off += cellCount(o);
+  }
+
+  /* Images hold code as it was loaded */
+  for(off=0;l.ok && off<l.cells;){
+    objPo o = l.base+off;
+
+    if(Tag(o)==codeMarker){
+      char *msg;
+
+      if(verifyCode && (msg=verifyCached(o,True))!=NULL){
+	logMsg(logFile,"error in code in image %s: %s",file,msg);
+	l.ok = False;
+      }
+      else
+	disableDebugSites(o);
+    }
+    off += cellCount(o);
+  }
+
+  if(l.ok){
+    objPo root = (objPo)hdr->root;
+
+    relocRef(&root,&l);
+
+    if(l.ok && root!=NULL && (root==emptyList || isNonEmptyList(root)))
+      modules = root;
+    else
+      l.ok = False;
+  }
+
+  free(l.starts);
+  free(l.symOffs);
+  free(l.syms);
+
+  return l.ok?Ok:Error;
+}
+
+void initImage(void)
+{
+  modules = emptyList;
+
+  if(bootImageFile!=NULL){
+    switch(loadImage(bootImageFile)){
+    case Ok:
+      break;
+    case Fail:
+      logMsg(logFile,"image %s was written by a different engine",bootImageFile);
+      break;
+    default:
+      logMsg(logFile,"cant load image %s",bootImageFile);
+    }
+  }
+}
+
+/* Modules */
+
+/* The size of a module's file, and the digest of its contents in hex */
+static logical fileStamp(uniChar *url,char *hex,integer *size)
+{
+  char fn[MAXPATHLEN];
+  unsigned char d[DIGESTLEN];
+  struct stat buf;
+  int i;
+
+  if(localFileName(aprilSysPath,url,fn,NumberOf(fn))!=Ok || stat(fn,&buf)!=0 ||
+     !fileDigest(fn,d))
+    return False;
+
+  for(i=0;i<DIGESTLEN;i++)
+    sprintf(&hex[2*i],"%02x",d[i]);
+  *size = buf.st_size;
+  return True;
+}
+
+static logical sameDigest(objPo str,char *hex)
+{
+  char text[2*DIGESTLEN+1];
+
+  if(!isListOfChars(str))
+    return False;
+
+  Cstring(str,text,NumberOf(text));
+  return strcmp(text,hex)==0;
+}
+
+/* Find the entry for a module */
+static objPo findModule(uniChar *url)
+{
+  objPo lst;
+
+  for(lst=modules;isNonEmptyList(lst);lst=ListTail(lst)){
+    objPo m = ListHead(lst);
+
+    if(IsTuple(m) && tupleArity(m)==4 && isListOfChars(tupleArg(m,0))){
+      uniChar name[MAX_SYMB_LEN];
+
+      StringText(tupleArg(m,0),name,NumberOf(name));
+
+      if(uniCmp(name,url)==0)
+	return m;
+    }
+  }
+  return NULL;
+}
+
+/* The code for a module, if it has not changed since it was saved */
+retCode imageCode(uniChar *url,objPo *tgt)
+{
+  char hex[2*DIGESTLEN+1];
+  integer size;
+  objPo m;
+
+  if(modules==NULL || (m=findModule(url))==NULL || !fileStamp(url,hex,&size))
+    return Fail;
+  else if(sameDigest(tupleArg(m,1),hex) &&
+	  IsInteger(tupleArg(m,2)) && IntVal(tupleArg(m,2))==size &&
+	  IsCode(tupleArg(m,3))){
+    *tgt = tupleArg(m,3);
+    return Ok;
+  }
+  else
+    return Fail;
+}
+
+void imageRecord(uniChar *url,objPo code)
+{
+  char hex[2*DIGESTLEN+1];
+  integer size;
+  objPo m;
+
+  if(saveImageFile==NULL || modules==NULL || !fileStamp(url,hex,&size))
+    return;
+  else if((m=findModule(url))!=NULL && tupleArg(m,3)==code)
+    return;			/* we got it from the image */
+  else{
+    objPo ent = kvoid;
+    objPo el = kvoid;
+    void *root = gcAddRoot(&code);
+
+    gcAddRoot(&ent);
+    gcAddRoot(&el);
+
+    ent = allocateTuple(4);
+    updateTuple(ent,3,code);
+    el = allocateString(url);
+    updateTuple(ent,0,el);
+    el = allocateCString(hex);
+    updateTuple(ent,1,el);
+    el = allocateInteger(size);
+    updateTuple(ent,2,el);
+
+    modules = allocatePair(&ent,&modules);
+
+    gcRemoveRoot(root);
+  }
+}
+
+void scanImage(void)
+{
+  modules = scanCell(modules);
+}
+
+void markImage(void)
+{
+  if(modules!=NULL)
+    markCell(modules);
+}
+
+void adjustImage(void)
+{
+  if(modules!=NULL)
+    modules = adjustCell(modules);
+}
@@ -25,53 +25,331 @@
 #include <assert.h>
 
 #include "april.h"
-#include "pool.h"               // We need a pool of labels
+#include "encoding.h"
 #include "labels.h"             // Support for label management
 
-static poolPo lblPool = NULL;
+/*
+ * Terms are looked up by their address, so a table is only valid while
+ * the garbage collector is not allowed to move things.
+ */
+static inline unsigned long hashTerm(objPo term,int size)
+{
+  return ((((unsigned long)term)>>3)*2654435761ul)&(size-1);
+}
 
-lblPo createLabel(objPo term,int ref,lblPo chain)
+lblTablePo newLabelTable(int size)
 {
-  if(lblPool==NULL)
-    lblPool = newPool(sizeof(LabelRec),16);
-    
-  {
-    lblPo lbl = (lblPo)allocPool(lblPool);
-    lbl->term = term;
-    lbl->ref = ref;
-    lbl->prev = chain;
-    return lbl;
-  }
+  lblTablePo tbl = (lblTablePo)malloc(sizeof(LabelTable));
+  int sz = 16;
+
+  while(sz<size)
+    sz <<= 1;
+
+  tbl->size = sz;
+  tbl->count = 0;
+  tbl->terms = (objPo*)calloc(sz,sizeof(objPo));
+  tbl->refs = (int*)malloc(sizeof(int)*sz);
+  return tbl;
 }
 
-int searchLabels(objPo term,lblPo chain)
+int findLabel(lblTablePo tbl,objPo term)
 {
-  while(chain!=NULL){
-    if(chain->term==term)
-      return chain->ref;
-    chain = chain->prev;
+  unsigned long h = hashTerm(term,tbl->size);
+
+  while(tbl->terms[h]!=NULL){
+    if(tbl->terms[h]==term)
+      return tbl->refs[h];
+    h = (h+1)&(tbl->size-1);
   }
-  
   return -1;
 }
 
-objPo findObj(int ref,lblPo chain)
+static void growTable(lblTablePo tbl)
+{
+  int oldSize = tbl->size;
+  objPo *oldTerms = tbl->terms;
+  int *oldRefs = tbl->refs;
+  int i;
+
+  tbl->size = oldSize<<1;
+  tbl->count = 0;
+  tbl->terms = (objPo*)calloc(tbl->size,sizeof(objPo));
+  tbl->refs = (int*)malloc(sizeof(int)*tbl->size);
+
+  for(i=0;i<oldSize;i++)
+    if(oldTerms[i]!=NULL)
+      setLabel(tbl,oldTerms[i],oldRefs[i]);
+
+  free(oldTerms);
+  free(oldRefs);
+}
+
+void setLabel(lblTablePo tbl,objPo term,int ref)
 {
-  while(chain!=NULL){
-    if(chain->ref == ref)
-      return chain->term;
-    chain = chain->prev;
+  unsigned long h;
+
+  if(tbl->count*2>=tbl->size)	/* keep the table at most half full */
+    growTable(tbl);
+
+  h = hashTerm(term,tbl->size);
+
+  while(tbl->terms[h]!=NULL && tbl->terms[h]!=term)
+    h = (h+1)&(tbl->size-1);
+
+  if(tbl->terms[h]==NULL){
+    tbl->terms[h] = term;
+    tbl->count++;
   }
-  return NULL;
+  tbl->refs[h] = ref;
+}
+
+int labelCount(lblTablePo tbl)
+{
+  return tbl->count;
+}
+
+void freeLabelTable(lblTablePo tbl)
+{
+  free(tbl->terms);
+  free(tbl->refs);
+  free(tbl);
+}
+
+/*
+ * ICM dictionaries. All the dictionaries are chained together so that the
+ * garbage collector can find the terms held by decoding dictionaries.
+ */
+static icmDictPo dicts = NULL;
+
+static inline unsigned long hashKey(unsigned char *key,int len,int size)
+{
+  unsigned long h = 0;
+
+  while(len-->0)
+    h = h*31+*key++;
+  return (h*2654435761ul)&(size-1);
+}
+
+icmDictPo newIcmDict(void)
+{
+  icmDictPo dict = (icmDictPo)malloc(sizeof(IcmDict));
+
+  dict->size = 64;
+  dict->count = 0;
+  dict->keys = (unsigned char**)calloc(dict->size,sizeof(unsigned char*));
+  dict->keyLens = (int*)malloc(sizeof(int)*dict->size);
+  dict->ixs = (int*)malloc(sizeof(int)*dict->size);
+  dict->vals = NULL;
+  dict->maxVal = 0;
+  dict->next = dicts;
+  dicts = dict;
+  return dict;
+}
+
+void clearIcmDict(icmDictPo dict)
+{
+  int i;
+
+  for(i=0;i<dict->size;i++)
+    if(dict->keys[i]!=NULL){
+      free(dict->keys[i]);
+      dict->keys[i] = NULL;
+    }
+  dict->count = 0;
+
+  if(dict->vals!=NULL)
+    memset(dict->vals,0,sizeof(objPo)*dict->maxVal);
 }
 
-lblPo freeAllLabels(lblPo chain)
+void freeIcmDict(icmDictPo dict)
 {
-  while(chain!=NULL){
-    lblPo p = chain->prev;
-    
-    freePool(lblPool,chain);
-    chain = p;
+  icmDictPo *d = &dicts;
+
+  while(*d!=NULL){
+    if(*d==dict){
+      *d = dict->next;
+      break;
+    }
+    d = &(*d)->next;
   }
-  return NULL;
+
+  clearIcmDict(dict);
+  free(dict->keys);
+  free(dict->keyLens);
+  free(dict->ixs);
+  if(dict->vals!=NULL)
+    free(dict->vals);
+  free(dict);
+}
+
+int icmDictCount(icmDictPo dict)
+{
+  return dict->count;
+}
+
+/*
+ * Forget the keys given an index of count or more -- they were added by
+ * an encoding that was never sent. The rest are hashed again, so that
+ * no probe sequence is broken by the slots we empty.
+ */
+void truncIcmDict(icmDictPo dict,int count)
+{
+  unsigned char **oldKeys = dict->keys;
+  int *oldLens = dict->keyLens;
+  int *oldIxs = dict->ixs;
+  int i;
+
+  if(count>=dict->count)
+    return;
+
+  dict->keys = (unsigned char**)calloc(dict->size,sizeof(unsigned char*));
+  dict->keyLens = (int*)malloc(sizeof(int)*dict->size);
+  dict->ixs = (int*)malloc(sizeof(int)*dict->size);
+
+  for(i=0;i<dict->size;i++)
+    if(oldKeys[i]!=NULL){
+      if(oldIxs[i]>=count)
+	free(oldKeys[i]);
+      else{
+	unsigned long h = hashKey(oldKeys[i],oldLens[i],dict->size);
+
+	while(dict->keys[h]!=NULL)
+	  h = (h+1)&(dict->size-1);
+	dict->keys[h] = oldKeys[i];
+	dict->keyLens[h] = oldLens[i];
+	dict->ixs[h] = oldIxs[i];
+      }
+    }
+
+  dict->count = count;
+
+  free(oldKeys);
+  free(oldLens);
+  free(oldIxs);
+}
+
+int findDictKey(icmDictPo dict,unsigned char *key,int len)
+{
+  unsigned long h = hashKey(key,len,dict->size);
+
+  while(dict->keys[h]!=NULL){
+    if(dict->keyLens[h]==len && memcmp(dict->keys[h],key,len)==0)
+      return dict->ixs[h];
+    h = (h+1)&(dict->size-1);
+  }
+  return -1;
+}
+
+static void growDict(icmDictPo dict)
+{
+  int oldSize = dict->size;
+  unsigned char **oldKeys = dict->keys;
+  int *oldLens = dict->keyLens;
+  int *oldIxs = dict->ixs;
+  int i;
+
+  dict->size = oldSize<<1;
+  dict->keys = (unsigned char**)calloc(dict->size,sizeof(unsigned char*));
+  dict->keyLens = (int*)malloc(sizeof(int)*dict->size);
+  dict->ixs = (int*)malloc(sizeof(int)*dict->size);
+
+  for(i=0;i<oldSize;i++)
+    if(oldKeys[i]!=NULL){
+      unsigned long h = hashKey(oldKeys[i],oldLens[i],dict->size);
+
+      while(dict->keys[h]!=NULL)
+	h = (h+1)&(dict->size-1);
+      dict->keys[h] = oldKeys[i];
+      dict->keyLens[h] = oldLens[i];
+      dict->ixs[h] = oldIxs[i];
+    }
+
+  free(oldKeys);
+  free(oldLens);
+  free(oldIxs);
+}
+
+/* Give a new key the next index; the caller has checked it is not there */
+int addDictKey(icmDictPo dict,unsigned char *key,int len)
+{
+  unsigned long h;
+
+  if(dict->count>=ICMDICTMAX)
+    return -1;
+  else if(dict->count*2>=dict->size)
+    growDict(dict);
+
+  h = hashKey(key,len,dict->size);
+
+  while(dict->keys[h]!=NULL)
+    h = (h+1)&(dict->size-1);
+
+  dict->keys[h] = (unsigned char*)malloc(len);
+  memcpy(dict->keys[h],key,len);
+  dict->keyLens[h] = len;
+  dict->ixs[h] = dict->count;
+  return dict->count++;
+}
+
+objPo dictValue(icmDictPo dict,int ix)
+{
+  if(ix<0 || ix>=dict->maxVal)
+    return NULL;
+  else
+    return dict->vals[ix];
+}
+
+retCode setDictValue(icmDictPo dict,int ix,objPo val)
+{
+  if(ix<0 || ix>=ICMDICTMAX)
+    return Error;
+  else if(ix>=dict->maxVal){
+    int newmax = ix+(dict->maxVal>>1)+16;
+    objPo *newvals;
+
+    if(newmax>ICMDICTMAX)
+      newmax = ICMDICTMAX;
+
+    if((newvals=(objPo*)realloc(dict->vals,sizeof(objPo)*newmax))==NULL)
+      return Space;
+
+    memset(&newvals[dict->maxVal],0,sizeof(objPo)*(newmax-dict->maxVal));
+    dict->vals = newvals;
+    dict->maxVal = newmax;
+  }
+  dict->vals[ix] = val;
+  return Ok;
+}
+
+void scanIcmDicts(void)
+{
+  icmDictPo dict;
+  int i;
+
+  for(dict=dicts;dict!=NULL;dict=dict->next)
+    for(i=0;i<dict->maxVal;i++)
+      if(dict->vals[i]!=NULL)
+	dict->vals[i] = scanCell(dict->vals[i]);
+}
+
+void markIcmDicts(void)
+{
+  icmDictPo dict;
+  int i;
+
+  for(dict=dicts;dict!=NULL;dict=dict->next)
+    for(i=0;i<dict->maxVal;i++)
+      if(dict->vals[i]!=NULL)
+	markCell(dict->vals[i]);
+}
+
+void adjustIcmDicts(void)
+{
+  icmDictPo dict;
+  int i;
+
+  for(dict=dicts;dict!=NULL;dict=dict->next)
+    for(i=0;i<dict->maxVal;i++)
+      if(dict->vals[i]!=NULL)
+	dict->vals[i] = adjustCell(dict->vals[i]);
 }
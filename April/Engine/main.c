@@ -35,8 +35,11 @@
 #include "clock.h"
 #include "arith.h"
 #include "fileio.h"
+#include "term.h"
+#include "image.h"
 
 #include "process.h"
+#include "profile.h"
 #include "debug.h"
 
 logical debugging = False;	/* instruction tracing option */
@@ -69,7 +72,7 @@ int getOptions(int argc, char **argv)
   extern char *optarg;
   extern int optind;
 
-  while((opt=getopt(argc,argv, GNU_GETOPT_NOPERMUTE "I:i:d:b:g:vh:L:V"))>=0){
+  while((opt=getopt(argc,argv, GNU_GETOPT_NOPERMUTE "I:i:d:b:g:vh:z:L:VC:B:S:P:"))>=0){
     switch(opt){
     case 'd':{			/* turn on various debugging options */
       char *c = optarg;
@@ -285,10 +288,30 @@ int getOptions(int argc, char **argv)
       verifyCode = !verifyCode;
       break;
 
+    case 'C':			/* where to keep verified code digests */
+      verifyCacheFile = optarg;
+      break;
+
+    case 'B':			/* start from a boot image */
+      bootImageFile = optarg;
+      break;
+
+    case 'S':			/* save loaded code in an image */
+      saveImageFile = optarg;
+      break;
+
+    case 'P':			/* sample the cpu, write the profile here */
+      profileFile = optarg;
+      break;
+
     case 'h':			/* set up initial heap size */
       initHeapSize = atoi(optarg)*1024;
       break;
 
+    case 'z':			/* idle time before processes hibernate */
+      hibernateTime = atol(optarg);
+      break;
+
     default:
       return -1;
     }
@@ -318,7 +341,8 @@ int main(int argc, char **argv)
 
   if((narg=getOptions(argc,argv))<0){
     outMsg(logFile,"usage: %s [-I invocation] [-i thName] [-L dir]*"
-	   " [-g] [-D debugagent] [-v] [-h sizeK]"
+	   " [-g] [-D debugagent] [-v] [-h sizeK] [-z idleSecs] [-C cachefile]"
+	   " [-B image] [-S image] [-P profile]"
 	   " args ...\n",argv[0]);
     exit(1);
   }
@@ -334,6 +358,7 @@ int main(int argc, char **argv)
   init_args(argv,argc,narg);	/* Initialize the argument tuple */
   init_time();			/* Initialize time stuff */
   init_msgs();			/* Initialize message tables */
+  initImage();			/* Load the boot image */
   
 
   if(Invocation==NULL) {        /* compute a low-level name */
@@ -0,0 +1,297 @@
+/*
+  Memory mapped files -- read-only views of large files
+  (c) 1994-2002 Imperial College and F.G.McCabe
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+  Contact: Francis McCabe <fgm@fla.fujitsu.com>
+*/
+
+/*
+ * A mapped file is an opaque value that refers to a view -- a window onto
+ * a mapping. Slices share the mapping, which is unmapped when the last
+ * view dies. Only the regions actually converted to strings use the heap.
+ */
+
+#include "config.h"		/* pick up standard configuration header */
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "april.h"
+#include "process.h"
+#include "dict.h"
+#include "symbols.h"
+#include "astring.h"
+#include "fileio.h"
+
+#define MAP_OPAQUE 'M'
+
+typedef struct {
+  void *addr;			/* Where the file is mapped */
+  size_t len;			/* How long the mapping is */
+  int refs;			/* How many views share it */
+} MapRegion, *mapRegionPo;
+
+typedef struct {
+  mapRegionPo map;		/* The mapping we are a view of */
+  unsigned char *base;		/* Start of the view */
+  size_t len;			/* Length of the view */
+} MapView, *mapViewPo;
+
+static retCode mapOpaqueHdlr(opaqueEvalCode code,void *p,void *cd,void *cl);
+
+/* A new view of a mapping, or NULL if there is no room for one */
+static objPo newView(mapRegionPo map,unsigned char *base,size_t len)
+{
+  static logical registered = False;
+  mapViewPo v = (mapViewPo)malloc(sizeof(MapView));
+  objPo o;
+
+  if(v==NULL)
+    return NULL;
+
+  if(!registered){
+    registerOpaqueType(mapOpaqueHdlr,MAP_OPAQUE,NULL);
+    registered=True;
+  }
+
+  v->map = map;
+  v->base = base;
+  v->len = len;
+  map->refs++;
+
+  o = allocateOpaque(MAP_OPAQUE,(void*)v);
+  finaliseOnDeath(o);
+  return o;
+}
+
+static retCode mapOpaqueHdlr(opaqueEvalCode code,void *p,void *cd,void *cl)
+{
+  mapViewPo v = (mapViewPo)p;
+
+  switch(code){
+  case showOpaque:{
+    ioPo f = (ioPo)cd;
+    outMsg(f,"<<mapped %d bytes>>",v->len);
+    return Ok;
+  }
+  case finaliseOpaque:{
+    mapRegionPo map = v->map;
+
+    if(--map->refs==0){
+      if(map->addr!=NULL)
+	munmap(map->addr,map->len);
+      free(map);
+    }
+    free(v);
+    return Ok;
+  }
+  default:
+    return Error;
+  }
+}
+
+static logical isMapView(objPo o)
+{
+  return IsOpaque(o) && OpaqueType(o)==MAP_OPAQUE;
+}
+
+/* Check that off and len describe a region of a view */
+static logical mapRegion(mapViewPo v,objPo o,objPo l,size_t *off,size_t *len)
+{
+  if(!IsInteger(o) || !IsInteger(l) || IntVal(o)<0)
+    return False;
+
+  *off = IntVal(o);
+
+  if(*off>v->len)
+    return False;
+  else if(IntVal(l)<0 || *off+IntVal(l)>v->len)
+    *len = v->len-*off;		/* negative length means to the end */
+  else
+    *len = IntVal(l);
+  return True;
+}
+
+/* Convert a region of mapped bytes into a string */
+static objPo mapString(unsigned char *base,size_t len)
+{
+  uniChar buffer[MAX_SYMB_LEN];
+  uniChar *buff = (len<NumberOf(buffer)?buffer:(uniChar*)malloc(sizeof(uniChar)*(len+1)));
+  WORD32 ulen = utf8_uni(base,len,buff,len+1);
+  objPo str = allocateSubString(buff,ulen);
+
+  if(buff!=buffer)
+    free(buff);
+  return str;
+}
+
+/*
+ * mmap(url)
+ *
+ * map a local file into memory, read only
+ */
+retCode m_mmap(processpo p,objPo *args)
+{
+  if(!p->priveleged)
+    return liberror("__mmap",1,"permission denied",eprivileged);
+  else if(!isListOfChars(args[0]))
+    return liberror("__mmap",1,"argument should be a string",einval);
+  else{
+    WORD32 len = ListLen(args[0])+1;
+    uniChar url[len];
+    char fn[MAX_SYMB_LEN];
+    struct stat buf;
+    mapRegionPo map;
+    int fd;
+
+    StringText(args[0],url,len);
+
+    if(localFileName(aprilSysPath,url,fn,NumberOf(fn))!=Ok)
+      return liberror("__mmap",1,"not a local file",einval);
+    else if((fd=open(fn,O_RDONLY))<0)
+      return liberror("__mmap",1,"cant open file",efail);
+    else if(fstat(fd,&buf)!=0 || !S_ISREG(buf.st_mode)){
+      close(fd);
+      return liberror("__mmap",1,"not a plain file",efail);
+    }
+
+    if((map=(mapRegionPo)malloc(sizeof(MapRegion)))==NULL){
+      close(fd);
+      return liberror("__mmap",1,"out of memory",esystem);
+    }
+
+    map->len = buf.st_size;
+    map->refs = 0;
+
+    if(map->len==0)
+      map->addr = NULL;		/* cant map an empty file */
+    else if((map->addr=mmap(NULL,map->len,PROT_READ,MAP_SHARED,fd,0))==MAP_FAILED){
+      close(fd);
+      free(map);
+      return liberror("__mmap",1,"cant map file",esystem);
+    }
+
+    close(fd);			/* the mapping keeps the file */
+
+    if((args[0]=newView(map,(unsigned char*)map->addr,map->len))==NULL){
+      if(map->addr!=NULL)
+	munmap(map->addr,map->len);
+      free(map);
+      return liberror("__mmap",1,"out of memory",esystem);
+    }
+    return Ok;
+  }
+}
+
+/*
+ * mmap_size(map)
+ */
+retCode m_mmap_size(processpo p,objPo *args)
+{
+  if(!isMapView(args[0]))
+    return liberror("__mmap_size",1,"argument should be a mapped file",einval);
+  else{
+    args[0] = allocateInteger(((mapViewPo)OpaqueVal(args[0]))->len);
+    return Ok;
+  }
+}
+
+/*
+ * mmap_slice(map,offset,length)
+ *
+ * a new view on part of a mapped file, sharing the mapping
+ */
+retCode m_mmap_slice(processpo p,objPo *args)
+{
+  if(!isMapView(args[2]))
+    return liberror("__mmap_slice",3,"argument should be a mapped file",einval);
+  else{
+    mapViewPo v = (mapViewPo)OpaqueVal(args[2]);
+    size_t off,len;
+
+    if(!mapRegion(v,args[1],args[0],&off,&len))
+      return liberror("__mmap_slice",3,"invalid region",einval);
+
+    if((args[2]=newView(v->map,v->base+off,len))==NULL)
+      return liberror("__mmap_slice",3,"out of memory",esystem);
+    return Ok;
+  }
+}
+
+/*
+ * mmap_string(map,offset,length)
+ *
+ * convert a region of a mapped file into a string
+ */
+retCode m_mmap_string(processpo p,objPo *args)
+{
+  if(!isMapView(args[2]))
+    return liberror("__mmap_string",3,"argument should be a mapped file",einval);
+  else{
+    mapViewPo v = (mapViewPo)OpaqueVal(args[2]);
+    size_t off,len;
+
+    if(!mapRegion(v,args[1],args[0],&off,&len))
+      return liberror("__mmap_string",3,"invalid region",einval);
+
+    args[2] = mapString(v->base+off,len);
+    return Ok;
+  }
+}
+
+/*
+ * mmap_line(map,offset)
+ *
+ * return the line starting at offset, and the offset of the next line
+ */
+retCode m_mmap_line(processpo p,objPo *args)
+{
+  if(!isMapView(args[1]))
+    return liberror("__mmap_line",2,"argument should be a mapped file",einval);
+  else if(!IsInteger(args[0]) || IntVal(args[0])<0)
+    return liberror("__mmap_line",2,"offset should be a positive integer",einval);
+  else{
+    mapViewPo v = (mapViewPo)OpaqueVal(args[1]);
+    size_t off = IntVal(args[0]);
+
+    if(off>=v->len)
+      return liberror("__mmap_line",2,"end of file",eeof);
+    else{
+      unsigned char *line = v->base+off;
+      unsigned char *nl = (unsigned char*)memchr(line,'\n',v->len-off);
+      size_t len = (nl!=NULL?nl-line:v->len-off);
+      objPo str = mapString(line,len);
+      objPo nxt = kvoid;
+      void *root = gcAddRoot(&str);
+
+      gcAddRoot(&nxt);
+
+      nxt = allocateInteger(off+len+(nl!=NULL?1:0));
+
+      args[1] = allocateTuple(2);
+      updateTuple(args[1],0,str);
+      updateTuple(args[1],1,nxt);
+
+      gcRemoveRoot(root);
+      return Ok;
+    }
+  }
+}
@@ -31,6 +31,7 @@
 #include "dict.h"
 #include "symbols.h"
 #include "msg.h"
+#include "transport.h"
 #include "astring.h"		/* String handling interface */
 #include "debug.h"
 #include "std-types.h"
@@ -44,6 +45,13 @@ logical traceMessage = False;	/* message tracing  */
 
 poolPo msg_pool;		/* pool of message records */
 
+static msgpo leaseQ = NULL;	/* leased messages, earliest deadline first */
+static msgpo leaseBack = NULL;
+static logical leasesDue = False; /* has the lease alarm gone off? */
+
+static long localSends = 0;	/* engine-wide message counts */
+static long remoteSends = 0;
+
 void init_msgs(void)
 {
   msg_pool = newPool(sizeof(struct msg_rec),MAXMSG); /* make a message pool */
@@ -92,16 +100,25 @@ retCode sendAmsg(objPo to,objPo msg,objPo sender,objPo opts)
 {
   processpo p;
   processpo mailer;
+  retCode ret;
 
   /* is this to be handled locally? */
   if(to==knullhandle)
     return Ok;
-  else if((p=handleProc(to))!=NULL)
+  else if((p=handleProc(to))!=NULL){
+    localSends++;
     LocalMsg(p,msg,sender,opts);
+  }
+  else if((ret=transportSend(to,sender,opts,msg))==Ok)
+    remoteSends++;		/* sent directly to the remote engine */
+  else if(ret==Error)
+    return Error;		/* it cannot be encoded */
   else if((mailer=current_process->mailer)!=NULL){
     void *root = gcAddRoot(&msg);
     objPo m;
 
+    remoteSends++;
+
     gcAddRoot(&opts);
     gcAddRoot(&sender);
     gcAddRoot(&to);
@@ -124,6 +141,77 @@ retCode sendAmsg(objPo to,objPo msg,objPo sender,objPo opts)
   return Switch;		/* Try to switch to the recipient */
 }
 
+static void wakeSender(processpo p);
+
+/*
+ * Mailbox statistics. Each message records when it was queued; when it is
+ * received the time it spent waiting is added to a histogram whose
+ * buckets double in width. A receive that finds no pattern to match puts
+ * the message back at once; that undoes its count, and it keeps the time
+ * it was first queued.
+ */
+static void noteQueued(processpo p,msgpo m)
+{
+  gettimeofday(&m->queued,NULL);
+
+  if(++p->mcount>p->mstats.maxDepth)
+    p->mstats.maxDepth = p->mcount;
+}
+
+static void noteReceived(processpo p,msgpo m)
+{
+  struct timeval now;
+  long usecs;
+  int i = 0;
+
+  gettimeofday(&now,NULL);
+
+  usecs = (now.tv_sec-m->queued.tv_sec)*1000000+(now.tv_usec-m->queued.tv_usec);
+
+  while(usecs>=16 && i<MSGLATENCIES-1){ /* first bucket is under 16 usecs */
+    usecs >>= 1;
+    i++;
+  }
+
+  p->mstats.received++;
+  p->mstats.latency[i]++;
+
+  p->mstats.taken = True;
+  p->mstats.takenSeq = m->sequence;
+  p->mstats.takenQueued = m->queued;
+  p->mstats.takenBucket = i;
+}
+
+static void noteReplaced(processpo p,msgpo m)
+{
+  noteQueued(p,m);
+
+  if(p->mstats.taken && p->mstats.takenSeq==m->sequence){
+    p->mstats.received--;	/* it was not consumed after all */
+    p->mstats.latency[p->mstats.takenBucket]--;
+    m->queued = p->mstats.takenQueued;
+  }
+  p->mstats.taken = False;
+}
+
+/* lower bound of a latency bucket, in usecs */
+static long latencyBucket(int i)
+{
+  return i==0?0:8l<<i;
+}
+
+void displayMsgStats(processpo p)
+{
+  int i;
+
+  outMsg(logFile,"  %ld received, %ld queued, %ld max queued\n",
+	 p->mstats.received,p->mcount,p->mstats.maxDepth);
+
+  for(i=0;i<MSGLATENCIES;i++)
+    if(p->mstats.latency[i]!=0)
+      outMsg(logFile,"  >=%ldus: %ld\n",latencyBucket(i),p->mstats.latency[i]);
+}
+
 static void leaseExpireAck(processpo p,objPo sender,objPo receipt)
 {
   void *root = gcAddRoot(&receipt);
@@ -151,6 +239,96 @@ static void leaseExpireAck(processpo p,objPo sender,objPo receipt)
   gcRemoveRoot(root);
 }
 
+/*
+ * The lease index keeps leased messages in order of their deadline. A
+ * single engine timer is set for the earliest deadline; when it goes off
+ * the expired messages are discarded at the next safe point, so that the
+ * receive escapes never need to look at the clock.
+ */
+static void leaseAlarm(processpo p,void *cl)
+{
+  leasesDue = True;
+}
+
+static void setLeaseAlarm(void)
+{
+  flush_timer(leaseAlarm,NULL);
+
+  if(leaseQ!=NULL){		/* a lease runs out once its second has passed */
+    if(set_alarm(NULL,(Number)(leaseQ->lease+1),leaseAlarm,NULL)!=Suspend)
+      leasesDue = True;
+  }
+}
+
+static void addLease(msgpo m)
+{
+  msgpo l = leaseBack;
+
+  while(l!=NULL && l->lease>m->lease)
+    l = l->lprev;
+
+  m->lprev = l;
+  if(l!=NULL){
+    m->lnext = l->lnext;
+    l->lnext = m;
+  }
+  else{
+    m->lnext = leaseQ;
+    leaseQ = m;
+  }
+
+  if(m->lnext!=NULL)
+    m->lnext->lprev = m;
+  else
+    leaseBack = m;
+
+  if(leaseQ==m)			/* a new earliest deadline */
+    setLeaseAlarm();
+}
+
+static void removeLease(msgpo m)
+{
+  if(m->lprev!=NULL)
+    m->lprev->lnext = m->lnext;
+  else
+    leaseQ = m->lnext;
+
+  if(m->lnext!=NULL)
+    m->lnext->lprev = m->lprev;
+  else
+    leaseBack = m->lprev;
+}
+
+/* Called from the scheduler, at a point where it is safe to allocate */
+void expireLeases(void)
+{
+  if(leasesDue){
+    time_t now = time(NULL);
+
+    leasesDue = False;
+
+    while(leaseQ!=NULL && leaseQ->lease<now){
+      msgpo m = leaseQ;
+      processpo p = m->to;
+      objPo sender = m->sender;
+      objPo receipt = receiptRequest(m->opts);
+
+#ifdef MSGTRACE
+      if(traceMessage)
+	outMsg(logFile,"Discarding out of date msg  `%.4w' from %#w\n",
+	       m->msg,m->sender);
+#endif
+
+      free_msg(p,m);
+
+      if(receipt!=NULL)
+	leaseExpireAck(p,sender,receipt);
+    }
+
+    setLeaseAlarm();
+  }
+}
+
 void LocalMsg(processpo p,objPo msg,objPo sender,objPo opts)
 {
   sigset_t blocked = stopInterrupts();  /* prevent interrupts now */
@@ -191,6 +369,11 @@ void LocalMsg(processpo p,objPo msg,objPo sender,objPo opts)
       m->next = NULL;
       m->sequence = ++p->sequence; /* set sequence number of this message */
 
+      if(lease!=(time_t)0)
+	addLease(m);
+
+      noteQueued(p,m);
+
       if(p->mback) {
 	p->mback->next = m;
 	m->prev = p->mback;
@@ -220,6 +403,83 @@ void LocalMsg(processpo p,objPo msg,objPo sender,objPo opts)
   startInterrupts(blocked);		/* re-anable interrupts */
 }
 
+/*
+ * Bounded mailboxes. A sender that finds the mailbox full is dealt with
+ * according to the recipient's policy: it is suspended until there is
+ * room, the oldest waiting message is dropped, the new message is
+ * dropped, or the send fails. Messages generated by the engine itself,
+ * such as receipts, are not subject to the capacity.
+ */
+static void wakeSender(processpo p)
+{
+  processpo s = p->mblocked;
+
+  if(s!=NULL && (p->mcapacity==0 || p->mcount<p->mcapacity)){
+    p->mblocked = s->mblockNext;
+    s->mblockNext = NULL;
+    s->mwaitOn = NULL;
+
+    if(s->state==wait_mailbox)
+      add_to_run_q(s,False);
+  }
+}
+
+/* A blocked sender is going away */
+void cancelMailboxWait(processpo p)
+{
+  processpo to = p->mwaitOn;
+
+  if(to!=NULL){
+    processpo *s = &to->mblocked;
+
+    while(*s!=NULL){
+      if(*s==p){
+	*s = p->mblockNext;
+	break;
+      }
+      else
+	s = &(*s)->mblockNext;
+    }
+    p->mblockNext = NULL;
+    p->mwaitOn = NULL;
+  }
+}
+
+static retCode mailboxRoom(processpo p,objPo to)
+{
+  processpo P = handleProc(to);
+
+  if(P==NULL && (P=p->mailer)==NULL)
+    return Ok;			/* let sendAmsg sort it out */
+  else if(P->mcapacity==0 || P->mcount<P->mcapacity || P==p)
+    return Ok;
+  else{
+    switch(P->mpolicy){
+    case mailDropOldest:
+      free_msg(P,P->mfront);
+      return Ok;
+    case mailDropNewest:
+      return Fail;
+    case mailError:
+      return Error;
+    case mailBlock:
+    default:{
+      processpo *s = &P->mblocked;
+
+      while(*s!=NULL)		/* senders are woken in the order they blocked */
+	s = &(*s)->mblockNext;
+      *s = p;
+      p->mwaitOn = P;
+      p->mblockNext = NULL;
+
+      p->pc--;			/* try the send again when there is room */
+      ps_suspend(p,wait_mailbox);
+      return Suspend;
+    }
+    }
+  }
+}
+
 /* Basic message escape */
 retCode m_send(processpo p,objPo *args)
 {
@@ -230,11 +490,24 @@ retCode m_send(processpo p,objPo *args)
   if(!IsHandle(to))
     return liberror("_send",3,"argument should be a handle",einval);
 
+  switch(mailboxRoom(p,to)){
+  case Ok:
+    break;
+  case Suspend:
+    return Suspend;
+  case Error:
+    return liberror("_send",3,"mailbox full",efail);
+  default:
+    return Ok;			/* the message is dropped */
+  }
+
   switch(sendAmsg(to,msg,current_process->handle,opts)){
   case Switch:
     return Switch;
   case Space:
     return liberror("_send",3,"out of heap space",esystem);
+  case Error:
+    return liberror("_send",3,"message cannot be sent",efail);
   default:
     return Ok;
   }
@@ -255,6 +528,17 @@ retCode m_send2(processpo p,objPo *args)
   if(!p->priveleged)
     return liberror("__send",4,"permission denied",eprivileged);
 
+  switch(mailboxRoom(p,to)){
+  case Ok:
+    break;
+  case Suspend:
+    return Suspend;
+  case Error:
+    return liberror("__send",4,"mailbox full",efail);
+  default:
+    return Ok;			/* the message is dropped */
+  }
+
   switch(sendAmsg(to,msg,sender,opts)){
   case Switch:
     return Switch;
@@ -263,10 +547,116 @@ retCode m_send2(processpo p,objPo *args)
   case Ok:
     return Ok;
   default:
-    return Error;
+    return liberror("__send",4,"message cannot be sent",efail);
   }
 }
 
+/*
+ * A multicast never blocks the sender; a full mailbox either makes room,
+ * refuses the message, or -- if its owner asked for senders to block --
+ * takes it beyond its bound.
+ */
+static logical mailboxAccepts(processpo P)
+{
+  if(P->mcapacity==0 || P->mcount<P->mcapacity)
+    return True;
+  else{
+    switch(P->mpolicy){
+    case mailDropOldest:
+      free_msg(P,P->mfront);
+      return True;
+    case mailBlock:
+      return True;
+    default:
+      return False;
+    }
+  }
+}
+
+/*
+ * _multicast(handles,opts,msg)
+ *
+ * deliver one message to many recipients in a single pass. Local
+ * recipients share the message; remote recipients are collected into a
+ * single envelope for the mailer, which is of the form
+ * (handle[],handle,msgAttr[],any)
+ */
+retCode m_multicast(processpo p,objPo *args)
+{
+  objPo to = args[2];
+  objPo opts = args[1];
+  objPo msg = args[0];
+  objPo sender = p->handle;
+  objPo remote = emptyList;
+  objPo h = kvoid;
+  logical unsent = False;
+  void *root;
+  retCode ret;
+
+  while(isNonEmptyList(to)){
+    if(!IsHandle(ListHead(to)))
+      return liberror("_multicast",3,"argument should be a list of handles",einval);
+    to = ListTail(to);
+  }
+
+  if(to!=emptyList)
+    return liberror("_multicast",3,"argument should be a list of handles",einval);
+
+  to = args[2];
+  root = gcAddRoot(&to);
+  gcAddRoot(&opts);
+  gcAddRoot(&msg);
+  gcAddRoot(&sender);
+  gcAddRoot(&remote);
+  gcAddRoot(&h);
+
+  while(to!=emptyList){
+    processpo P;
+
+    h = ListHead(to);
+
+    if(h==knullhandle)
+      ;
+    else if((P=handleProc(h))!=NULL){
+      if(mailboxAccepts(P)){
+	LocalMsg(P,msg,sender,opts);
+	localSends++;		/* only count what was delivered */
+      }
+    }
+    else if((ret=transportSend(h,sender,opts,msg))==Ok)
+      remoteSends++;
+    else if(ret==Error)
+      unsent = True;		/* the others still get it */
+    else if(p->mailer!=NULL){
+      remoteSends++;
+      remote = allocatePair(&h,&remote);
+    }
+
+    to = ListTail(to);
+  }
+
+  if(remote!=emptyList){	/* one envelope for all the remote recipients */
+    objPo m = allocateTuple(4);
+
+    gcAddRoot(&m);
+
+    updateTuple(m,0,remote);
+    updateTuple(m,1,sender);
+    updateTuple(m,2,opts);
+    updateTuple(m,3,msg);
+
+    m = allocateAny(&mcastTp,&m);
+
+    LocalMsg(p->mailer,m,sender,emptyList);
+  }
+
+  gcRemoveRoot(root);
+
+  if(unsent)
+    return liberror("_multicast",3,"message cannot be sent",efail);
+  return Ok;
+}
+
 retCode m_front_msg(processpo p,objPo *args)
 {
   objPo msg = args[2];
@@ -287,6 +677,8 @@ retCode m_front_msg(processpo p,objPo *args)
 	     msg,p->handle);
 #endif
 
+    p->mcursor = NULL;		/* the cursor has not seen this one */
+
     m->to = p;			/* this message is being sent to ourselves */
     m->sender = sender;
     m->opts = opts;
@@ -295,9 +687,15 @@ retCode m_front_msg(processpo p,objPo *args)
     m->next = NULL;
     m->prev = NULL;
 
+    if(m->lease!=(time_t)0)
+      addLease(m);
+
+    noteQueued(p,m);
+
     if(p->mfront!=NULL){
       m->sequence = p->mfront->sequence-1; /* Fake the sequence number ... */
       m->next = p->mfront;
+      p->mfront->prev = m;
       p->mfront = m;
     }
     else{
@@ -314,27 +712,10 @@ retCode m_getmsg(processpo p,objPo *args)
 {
   integer msgNo = IntVal(args[0]);
   msgpo msg = p->mfront; /* Start by looking at the message Q */
-  time_t now = time(NULL);
 
   while(msg!=NULL){
     if(msg->sequence<=msgNo)
       msg = msg->next;
-    else if(msg->lease!=(time_t)0 && msg->lease<now){
-      msgpo next = msg->next;
-      objPo receipt = receiptRequest(msg->opts);
-
-#ifdef MSGTRACE
-      if(traceMessage)
-	outMsg(logFile,"Discarding out of date msg  `%.4w' from %#w\n",
-	       msg->msg,msg->sender);
-#endif
-
-      if(receipt!=NULL)
-	leaseExpireAck(p,msg->sender,receipt);
-
-      free_msg(p,msg);
-      msg = next;
-    }
     else
       break;
   }
@@ -354,6 +735,7 @@ retCode m_getmsg(processpo p,objPo *args)
     updateTuple(args[0],4,seq);
 
     gcRemoveRoot(root);
+    noteReceived(p,msg);
     free_msg(p,msg);
     return Ok;
   }
@@ -367,27 +749,10 @@ retCode m_nextmsg(processpo p,objPo *args)
 {
   integer msgNo = IntVal(args[0]);
   msgpo msg = p->mfront; /* Start by looking at the message Q */
-  time_t now = time(NULL);
 
   while(msg!=NULL){
     if(msg->sequence<=msgNo)
       msg = msg->next;
-    else if(msg->lease!=(time_t)0 && msg->lease<now){
-      msgpo next = msg->next;
-      objPo receipt = receiptRequest(msg->opts);
-
-#ifdef MSGTRACE
-      if(traceMessage)
-	outMsg(logFile,"Discarding out of date msg  `%.4w' from %#w\n",
-	       msg->msg,msg->sender);
-#endif
-
-      if(receipt!=NULL)
-	leaseExpireAck(p,msg->sender,receipt);
-
-      free_msg(p,msg);
-      msg = next;
-    }
     else
       break;
   }
@@ -409,6 +774,105 @@ retCode m_nextmsg(processpo p,objPo *args)
 
     gcRemoveRoot(root);
 
+    noteReceived(p,msg);
+    free_msg(p,msg);
+    return Ok;
+  }
+  else{				/* no messages ... */
+    p->pc--;
+    ps_suspend(p,wait_msg);
+    return Suspend;		/* suspend for a message receive */
+  }
+}
+
+/*
+ * Does a message pass a receive filter? The filter lists the constructor
+ * symbols and tuple arities of the receive's patterns; anything else in
+ * the filter lets every message through.
+ */
+static logical msgMatches(objPo msg,objPo filter)
+{
+  objPo data;
+
+  if(!isNonEmptyList(filter) || !IsAny(msg))
+    return True;
+
+  data = AnyData(msg);
+
+  while(isNonEmptyList(filter)){
+    objPo key = ListHead(filter);
+
+    if(IsAny(key))
+      key = AnyData(key);
+
+    if(isSymb(key)){
+      if(data==key || (isCons(data) && consFn(data)==key))
+	return True;
+    }
+    else if(IsInteger(key)){
+      if(IsTuple(data) && tupleArity(data)==IntVal(key))
+	return True;
+    }
+    else
+      return True;		/* a wild card */
+
+    filter = ListTail(filter);
+  }
+  return False;
+}
+
+/*
+ * Selective receive: get the next message that passes the filter,
+ * suspending if there is none. Messages that do not pass are left where
+ * they are, and a cursor remembers how far we got so that when we are
+ * woken up only the new arrivals are looked at.
+ */
+static msgpo selectMsg(processpo p,integer msgNo,objPo filter)
+{
+  msgpo msg;
+
+  if(p->mcursor!=NULL && p->mcursorSeq==msgNo)
+    msg = p->mcursor->next;	/* carry on from where we left off */
+  else
+    msg = p->mfront;
+
+  while(msg!=NULL){
+    if(msg->sequence<=msgNo)
+      msg = msg->next;
+    else if(!msgMatches(msg->msg,filter)){
+      p->mcursor = msg;
+      p->mcursorSeq = msgNo;
+      msg = msg->next;
+    }
+    else
+      break;
+  }
+  return msg;
+}
+
+retCode m_selectmsg(processpo p,objPo *args)
+{
+  msgpo msg = selectMsg(p,IntVal(args[1]),args[0]);
+
+  if(msg!=NULL){		/* set up the return tuple for this message */
+    objPo reply = replyHandle(msg->opts,msg->sender);
+    void *root = gcAddRoot(&reply);
+    objPo seq = allocateInteger(msg->sequence);
+
+    gcAddRoot(&seq);
+
+    args[1] = allocateTuple(5);
+
+    updateTuple(args[1],0,msg->msg);	/* construct the result structure */
+    updateTuple(args[1],1,msg->sender);
+    updateTuple(args[1],2,reply);
+    updateTuple(args[1],3,msg->opts);
+    updateTuple(args[1],4,seq);
+
+    gcRemoveRoot(root);
+
+    p->mcursor = NULL;
+    noteReceived(p,msg);
     free_msg(p,msg);
     return Ok;
   }
@@ -429,22 +893,10 @@ retCode m_waitmsg(processpo p,objPo *args)
 {
   integer msgNo = IntVal(args[1]);
   msgpo msg = p->mfront;	/* Start by looking at the message Q */
-  time_t now = time(NULL);
 
   while(msg!=NULL){
     if(msg->sequence<=msgNo)
       msg = msg->next;
-    else if(msg->lease!=(time_t)0 && msg->lease<now){
-      msgpo next = msg->next;
-
-#ifdef MSGTRACE
-    if(traceMessage)
-      outMsg(logFile,"Discarding out of date msg  `%.4w' from %#w\n",
-	     msg->msg,msg->sender);
-#endif
-      free_msg(p,msg);
-      msg = next;
-    }
     else
       break;
   }
@@ -464,6 +916,7 @@ retCode m_waitmsg(processpo p,objPo *args)
     updateTuple(args[1],3,msg->opts);
     updateTuple(args[1],4,seq);
 
+    noteReceived(p,msg);
     free_msg(p,msg);
 
     gcRemoveRoot(root);
@@ -493,6 +946,57 @@ retCode m_waitmsg(processpo p,objPo *args)
   }
 }
 
+/* Selective receive with a time limit */
+retCode m_selectwait(processpo p,objPo *args)
+{
+  msgpo msg = selectMsg(p,IntVal(args[2]),args[1]);
+
+  if(msg!=NULL){		/* set up the return tuple for this message */
+    objPo reply = replyHandle(msg->opts,msg->sender);
+    void *root = gcAddRoot(&reply);
+    objPo seq = allocateInteger(msg->sequence);
+
+    gcAddRoot(&seq);
+
+    args[2] = allocateTuple(5);
+
+    updateTuple(args[2],0,msg->msg);	/* construct the result structure */
+    updateTuple(args[2],1,msg->sender);
+    updateTuple(args[2],2,reply);
+    updateTuple(args[2],3,msg->opts);
+    updateTuple(args[2],4,seq);
+
+    gcRemoveRoot(root);
+
+    p->mcursor = NULL;
+    noteReceived(p,msg);
+    free_msg(p,msg);
+    return Ok;
+  }
+  else{				/* nothing that passes ... check the timeout */
+    Number timeout;
+    if(IsInteger(args[0]))
+      timeout=(Number)IntVal(args[0]);
+    else
+      timeout=FloatVal(args[0]);
+
+    switch(set_alarm(p,timeout,wakeMeUp,NULL)){
+    case Ok:                          /* already fired ... raise an exception */
+      p->errval=ktimedout;
+      return Error;
+    case Space:
+      return liberror("__selectwait",3,"out of space",esystem);
+    case Suspend:
+      p->pc--;
+      ps_suspend(p,wait_msg);
+      return Suspend;                   /* suspend for a message receive */
+    default:
+      p->errval=kfailed;
+      return Error;                     /* shouldnt happen */
+    }
+  }
+}
+
 retCode m_replacemsg(processpo p,objPo *args)
 {
   sigset_t blocked = stopInterrupts();  /* prevent interrupts now */
@@ -516,8 +1020,7 @@ retCode m_replacemsg(processpo p,objPo *args)
       if(receipt!=NULL)		/* acknowledge discarding of old message */
 	leaseExpireAck(p,sender,receipt);
     }
-
-    {
+    else{
       register msgpo m = (msgpo)allocPool(msg_pool);
       msgpo mp = p->mfront;
 
@@ -537,6 +1040,8 @@ retCode m_replacemsg(processpo p,objPo *args)
       m->next = NULL;
       m->sequence = msgNo;
 
+      p->mcursor = NULL;	/* it may land behind the cursor */
+
       while(mp!=NULL && mp->sequence<msgNo)
 	mp=mp->next;
 
@@ -560,6 +1065,11 @@ retCode m_replacemsg(processpo p,objPo *args)
 	  p->mfront = p->mback = m;
 	}
       }
+
+      if(lease!=(time_t)0)
+	addLease(m);
+
+      noteReplaced(p,m);
     }
   }
 
@@ -572,6 +1082,12 @@ retCode m_replacemsg(processpo p,objPo *args)
  */
 void free_msg(processpo p,msgpo m)
 {
+  if(m->lease!=(time_t)0)
+    removeLease(m);
+
+  if(p->mcursor==m)
+    p->mcursor = m->prev;	/* everything before it has been seen */
+
   if (m->prev == NULL)
     p->mfront = m->next;
   else m->prev->next = m->next;
@@ -582,19 +1098,15 @@ void free_msg(processpo p,msgpo m)
 
   /* add back to message pool */
   freePool(msg_pool,(void*)m);
+
+  p->mcount--;
+  wakeSender(p);		/* there may be room for a blocked sender */
 }
 
 /* count the number of messages waiting at a process */
 int msgcount(processpo p)
 {
-  register msgpo m = p->mfront;
-  register int cnt = 0;
-
-  while(m){
-    cnt++;
-    m = m->next;
-  }
-  return(cnt);
+  return p->mcount;
 }
 
 /*
@@ -606,9 +1118,17 @@ void discard_msgs(processpo p)
 
   while(m!=NULL){
     void *r = (void*)m;
+
+    if(m->lease!=(time_t)0)
+      removeLease(m);
     m=m->next;
     freePool(msg_pool,r);
   }
+
+  p->mcount = 0;
+
+  while(p->mblocked!=NULL)	/* let the senders find out we have gone */
+    wakeSender(p);
 }
 
 #ifdef MSGTRACE
@@ -620,6 +1140,7 @@ static void print_proc_msgs(processpo p,void *c)
     struct msg_rec *m=p->mfront;
     
     outMsg(logFile,"Messages waiting for [%w]\n",p->handle);
+    displayMsgStats(p);
 
     while(m){
       outMsg(logFile,"Message from %w[%w]: `%.5w'\n",
@@ -632,7 +1153,8 @@ static void print_proc_msgs(processpo p,void *c)
 /* print all the messages that are outstanding for each process */
 void printMessages(void)
 {
-  outMsg(logFile,"Printing out messages\n");
+  outMsg(logFile,"Printing out messages, %ld local and %ld remote sends\n",
+	 localSends,remoteSends);
   processProcesses(print_proc_msgs,NULL);
 }
 
@@ -670,3 +1192,85 @@ retCode m_set_mailer(processpo p,objPo *args) /* set name of the mailer process
   return Ok;
 }
 
+/*
+ * _mailbox(capacity,policy)
+ *
+ * bound our mailbox; policy is one of block, drop_oldest, drop_newest or
+ * error. A capacity of zero removes the bound.
+ */
+retCode m_mailbox(processpo p,objPo *args)
+{
+  objPo cap = args[1];
+  objPo pol = args[0];
+
+  if(!IsInteger(cap) || IntVal(cap)<0)
+    return liberror("_mailbox",2,"capacity should be a non-negative integer",einval);
+  else if(!isSymb(pol))
+    return liberror("_mailbox",2,"policy should be a symbol",einval);
+  else{
+    uniChar *policy = SymText(pol);
+
+    if(uniIsLit(policy,"block"))
+      p->mpolicy = mailBlock;
+    else if(uniIsLit(policy,"drop_oldest"))
+      p->mpolicy = mailDropOldest;
+    else if(uniIsLit(policy,"drop_newest"))
+      p->mpolicy = mailDropNewest;
+    else if(uniIsLit(policy,"error"))
+      p->mpolicy = mailError;
+    else
+      return liberror("_mailbox",2,"unknown mailbox policy",einval);
+
+    p->mcapacity = IntVal(cap);
+
+    while(p->mblocked!=NULL && (p->mcapacity==0 || p->mcount<p->mcapacity))
+      wakeSender(p);		/* the mailbox may have grown */
+    return Ok;
+  }
+}
+
+
+/*
+ * _msg_stats(h)
+ *
+ * (received,queued,max queued,latency histogram,local sends,remote sends)
+ * for process h; the last two are totals for the engine
+ */
+retCode m_msg_stats(processpo p,objPo *args)
+{
+  processpo P;
+
+  if(!IsHandle(args[0]) || (P=handleProc(args[0]))==NULL)
+    return liberror("_msg_stats",1,"argument should be a local handle",einval);
+  else{
+    objPo stats = allocateTuple(6);
+    void *root = gcAddRoot(&stats);
+    objPo hist = emptyList;
+    objPo el = kvoid;
+    int i;
+
+    gcAddRoot(&hist);
+    gcAddRoot(&el);
+
+    for(i=MSGLATENCIES-1;i>=0;i--){
+      el = allocateInteger(P->mstats.latency[i]);
+      hist = allocatePair(&el,&hist);
+    }
+
+    el = allocateInteger(P->mstats.received);
+    updateTuple(stats,0,el);
+    el = allocateInteger(P->mcount);
+    updateTuple(stats,1,el);
+    el = allocateInteger(P->mstats.maxDepth);
+    updateTuple(stats,2,el);
+    updateTuple(stats,3,hist);
+    el = allocateInteger(localSends);
+    updateTuple(stats,4,el);
+    el = allocateInteger(remoteSends);
+    updateTuple(stats,5,el);
+
+    args[0] = stats;
+    gcRemoveRoot(root);
+    return Ok;
+  }
+}
@@ -49,5 +49,47 @@ retCode displayOpaque(ioPo f,opaquePo p)
   return hdlrs[type].h(showOpaque,OpaqueVal(p),f,hdlrs[type].cl);
 }
 
+/* Opaque values that want to be told when they are garbage */
+static objPo *finals = NULL;
+static integer finalCount = 0;
+static integer finalSize = 0;
+
+void finaliseOnDeath(objPo o)
+{
+  assert(IsOpaque(o));
+
+  if(finalCount>=finalSize){
+    finalSize = finalSize+(finalSize>>1)+16;
+    finals = (objPo*)realloc(finals,sizeof(objPo)*finalSize);
+
+    if(finals==NULL)
+      syserr("no space for finalisers");
+  }
+  finals[finalCount++] = o;
+}
+
+/*
+ * Called by the garbage collector -- alive returns the new location of a
+ * surviving value or NULL if it is dead. The dead cell is still intact.
+ */
+void sweepOpaques(objPo (*alive)(objPo o))
+{
+  integer i,j;
+
+  for(i=j=0;i<finalCount;i++){
+    objPo o = finals[i];
+    objPo n = alive(o);
+
+    if(n!=NULL)
+      finals[j++] = n;
+    else{
+      short int type = OpaqueType(o);
+
+      hdlrs[type].h(finaliseOpaque,OpaqueVal(o),NULL,hdlrs[type].cl);
+    }
+  }
+  finalCount = j;
+}
+
 
 
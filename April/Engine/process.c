@@ -24,6 +24,7 @@
 #include <signal.h>
 #include <unistd.h>
 #include <limits.h>
+#include <time.h>
 
 #include <string.h>
 #include <assert.h>
@@ -39,6 +40,7 @@
 #include "opcodes.h"
 #include "hash.h"		/* access the hash functions */
 #include "std-types.h"
+#include "async.h"
 
 poolPo proc_pool=NULL;		/* pool of process records */
 
@@ -48,6 +50,9 @@ processpo rootProcess = NULL;
 
 static WORD32 processno = 0;      /* This counts the total number of processes */
 
+long hibernateTime = 0;		/* Seconds in wait_msg before hibernating, 0 = never */
+static processpo freezing = NULL; /* process being hibernated */
+
 #ifdef RESTRACE
 logical traceResource = False;
 #endif
@@ -67,10 +72,12 @@ static processpo fork_process(uniChar *tgt,objPo name,
 			      objPo code,logical priv,
 			      objPo *creator,objPo *filer,
 			      processpo mailer,objPo clicks);
+static void releaseStack(objPo *stack,WORD32 size);
 
 static const char* state_names[] = {"quiescent", "runnable",
 				    "wait_io", "wait_msg",
-				    "wait_timer", 
+				    "wait_timer", "wait_lock", "wait_child",
+				    "wait_mailbox",
 				    "dead"};
 
 
@@ -99,6 +106,7 @@ static objPo buildEnv(insPo cd,WORD32 cdlen,WORD32 litcnt,WORD32 frcount)
     pc->litcnt = litcnt;
     
     memcpy(&pc->data,cd,cdlen*sizeof(instruction));
+    pc->spacereq = scanSpaceReq(&pc->data[0],cdlen);
   }
   
   env = allocateConstructor(frcount);
@@ -189,7 +197,7 @@ static objPo buildRoot(uniChar *cwd,uniChar *bootfile)
   updateConsEl(rootEnv,1,boot);
   updateConsEl(rootEnv,2,aprilCWD);
   
-  if(load_code_file(aprilSysPath,bootfile,&code,False)!=Ok){
+  if(load_code_file(aprilSysPath,bootfile,&code,False,False)!=Ok){
     if(!uniStrLen(errorMsg)!=0)
       logMsg(logFile,"code in boot file [%U] doesn't verify: %U",bootfile,errorMsg);
     else
@@ -239,6 +247,8 @@ processpo ps_terminate(processpo p)
     void *root = gcAddRoot(&handle);
 
     flush_from_time_q(p);	/* remove any active timer records */
+    asyncCancel(p);		/* and any outstanding asynchronous escapes */
+    cancelMailboxWait(p);	/* and any wait for room in a mailbox */
 
     discard_msgs(p);
 
@@ -260,7 +270,9 @@ processpo ps_terminate(processpo p)
 
     p->state = dead;		/* mark this process as a zombie */
     
-    free(p->stack);		/* Dispose of the old evaluation stack */
+    if(p->stack!=NULL)
+      releaseStack(p->stack,p->sb-p->stack); /* Dispose of the old evaluation stack */
+    p->frozen = NULL;
 
     LiveProcesses--;
 
@@ -311,7 +323,9 @@ void displayProcess(processpo p)
 {
   struct msg_rec *m=p->mfront;
 
-  outMsg(logFile,"%#w [%s]\n",p->handle,state_names[p->state]);
+  outMsg(logFile,"%#w [%s]%s\n",p->handle,state_names[p->state],
+	 isHibernating(p)?" hibernating":"");
+  displayMsgStats(p);
 
   /* print the messages for this process */
   while(m){
@@ -395,21 +409,67 @@ void stackTrace(processpo p)
   Process stack manipulations 
 */
 
-int grow_stack(processpo p, int factor)
+/*
+ * Stacks are allocated in power of two size classes, starting at MINSTACK
+ * words. Freed stacks of a pooled class are kept on a free list threaded
+ * through their first word, so that forking a process is usually cheap.
+ */
+static objPo *stackPool[STACKCLASSES];
+static int stackPoolCount[STACKCLASSES];
+
+static int stackClass(WORD32 size)
+{
+  int k = 0;
+  WORD32 sz = MINSTACK;
+
+  while(sz<size){
+    sz<<=1;
+    k++;
+  }
+  return k;
+}
+
+static objPo *allocStack(WORD32 *size)
 {
-  int nsz = (p->sb-p->stack)*factor; /* New stack size */
-  objPo *st = (objPo*)malloc(sizeof(objPo)*nsz);
+  int k = stackClass(*size);
+
+  if(k<STACKCLASSES){
+    *size = MINSTACK<<k;
+
+    if(stackPool[k]!=NULL){
+      objPo *st = stackPool[k];
+
+      stackPool[k] = (objPo*)st[0];
+      stackPoolCount[k]--;
+      return st;
+    }
+  }
+  return (objPo*)malloc(sizeof(objPo)*(*size));
+}
+
+static void releaseStack(objPo *stack,WORD32 size)
+{
+  int k = stackClass(size);
+
+  if(k<STACKCLASSES && (MINSTACK<<k)==size && stackPoolCount[k]<MAXPOOLSTACKS){
+    stack[0] = (objPo)stackPool[k];
+    stackPool[k] = stack;
+    stackPoolCount[k]++;
+  }
+  else
+    free(stack);
+}
+
+/* Move a process's stack into a new stack of nsz words */
+static int move_stack(processpo p,WORD32 nsz)
+{
+  objPo *st = allocStack(&nsz);
   register objPo *s;
   register WORD32 i;
   register objPo *fp = p->fp;
   register objPo *sp = p->sp;
   register objPo *er = p->er;
 
-#ifdef PROCTRACE
-  if(traceSuspend)
-    logMsg(logFile,"Growing e-stack of process %#w",p->handle); 
-#endif
-
   if(st==NULL)
     return SpaceErr();
 
@@ -438,12 +498,74 @@ int grow_stack(processpo p, int factor)
     sp+=3;
   }
 
-  free(p->stack);		/* Dispose of the old evaluation stack */
+  releaseStack(p->stack,p->sb-p->stack); /* Dispose of the old evaluation stack */
   p->stack = st;
   p->sb = st+nsz;		/* New stackbase */
   return Ok;
 }
 
+int grow_stack(processpo p, int factor)
+{
+#ifdef PROCTRACE
+  if(traceSuspend)
+    logMsg(logFile,"Growing e-stack of process %#w",p->handle); 
+#endif
+
+  return move_stack(p,(p->sb-p->stack)*factor);
+}
+
+/* Grow a stack so that it has at least extra more words free */
+int extend_stack(processpo p,WORD32 extra)
+{
+  WORD32 size = p->sb-p->stack;
+  WORD32 nsz = size*2;
+
+  if(nsz<size+extra+MINSTACK)
+    nsz = size+extra+MINSTACK;
+
+#ifdef PROCTRACE
+  if(traceSuspend)
+    logMsg(logFile,"Growing e-stack of process %#w",p->handle); 
+#endif
+
+  return move_stack(p,nsz);
+}
+
+/*
+ * Shrink the stack of a process whose usage has fallen well below its
+ * capacity. Only processes that are blocked are considered: a runnable
+ * process may be in the middle of an escape holding pointers into its stack.
+ * The current frame may have locals below sp, so we allow for the space
+ * requirement of its code as well.
+ */
+static void shrinkProc(processpo p,void *cl)
+{
+  if(p->state!=dead && p->state!=runnable && p->state!=quiescent &&
+     p!=current_process && p!=newP && p!=freezing && p->stack!=NULL){
+    WORD32 size = p->sb-p->stack;
+    objPo *low = p->fp-CodeSpaceReq(codeOfClosure(p->e));
+    WORD32 need;
+
+    if(p->sp<low)
+      low = p->sp;
+
+    need = p->sb-low;
+
+    if(size>MINSTACK && need*SHRINKRATIO<size){
+#ifdef PROCTRACE
+      if(traceSuspend)
+	logMsg(logFile,"Shrinking e-stack of process %#w",p->handle); 
+#endif
+      move_stack(p,need*2);
+    }
+  }
+}
+
+void shrinkStacks(void)
+{
+  processProcesses(shrinkProc,NULL);
+}
+
 static processpo fork_process(uniChar *tgt,objPo name,
 			      objPo code,logical priv,
 			      objPo *creator,objPo *filer,processpo mailer,
@@ -452,14 +574,23 @@ static processpo fork_process(uniChar *tgt,objPo name,
   void *root = gcAddRoot(&code);
   register processpo p = allocPool(proc_pool);
   objPo *scr;			/* Scratch pointer */
+  WORD32 stsize = 3+CodeSpaceReq(codeOfClosure(code)); /* Entry frame's needs */
 
   if(p==NULL){
     logMsg(logFile,"unable to allocate new process record");
     return(NULL);
   }
 
-  p->stack = (objPo*)malloc(sizeof(objPo)*DEFSTACK); /* allocate a run-time stack */
-  p->sb = &p->stack[DEFSTACK];
+  p->stack = allocStack(&stsize); /* allocate a run-time stack */
+
+  if(p->stack==NULL){
+    freePool(proc_pool,p);
+    gcRemoveRoot(root);
+    logMsg(logFile,"unable to allocate new process stack");
+    return(NULL);
+  }
+
+  p->sb = &p->stack[stsize];
   p->priveleged = priv;        /* Privileged process? */
   p->er = p->sb;		/* set the error handler to stack base */
   p->errval = kvoid;		/* No error messages at the moment */
@@ -475,6 +606,12 @@ static processpo fork_process(uniChar *tgt,objPo name,
 
   p->mfront = p->mback = NULL;/* initialize the message queue */
   p->sequence = 0;		/* No messages received yet */
+  p->mcursor = NULL;
+  p->mcount = 0;
+  p->mcapacity = 0;		/* unbounded unless the forker says otherwise */
+  p->mpolicy = mailBlock;
+  p->mblocked = p->mwaitOn = p->mblockNext = NULL;
+  memset(&p->mstats,0,sizeof(MsgStats));
 
   scr = p->sb;		/* initialize the stack */
   {
@@ -492,6 +629,8 @@ static processpo fork_process(uniChar *tgt,objPo name,
   p->cl = NULL;		/* no client data yet */
 
   p->clicks = clicks;		/* set the click counter */
+  p->frozen = NULL;		/* not hibernating */
+  p->idleSince = 0;
 
   newP = p;			/* we need to set this up incase we get a GC */
   p->handle = kvoid;		/* in case of GC */
@@ -530,6 +669,8 @@ retCode m_fork(processpo p,objPo *args)
   if(NP==NULL)
     return liberror("_fork_",1,"cant fork process",einval);
   else{
+    NP->mcapacity = p->mcapacity; /* children inherit our mailbox bound */
+    NP->mpolicy = p->mpolicy;
     args[0] = NP->handle;
 
     return Switch;		/* will cause new process to be entered */
@@ -595,6 +736,8 @@ retCode m_fork2(processpo p,objPo *args)
   if(NP==NULL)
     return liberror("__fork_",6,"cant fork process",einval);
   else{
+    NP->mcapacity = p->mcapacity; /* children inherit our mailbox bound */
+    NP->mpolicy = p->mpolicy;
     args[5] = NP->handle;
 
     return Switch;		/* will cause new process to be entered */
@@ -741,7 +884,7 @@ retCode m_state(processpo p,objPo *args)
     if(P==NULL)
       args[0]=newSymbol("unknown");
     else
-      args[0]=newSymbol(state_names[p->state]);
+      args[0]=newSymbol(state_names[P->state]);
     return Ok;			/* return nothing to do */
   }
 }
@@ -811,6 +954,197 @@ static inline insPo CodeEnd(objPo b)
   return &pc->data[pc->size];
 }
 
+/*
+ * Process hibernation.
+ * A process that is waiting for a message may have its stack copied into a
+ * heap tuple and the stack itself released. The tuple holds the stack words
+ * from the top of the stack down to its base, preceded by the offsets of the
+ * frame and error pointers. Frame links, error links and return addresses
+ * are stored as integer offsets so that the tuple is a normal heap value.
+ */
+static void frzInt(objPo *frozen,WORD32 off,integer i)
+{
+  objPo el = allocateInteger(i);
+
+  updateTuple(*frozen,off,el);
+}
+
+retCode hibernateProcess(processpo p)
+{
+  if(p->stack==NULL || p->state==dead)
+    return Fail;
+  else{
+    objPo *fp = p->fp;
+    objPo *sp = p->sp;
+    objPo *sb = p->sb;
+    objPo *er = p->er;
+    objPo *pep = &p->e;		/* environment of the code owning a frame */
+    objPo frozen;
+    void *root;
+    WORD32 k = 2;
+
+    freezing = p;		/* stop the GC from moving this stack */
+    frozen = allocateTuple((sb-sp)+2);
+    root = gcAddRoot(&frozen);
+
+    frzInt(&frozen,0,sb-fp);
+    frzInt(&frozen,1,sb-er);
+
+    while(sp<sb){
+      register WORD32 i = fp-sp;	/* the length of the local environment */
+
+      while(i--){
+	if(sp==er){
+	  frzInt(&frozen,k++,sb-(objPo*)er[0]);
+	  frzInt(&frozen,k++,(insPo)er[1]-CodeBase(*pep));
+	  er = (objPo*)er[0];	/* move the error handler pointer up */
+	  sp+=2;
+	  i--;
+	}
+	else
+	  updateTuple(frozen,k++,*sp++);
+      }
+
+      frzInt(&frozen,k++,sb-*(objPo**)fp);
+      updateTuple(frozen,k++,fp[1]);
+      frzInt(&frozen,k++,(insPo)fp[2]-CodeBase(fp[1]));
+
+      pep = &fp[1];
+      fp = *(objPo**)fp;	/* go back to the previous frame pointer */
+      sp +=3;			/* step over the return address and env*/
+    }
+
+    assert(k==tupleArity(frozen));
+
+#ifdef PROCTRACE
+    if(traceSuspend)
+      logMsg(logFile,"Hibernating process %#w, %d words",p->handle,k);
+#endif
+
+    releaseStack(p->stack,sb-p->stack);
+    p->stack = p->sb = p->sp = p->fp = p->er = NULL;
+    p->frozen = frozen;
+
+    freezing = NULL;
+    gcRemoveRoot(root);
+    return Ok;
+  }
+}
+
+/* Rebuild the stack of a hibernating process -- this does not allocate heap */
+void awakenProcess(processpo p)
+{
+  if(isHibernating(p)){
+    objPo frozen = p->frozen;
+    WORD32 n = tupleArity(frozen)-2;
+    WORD32 size = 3+n+CodeSpaceReq(codeOfClosure(p->e));
+    objPo *st = allocStack(&size);
+    objPo *sb,*sp,*fp,*er;
+    objPo *pep = &p->e;
+    WORD32 k = 2;
+
+    if(st==NULL)
+      syserr("unable to restore process stack");
+
+    p->stack = st;
+    p->sb = sb = st+size;
+    p->sp = sp = sb-n;
+    p->fp = fp = sb-IntVal(tupleArg(frozen,0));
+    p->er = er = sb-IntVal(tupleArg(frozen,1));
+
+    while(sp<sb){
+      register WORD32 i = fp-sp;	/* the length of the local environment */
+
+      while(i--){
+	if(sp==er){
+	  sp[0] = (objPo)(sb-IntVal(tupleArg(frozen,k++)));
+	  sp[1] = (objPo)(CodeBase(*pep)+IntVal(tupleArg(frozen,k++)));
+	  er = (objPo*)er[0];	/* move the error handler pointer up */
+	  sp+=2;
+	  i--;
+	}
+	else
+	  *sp++ = tupleArg(frozen,k++);
+      }
+
+      fp[0] = (objPo)(sb-IntVal(tupleArg(frozen,k++)));
+      fp[1] = tupleArg(frozen,k++);
+      fp[2] = (objPo)(CodeBase(fp[1])+IntVal(tupleArg(frozen,k++)));
+
+      pep = &fp[1];
+      fp = *(objPo**)fp;	/* go back to the previous frame pointer */
+      sp +=3;			/* step over the return address and env*/
+    }
+
+    p->frozen = NULL;
+
+#ifdef PROCTRACE
+    if(traceSuspend)
+      logMsg(logFile,"Awakening process %#w",p->handle);
+#endif
+  }
+}
+
+typedef struct {
+  processpo *procs;		/* candidates for hibernation */
+  WORD32 count;
+  WORD32 max;
+  long now;
+} idleRec;
+
+static void idleProc(processpo p,void *cl)
+{
+  idleRec *info = (idleRec*)cl;
+
+  if(p->state==wait_msg && p->stack!=NULL && p!=current_process &&
+     p->idleSince+hibernateTime<=info->now){
+    if(info->count>=info->max){
+      info->max = info->max*2+16;
+      info->procs = (processpo*)realloc(info->procs,info->max*sizeof(processpo));
+    }
+    if(info->procs!=NULL)
+      info->procs[info->count++] = p;
+  }
+}
+
+/* Called from the scheduler: hibernate processes that have waited too long */
+void hibernateIdle(void)
+{
+  static long lastSweep = 0;
+
+  if(hibernateTime>0){
+    long now = time(NULL);
+
+    if(now!=lastSweep){
+      idleRec info = {NULL,0,0,now};
+      WORD32 i;
+
+      lastSweep = now;
+
+      /* collect the candidates first, hibernation may cause a GC */
+      processProcesses(idleProc,&info);
+
+      for(i=0;i<info.count;i++)
+	hibernateProcess(info.procs[i]);
+
+      if(info.procs!=NULL)
+	free(info.procs);
+    }
+  }
+}
+
+/* Explicitly hibernate until the next message arrives */
+retCode m_hibernate(processpo p,objPo *args)
+{
+  if(msgcount(p)==0){
+    hibernateProcess(p);
+    ps_suspend(p,wait_msg);
+    return Suspend;
+  }
+  else
+    return Ok;
+}
+
 /* Support for GC of processes */
 
 /* This one is for normal copying process... */
@@ -856,6 +1190,8 @@ void scanProcess(processpo p)
     //    p->pc = (insPo)(p->pc-CodeBase(p->e));
     p->e = scanCell(p->e);	/* scan the process's environment */
     p->clicks = scanCell(p->clicks);	/* click counter */
+    if(p->frozen!=NULL)
+      p->frozen = scanCell(p->frozen);	/* hibernating stack */
 
     while(msgs!=NULL){
       msgs->msg = scanCell(msgs->msg); /* Scan this message */
@@ -1000,6 +1336,8 @@ void markProcess(processpo p)
     markCell(p->creator);	/* process creator */
     markCell(p->filer);		/* process file manager */
     markCell(p->clicks);	/* process click counter */
+    if(p->frozen!=NULL)
+      markCell(p->frozen);	/* hibernating stack */
     //    p->pc = (insPo)(p->pc-CodeBase(p->e));
 
     while(msgs!=NULL){
@@ -1052,6 +1390,8 @@ void adjustProcess(processpo p)
     p->creator = adjustCell(p->creator); /* process creator */
     p->filer = adjustCell(p->filer);	/* process file manager */
     p->clicks = adjustCell(p->clicks);	/* process click counter */
+    if(p->frozen!=NULL)
+      p->frozen = adjustCell(p->frozen); /* hibernating stack */
     p->pc = CodeBase(p->e) + (WORD32)(p->pc);
 
     while(msgs!=NULL){
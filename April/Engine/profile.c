@@ -0,0 +1,264 @@
+/*
+  Sampling profiler
+  (c) 1994-2003 Imperial College and F.G.McCabe
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+  Contact: Francis McCabe <fgm@fla.fujitsu.com>
+*/
+
+/*
+ * When profiling, the cpu timer goes off every PROFILETICKS milliseconds
+ * and sets sampleDue. The emulator notices it where it would notice a
+ * scheduler tick, and records the running process' stack: the code of
+ * each frame, named by its entry_d instruction, and -- from the line_d
+ * instructions -- the source line being executed.
+ *
+ * Identical stacks are counted together. When the engine exits they are
+ * written in the collapsed-stack format read by flame graph tools:
+ *
+ *   process;outer;...;inner;file:line count
+ */
+
+#include "config.h"		/* pick up standard configuration header */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "april.h"
+#include "process.h"
+#include "handle.h"
+#include "opcodes.h"
+#include "debug.h"
+#include "profile.h"
+
+#define PROFILEKEY 4096		/* Longest stack we record */
+#define PROFILEINIT 1024	/* Initial size of the table of stacks */
+
+typedef struct {
+  char *stack;			/* The collapsed stack */
+  unsigned long count;		/* How many samples had it */
+} SampleRec, *samplePo;
+
+char *profileFile = NULL;
+logical sampleDue = False;
+
+static samplePo table = NULL;	/* open hash table of stacks */
+static unsigned long tableSize = 0;
+static unsigned long tableCount = 0;
+
+static unsigned long stackHash(char *s)
+{
+  unsigned long h = 2166136261UL;
+
+  while(*s)
+    h = (h^(unsigned char)*s++)*16777619UL;
+  return h;
+}
+
+static void countStack(char *stack,unsigned long count)
+{
+  unsigned long h;
+
+  if((tableCount+1)*2>tableSize){	/* keep the table half empty */
+    samplePo old = table;
+    unsigned long oldSize = tableSize;
+    unsigned long i;
+
+    tableSize = (oldSize==0?PROFILEINIT:oldSize*2);
+    if((table=(samplePo)calloc(tableSize,sizeof(SampleRec)))==NULL){
+      table = old;		/* keep what we have */
+      tableSize = oldSize;
+      return;
+    }
+    tableCount = 0;
+
+    for(i=0;i<oldSize;i++)
+      if(old[i].stack!=NULL){
+	countStack(old[i].stack,old[i].count);
+	free(old[i].stack);
+      }
+    free(old);
+  }
+
+  for(h=stackHash(stack)%tableSize;table[h].stack!=NULL;h=(h+1)%tableSize)
+    if(strcmp(table[h].stack,stack)==0){
+      table[h].count += count;
+      return;
+    }
+
+  if((table[h].stack=strdup(stack))!=NULL){
+    table[h].count = count;
+    tableCount++;
+  }
+}
+
+static void append(char *buff,int *pos,char *text)
+{
+  while(*text && *pos<PROFILEKEY-1)
+    buff[(*pos)++] = *text++;
+  buff[*pos] = '\0';
+}
+
+static void appendSym(char *buff,int *pos,objPo sym,logical tail)
+{
+  uniChar *text = SymText(sym);
+  WORD32 len = uniStrLen(text);
+  char utf[3*MAX_SYMB_LEN+1];
+  char *t = utf;
+
+  if(len>MAX_SYMB_LEN)
+    len = MAX_SYMB_LEN;
+
+  utf[uni_utf8(text,len,utf,NumberOf(utf))] = '\0';
+
+  if(tail && strrchr(utf,'/')!=NULL)
+    t = strrchr(utf,'/')+1;	/* just the file's name */
+
+  for(;*t;t++)			/* these separate frames and counts */
+    if(*t==';' || *t==' ')
+      *t = '_';
+  append(buff,pos,t);
+}
+
+/* Find the name of the code, and the last source line before pc */
+static void codeInfo(objPo code,insPo pc,objPo *name,objPo *file,WORD32 *line)
+{
+  insPo base = CodeCode(code);
+  insPo end = base+CodeSize(code);
+  objPo *lits = CodeLits(code);
+  unsigned WORD32 litcnt = CodeLitcnt(code);
+  insPo p;
+
+  *name = *file = NULL;
+
+  for(p=base;p<end;p++){
+    unsigned WORD32 ins = loadedIns(code,p-base); /* even if not debugging */
+
+    switch(op_cde(ins)){
+    case entry_d:
+      if(*name==NULL && op_o_val(ins)<litcnt && isSymb(lits[op_o_val(ins)]))
+	*name = lits[op_o_val(ins)];
+      break;
+    case line_d:
+      if(p+1<end){
+	unsigned WORD32 ix = p[1]&0xffff;
+
+	if(p<pc && ix<litcnt && isSymb(lits[ix])){
+	  *file = lits[ix];
+	  *line = op_so_val(ins);
+	}
+	p++;			/* step over the file name */
+      }
+      break;
+    default:
+      break;
+    }
+  }
+}
+
+/* Record a sample of p's stack -- p's registers must have been saved */
+void profileSample(processpo p)
+{
+  objPo envs[PROFILEDEPTH];
+  insPo pcs[PROFILEDEPTH];
+  objPo *fp = p->fp;
+  objPo env = p->e;
+  insPo pc = p->pc;
+  int depth = 0;
+  char stack[PROFILEKEY];
+  int pos = 0;
+  objPo name,file = NULL;
+  WORD32 line = 0;
+
+  sampleDue = False;
+
+  if(p->stack==NULL)
+    return;
+
+  while(depth<PROFILEDEPTH){
+    if(isClosure(env)){
+      envs[depth] = env;
+      pcs[depth++] = pc;
+    }
+
+    /* the outermost frame belongs to the process' exit code */
+    if(fp==NULL || fp>=p->sb || *(objPo**)fp>=p->sb)
+      break;
+
+    env = fp[1];
+    pc = (insPo)fp[2];
+    fp = *(objPo**)fp;
+  }
+
+  stack[0] = '\0';
+  if(p->handle!=NULL && IsHandle(p->handle) && isSymb(handleName(p->handle)))
+    appendSym(stack,&pos,handleName(p->handle),False);
+  else
+    append(stack,&pos,"process");
+
+  while(depth--){
+    objPo code = codeOfClosure(envs[depth]);
+    objPo f;
+    WORD32 l = 0;
+
+    codeInfo(code,pcs[depth],&name,&f,&l);
+
+    append(stack,&pos,";");
+    if(name!=NULL)
+      appendSym(stack,&pos,name,False);
+    else{
+      char anon[64];
+
+      sprintf(anon,"code/%d[%d]",(int)CodeArity(code),(int)CodeSize(code));
+      append(stack,&pos,anon);
+    }
+
+    if(depth==0){
+      file = f;
+      line = l;
+    }
+  }
+
+  if(file!=NULL){		/* the line being executed */
+    char ln[32];
+
+    append(stack,&pos,";");
+    appendSym(stack,&pos,file,True);
+    sprintf(ln,":%d",(int)line);
+    append(stack,&pos,ln);
+  }
+
+  countStack(stack,1);
+}
+
+void dumpProfile(void)
+{
+  if(profileFile!=NULL && tableCount>0){
+    FILE *out = fopen(profileFile,"w");
+    unsigned long i;
+
+    if(out==NULL){
+      logMsg(logFile,"cant write profile %s",profileFile);
+      return;
+    }
+
+    for(i=0;i<tableSize;i++)
+      if(table[i].stack!=NULL)
+	fprintf(out,"%s %lu\n",table[i].stack,table[i].count);
+
+    fclose(out);
+  }
+}
@@ -57,6 +57,7 @@ void initDebugger(uniChar *host,int port)
     }
     else{
       SymbolDebug = True;
+      enableDebugSites();
       outMsg(debugOut,"<model language=\"april\" version=\"5.0\"/>\n");
       flushFile(debugOut);
     }
@@ -141,6 +142,7 @@ void debug_stop(WORD32 pcCount,processpo p,insPo pc,objPo *sp,objPo *fp,objPo en
 	break;
       case 'S':
 	SymbolDebug = True;
+	enableDebugSites();
 	TCPDebug = False;
 	debugging = False;
 	interactive = True;
@@ -332,6 +334,7 @@ retCode m_break(processpo p,objPo *args)
       interactive=debugging=True;
 #else
     SymbolDebug = True;
+    enableDebugSites();
     interactive = !TCPDebug;
 #endif
   }
@@ -27,6 +27,9 @@
 #include "handle.h"
 #include "fileio.h"
 #include "process.h"
+#include "async.h"
+#include "transport.h"
+#include "debug.h"
 #include <sys/times.h>
 #include <time.h>
 #include <limits.h>
@@ -43,7 +46,7 @@ logical stressSuspend=False;
 #ifdef PROCTRACE_
 static const char* state_names[] = {"quiescent", "runnable",
 				    "wait_io", "wait_msg",
-				    "wait_timer", "wait_clicks", "wait_memory","wait_lock","wait_child",
+				    "wait_timer", "wait_lock","wait_child","wait_mailbox",
 				    "dead"};
 #endif
 
@@ -53,15 +56,28 @@ static void checkOutIo(void)
   struct timeval period;
   int inCount = set_in_fdset(&fdin);
   int outCount = set_out_fdset(&fdout);
-  int fdCount = (inCount>outCount?inCount:outCount)+1;
+  int asyncFd = asyncPollFd();
+  int fdCount;
+
+  if(asyncFd>=0){
+    FD_SET(asyncFd,&fdin);
+    if(asyncFd>inCount)
+      inCount = asyncFd;
+  }
+
+  fdCount = (inCount>outCount?inCount:outCount)+1;
   
   period.tv_sec = 0;
   period.tv_usec = 0;
 
   flushOut();
+  flushTransport();		/* write out the batched remote messages */
 
-  if(select(fdCount,&fdin,&fdout,NULL,&period)>0)
+  if(select(fdCount,&fdin,&fdout,NULL,&period)>0){
+    if(asyncFd>=0 && FD_ISSET(asyncFd,&fdin))
+      asyncComplete();		/* some asynchronous escapes have finished */
     trigger_io(&fdin,&fdout,fdCount);
+  }
 }
 
 /*
@@ -85,9 +101,19 @@ static void wait_for_event(void)
     fd_set inSet, outSet;
     int inCount = set_in_fdset(&inSet);
     int outCount = set_out_fdset(&outSet);
-    int fdCount = (inCount>outCount?inCount:outCount)+1;
+    int asyncFd = asyncPollFd();
+    int fdCount;
+
+    if(asyncFd>=0){		/* listen to the worker threads too */
+      FD_SET(asyncFd,&inSet);
+      if(asyncFd>inCount)
+	inCount = asyncFd;
+    }
+
+    transportSleep();		/* neighbours must wake us from now on */
 
     flushOut();
+    flushTransport();
 
     if(childDone)
       checkOutShells();
@@ -97,8 +123,16 @@ static void wait_for_event(void)
        reset_timer();
        checkOutIo();		/* See if any IO has become ready */
      }
+     expireLeases();		/* discard messages whose lease has run out */
+     transportPoll();		/* messages from remote engines */
      if(run_q!=NULL)
        break;			/* The run_q might not be empty anymore */
+
+     hibernateIdle();		/* a good moment to release idle stacks */
+
+    inCount = transportFds(&inSet,&outSet,inCount); /* and to remote engines */
+
+    fdCount = (inCount>outCount?inCount:outCount)+1;
 				/* wait for something to happen */
 #ifdef CLOCKTRACE
     if(traceClock)
@@ -120,8 +154,11 @@ static void wait_for_event(void)
       else logMsg(logFile,"select error %s in wait_for_event()",strerror(errno));
     }
 
-    if(status>0)		/* trigger suspended processes */
+    if(status>0){		/* trigger suspended processes */
+      if(asyncFd>=0 && FD_ISSET(asyncFd,&inSet))
+	asyncComplete();
       trigger_io(&inSet,&outSet,fdCount);
+    }
 
     if(wakeywakey) {
       wakeywakey = False;
@@ -133,6 +170,7 @@ static void wait_for_event(void)
     logMsg(logFile,"restart with process %#w ...", run_q->handle);
 #endif
 
+  transportAwake();		/* neighbours need not wake us now */
   taxiFlag();			/* Start the taxi meter again */
   startTicks(-1);		/* restart the scheduler's heart beat */
 }
@@ -203,6 +241,12 @@ processpo ps_pause(register processpo p)
     wakeywakey = False;
     reset_timer();
     checkOutIo();
+    hibernateIdle();
+    expireLeases();
+    transportPoll();
+
+    if(SymbolDebug)
+      enableDebugSites();	/* in case a debugger was turned on */
   }
 
   taxiFare(current_process);	/* decrement tank's click counter */
@@ -305,7 +349,11 @@ void ps_unthreadProcess(processpo P,processpo *queue)
 processpo add_to_run_q(processpo p,logical front)
 {
   processpo next = NULL;
-  sigset_t blocked = stopInterrupts();  /* prevent interrupts now */
+  sigset_t blocked;
+
+  awakenProcess(p);		/* make sure that it has a stack */
+
+  blocked = stopInterrupts();  /* prevent interrupts now */
 
 #ifdef PROCTRACE_
   if(traceSuspend)
@@ -438,6 +486,11 @@ static void tF(processpo p,void *c)
   if(p->clicks==cl){
     p->errval = kclicked;	/* ran out of time */
 
+    awakenProcess(p);
+    asyncCancel(p);		/* it is not going to want its results */
+    p->mcursor = NULL;
+    cancelMailboxWait(p);
+
     if(p->er<p->sb){		/* force the process into error recovery */
       while(p->fp<p->er){
 	objPo *sp = p->sp = p->fp;
@@ -599,6 +652,9 @@ processpo remove_from_run_q(register processpo p,process_state reason)
 
   assert(p->state==runnable);
 
+  if(reason==wait_msg)
+    p->idleSince = time(NULL);	/* note when it started to wait */
+
   if(p->pnext != p) {
     p->state = reason;
     run_q = p->pnext;
@@ -53,6 +53,7 @@ static void sig_debug(int sig)
 {
   outMsg(logFile, "Turning on symbolic debug tracing\n");
   SymbolDebug = True;
+  wakeywakey = True;		/* the scheduler enables debugging instructions */
 }
 
 static void sig_child(int sig)
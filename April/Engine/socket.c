@@ -20,7 +20,13 @@
 */
 #include "config.h"		/* pick up standard configuration header */
 #include <string.h>
+#include <stdlib.h>
 #include <assert.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netdb.h>
 
 #include "april.h"
 #include "process.h"
@@ -28,6 +34,7 @@
 #include "symbols.h"
 #include "astring.h"		/* String interface functions */
 #include "fileio.h"		/* Interface to file functions */
+#include "async.h"
 
 retCode m_listen(processpo p,objPo *args)
 {
@@ -233,37 +240,124 @@ retCode m_connect(processpo p,objPo *args)
 
 /* Access host name functions */
 /* return IP addresses of a host */
+#define MAXHOSTIPS 16		/* Maximum number of addresses reported */
+
+typedef struct {
+  char host[MAX_SYMB_LEN];	/* Host name, or IP address */
+  int count;			/* Number of addresses found */
+  char ips[MAXHOSTIPS][INET6_ADDRSTRLEN];
+} hostJobRec, *hostJobPo;
+
+/* Look up the addresses of a host -- runs in a worker thread */
+static retCode hostToIpJob(asyncPo job)
+{
+  hostJobPo h = (hostJobPo)job->data;
+  struct addrinfo hints, *res, *a;
+
+  memset(&hints,0,sizeof(hints));
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+
+  h->count = 0;
+
+  if(getaddrinfo(h->host,NULL,&hints,&res)!=0)
+    return Fail;
+
+  for(a=res;a!=NULL && h->count<MAXHOSTIPS;a=a->ai_next){
+    struct sockaddr_in *in = (struct sockaddr_in*)a->ai_addr;
+
+    if(inet_ntop(AF_INET,&in->sin_addr,h->ips[h->count],INET6_ADDRSTRLEN)!=NULL)
+      h->count++;
+  }
+  freeaddrinfo(res);
+  return Ok;
+}
+
+/* Look up the name of a host from its address -- runs in a worker thread */
+static retCode ipToHostJob(asyncPo job)
+{
+  hostJobPo h = (hostJobPo)job->data;
+  struct addrinfo hints, *res;
+  retCode ret = Fail;
+
+  memset(&hints,0,sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_flags = AI_NUMERICHOST;
+
+  if(getaddrinfo(h->host,NULL,&hints,&res)!=0)
+    return Fail;
+
+  if(getnameinfo(res->ai_addr,res->ai_addrlen,h->ips[0],
+		 sizeof(h->ips[0]),NULL,0,NI_NAMEREQD)==0){
+    h->count = 1;
+    ret = Ok;
+  }
+  freeaddrinfo(res);
+  return ret;
+}
+
+/* Pick up a finished host lookup, or start one -- *ret is Suspend if we did */
+static asyncPo hostJob(processpo p,objPo host,asyncFun fun,retCode *ret)
+{
+  asyncPo job = asyncResult(p,fun);
+
+  *ret = Ok;
+
+  if(job==NULL){
+    hostJobPo h = (hostJobPo)malloc(sizeof(hostJobRec));
+    WORD32 hlen = ListLen(host);
+    uniChar hBuf[hlen+1];
+
+    if(h==NULL){
+      *ret = Space;
+      return NULL;
+    }
+
+    _utf(StringText(host,hBuf,hlen+1),(unsigned char*)h->host,NumberOf(h->host));
+    h->count = 0;
+
+    if((*ret=asyncEscape(p,fun,h))==Ok)
+      job = asyncResult(p,fun);
+  }
+  return job;
+}
+
+/* Access IP addresses of a host */
 retCode m_hosttoip(processpo p,objPo *args)
 {
   if(!isListOfChars(args[0]))
     return liberror("hosttoip",1,"argument should be a string",einval);
   else{
-    WORD32 i=0;
-    uniChar ip[MAX_SYMB_LEN];
-    WORD32 hlen = ListLen(args[0]);
-    uniChar hBuf[hlen+1];
-    uniChar *host = StringText(args[0],hBuf,hlen+1);
-    objPo last = emptyList;
-    objPo ipstr = emptyList;
-    void *root = gcAddRoot(&last);
-
-    gcAddRoot(&ipstr);
-
-    while(getNthHostIP(host,i,ip,NumberOf(ip))!=NULL){
-      ipstr = allocateString(ip);
-
-      if(last==emptyList)
-	last = args[0] = allocatePair(&ipstr,&emptyList);
-      else{
-	objPo tail = allocatePair(&ipstr,&emptyList);
-	updateListTail(last,tail);
-	last = tail;
+    retCode ret;
+    asyncPo job = hostJob(p,args[0],hostToIpJob,&ret);
+
+    if(job==NULL)
+      return ret==Space?liberror("hosttoip",1,"out of memory",esystem):ret;
+    else{
+      hostJobPo h = (hostJobPo)job->data;
+      WORD32 i;
+      objPo last = emptyList;
+      objPo ipstr = emptyList;
+      void *root = gcAddRoot(&last);
+
+      gcAddRoot(&ipstr);
+
+      for(i=0;i<h->count;i++){
+	ipstr = allocateCString(h->ips[i]);
+
+	if(last==emptyList)
+	  last = args[0] = allocatePair(&ipstr,&emptyList);
+	else{
+	  objPo tail = allocatePair(&ipstr,&emptyList);
+	  updateListTail(last,tail);
+	  last = tail;
+	}
       }
-      i++;
-    }
 
-    gcRemoveRoot(root);
-    return Ok;
+      gcRemoveRoot(root);
+      asyncFree(job);
+      return Ok;
+    }
   }
 }
 
@@ -273,15 +367,19 @@ retCode m_iptohost(processpo p,objPo *args)
   if(!isListOfChars(args[0]))
     return liberror("iptohost",1,"argument should be a string",einval);
   else{
-    WORD32 hlen = ListLen(args[0]);
-    uniChar hBuf[hlen+1];
-    uniChar *host = getHostname(StringText(args[0],hBuf,hlen+1));
-
-    if(host!=NULL){
-      args[0]=allocateString(host);
+    retCode ret;
+    asyncPo job = hostJob(p,args[0],ipToHostJob,&ret);
+
+    if(job==NULL)
+      return ret==Space?liberror("iptohost",1,"out of memory",esystem):ret;
+    else if(job->ret==Ok){
+      args[0]=allocateCString(((hostJobPo)job->data)->ips[0]);
+      asyncFree(job);
       return Ok;
     }
-    else
+    else{
+      asyncFree(job);
       return liberror("iptohost",1,"get find host",enet);
+    }
   }
 }
@@ -0,0 +1,223 @@
+/*
+  Execution profile of the engine
+  (c) 1994-2003 Imperial College and F.G.McCabe
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+  Contact: Francis McCabe <fgm@fla.fujitsu.com>
+*/
+
+/*
+ * When the engine is configured with --enable-statistics, emulate counts
+ * the instructions it executes -- singly and in (previous,current) pairs
+ * -- and the calls and time spent in each escape. The profile is written
+ * to the log when the engine exits, or when __stats is called.
+ */
+
+#include "config.h"		/* pick up standard configuration header */
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "april.h"
+#include "process.h"
+#include "dict.h"
+#include "symbols.h"
+#include "opcodes.h"
+
+#ifdef STATISTICS
+
+#define MAXESC 256		/* size of the escape table */
+#define MAXPAIRS 40		/* how many pairs are reported */
+
+unsigned long opCounts[STATOPS];
+unsigned long pairCounts[STATOPS][STATOPS];
+int lastOp = halt;
+
+static unsigned long escCounts[MAXESC]; /* calls of each escape */
+static double escTimes[MAXESC];	/* seconds spent in each escape */
+
+static char *opNames[STATOPS];
+
+static void initNames(void)
+{
+  if(opNames[halt]==NULL){
+#undef instruction
+#define instruction(mnem,op,sig,tp) opNames[op]=#mnem;
+
+#include "instructions.h"
+#undef instruction
+  }
+}
+
+void stat_ins_start(void)
+{
+  memset(opCounts,0,sizeof(opCounts));
+  memset(pairCounts,0,sizeof(pairCounts));
+  memset(escCounts,0,sizeof(escCounts));
+  memset(escTimes,0,sizeof(escTimes));
+  lastOp = halt;
+}
+
+/* Call an escape, and account for the time it takes */
+retCode stat_escape(funpo ef,int code,processpo P,objPo *SP)
+{
+  struct timeval start,end;
+  retCode ret;
+
+  gettimeofday(&start,NULL);
+  ret = (*ef)(P,SP);
+  gettimeofday(&end,NULL);
+
+  if(code>=0 && code<MAXESC){
+    escCounts[code]++;
+    escTimes[code] += (end.tv_sec-start.tv_sec)+(end.tv_usec-start.tv_usec)/1.0e6;
+  }
+  return ret;
+}
+
+static int cmpOps(const void *a,const void *b)
+{
+  unsigned long ca = opCounts[*(int*)a];
+  unsigned long cb = opCounts[*(int*)b];
+
+  return ca<cb?1:ca>cb?-1:0;
+}
+
+static int cmpPairs(const void *a,const void *b)
+{
+  int pa = *(int*)a, pb = *(int*)b;
+  unsigned long ca = pairCounts[pa/STATOPS][pa%STATOPS];
+  unsigned long cb = pairCounts[pb/STATOPS][pb%STATOPS];
+
+  return ca<cb?1:ca>cb?-1:0;
+}
+
+static int cmpEscapes(const void *a,const void *b)
+{
+  double ta = escTimes[*(int*)a];
+  double tb = escTimes[*(int*)b];
+
+  return ta<tb?1:ta>tb?-1:0;
+}
+
+static char *opName(int op)
+{
+  return opNames[op]!=NULL?opNames[op]:"unknown";
+}
+
+void dump_stats(void)
+{
+  int ops[STATOPS];
+  int *pairs = (int*)malloc(sizeof(int)*STATOPS*STATOPS);
+  unsigned long total = 0;
+  int i,count = 0;
+
+  initNames();
+
+  for(i=0;i<STATOPS;i++){
+    ops[i] = i;
+    total += opCounts[i];
+  }
+
+  if(total==0){
+    free(pairs);
+    return;
+  }
+
+  qsort(ops,STATOPS,sizeof(int),cmpOps);
+
+  outMsg(logFile,"%ld instructions executed\n",total);
+  outMsg(logFile,"       count   pct  instruction\n");
+
+  for(i=0;i<STATOPS && opCounts[ops[i]]!=0;i++)
+    outMsg(logFile,"%12ld %5.1f  %s\n",opCounts[ops[i]],
+	   100.0*opCounts[ops[i]]/total,opName(ops[i]));
+
+  if(pairs!=NULL){
+    for(i=0;i<STATOPS*STATOPS;i++)
+      if(pairCounts[i/STATOPS][i%STATOPS]!=0)
+	pairs[count++] = i;
+
+    qsort(pairs,count,sizeof(int),cmpPairs);
+
+    outMsg(logFile,"\nmost frequent instruction pairs\n");
+    outMsg(logFile,"       count   pct  instructions\n");
+
+    for(i=0;i<count && i<MAXPAIRS;i++){
+      int prev = pairs[i]/STATOPS, op = pairs[i]%STATOPS;
+      unsigned long cnt = pairCounts[prev][op];
+
+      outMsg(logFile,"%12ld %5.1f  %s %s\n",cnt,100.0*cnt/total,
+	     opName(prev),opName(op));
+    }
+    free(pairs);
+  }
+
+  dump_escape_stats();
+  flushFile(logFile);
+}
+
+void dump_escape_stats(void)
+{
+  int escs[MAXESC];
+  int i,count = 0;
+
+  for(i=0;i<MAXESC;i++)
+    if(escCounts[i]!=0)
+      escs[count++] = i;
+
+  if(count==0)
+    return;
+
+  qsort(escs,count,sizeof(int),cmpEscapes);
+
+  outMsg(logFile,"\nescape calls\n");
+  outMsg(logFile,"       calls     seconds  usec/call  escape\n");
+
+  for(i=0;i<count;i++){
+    int e = escs[i];
+
+    outMsg(logFile,"%12ld %11.6f %10.2f  %s [%d]\n",escCounts[e],escTimes[e],
+	   1.0e6*escTimes[e]/escCounts[e],escapeName(e),e);
+  }
+}
+
+#endif
+
+/*
+ * __stats(reset) writes out the execution profile, and clears it if reset
+ * is true
+ */
+retCode m_stats(processpo p,objPo *args)
+{
+  objPo reset = args[0];
+
+  if(!p->priveleged)
+    return liberror("__stats",1,"permission denied",eprivileged);
+  else if(!isSymb(reset) || (reset!=ktrue && reset!=kfalse))
+    return liberror("__stats",1,"argument should be logical",einval);
+  else{
+#ifdef STATISTICS
+    dump_stats();
+
+    if(reset==ktrue)
+      stat_ins_start();
+    return Ok;
+#else
+    return liberror("__stats",1,"engine not configured with --enable-statistics",efail);
+#endif
+  }
+}
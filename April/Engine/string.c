@@ -578,10 +578,10 @@ retCode genString(objPo val,objPo *tgt)
 }
 
 /* Construct an encoded string from a arbitrary data value */		
-retCode m_sencode(processpo p, objPo *args)
+static retCode sencode(char *name,objPo *args,logical share)
 {
   ioPo str = openOutStr(rawEncoding);
-  retCode res=encodeICM(str,args[0]);
+  retCode res=encodeICM(str,args[0],share,NULL);
 
   if(res==Ok){
     WORD32 len;
@@ -595,7 +595,18 @@ retCode m_sencode(processpo p, objPo *args)
   if(res==Ok)
     return Ok;
   else
-    return liberror("sencode",1,"too complex",efail);
+    return liberror(name,1,"too complex",efail);
+}
+
+retCode m_sencode(processpo p, objPo *args)
+{
+  return sencode("sencode",args,True);
+}
+
+/* The data is known to be a tree, so dont look for shared structure */
+retCode m_sencode_tree(processpo p, objPo *args)
+{
+  return sencode("_sencode_tree",args,False);
 }
 
 /* Decode an encoded string */		
@@ -607,7 +618,7 @@ retCode m_sdecode(processpo p, objPo *args)
   ioPo str = openInStr(StringText(args[0],buff,len+1),len,rawEncoding);
   objPo term = kvoid;
   void *root = gcAddRoot(&term);
-  retCode res=decodeICM(str,&term,verifyCode);
+  retCode res=decodeICM(str,&term,verifyCode,NULL);
 
   closeFile(str);		/* we need to close the channel anyway */
 
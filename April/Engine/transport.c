@@ -0,0 +1,1164 @@
+/*
+  Native message transport -- length-prefixed ICM frames over TCP
+  (c) 1994-2002 Imperial College and F.G.McCabe
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+  Contact: Francis McCabe <fgm@fla.fujitsu.com>
+*/
+
+/*
+ * Messages for agents with a route are sent directly to the engine that
+ * hosts them, rather than through the mailer process. Each message is a
+ * frame: a trmString header followed by the ICM encoding of the tuple
+ * (to,sender,opts,msg). There is one connection per remote engine, shared
+ * by all the agents routed to it; each connection has its own ICM
+ * dictionaries. Frames are queued and written out in batches with writev.
+ *
+ * Agents without a route are left to the mailer -- typically the SCS.
+ * Replies find their way back because the sender of each incoming message
+ * is routed over the connection it arrived on.
+ *
+ * Engines on the same host exchange frames through ring buffers in shared
+ * files, one for each direction. The socket is still used to set the
+ * rings up and to wake up a reader that is asleep in select; otherwise
+ * neither side makes a system call to pass a message.
+ *
+ * A ring is offered with (ring,path); the peer answers (ringok,path) if
+ * it could map it. Only then does the writer send (ringon,path) and put
+ * the frames after it in the ring. A peer that cannot map the ring --
+ * in another container, say -- just never answers, and the socket is
+ * used as before.
+ *
+ * A frame too big for the ring goes over the socket, and an empty frame
+ * is left in the ring in its place; the reader takes the next frame from
+ * the socket when it finds one. That keeps the frames in the order they
+ * were sent, which the ICM dictionaries depend on.
+ */
+
+#include "config.h"		/* pick up standard configuration header */
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "april.h"
+#include "process.h"
+#include "dict.h"
+#include "symbols.h"
+#include "astring.h"
+#include "msg.h"
+#include "term.h"
+#include "encoding.h"
+#include "labels.h"
+#include "transport.h"
+
+typedef struct _frame_ *framePo;
+typedef struct _frame_ {
+  byte *data;			/* header and encoded message */
+  long len;
+  logical announce;		/* later frames go in the ring */
+  framePo next;
+} FrameRec;
+
+typedef struct {
+  volatile unsigned long head;	/* bytes written so far */
+  volatile unsigned long tail;	/* bytes read so far */
+  volatile int sleeping;	/* is the reader waiting to be woken? */
+  unsigned long size;		/* size of the data, a power of two */
+} RingHeader, *ringPo;
+
+#define RingData(r) ((byte*)((r)+1))
+
+#define MAXINPUT (TRANSPORTMAXFRAME+9) /* the largest frame and its header */
+
+typedef struct _connection_ *connPo;
+typedef struct _connection_ {
+  int fd;
+  char host[MAX_SYMB_LEN];	/* who we connected to, empty if accepted */
+  int port;
+  logical connecting;		/* waiting for a non-blocking connect */
+  framePo front;		/* frames waiting to be written */
+  framePo back;
+  int queued;			/* how many there are */
+  long sent;			/* how much of the front frame has gone */
+  byte *in;			/* bytes read but not yet decoded */
+  long inLen;
+  long inMax;
+  icmDictPo outDict;		/* each direction has its own dictionary */
+  icmDictPo inDict;
+  ringPo outRing;		/* shared rings with an engine on this host */
+  ringPo inRing;
+  logical ringLive;		/* has the peer been told to read outRing? */
+  logical marked;		/* is the front frame's place in the ring kept? */
+  logical fromRing;		/* does the peer send through inRing? */
+  int bypass;			/* frames to take from the socket first */
+  int waking;			/* bytes of a wake-up frame still to write */
+  char ringPath[MAX_SYMB_LEN];	/* the file behind outRing */
+  connPo next;
+} ConnRec;
+
+typedef struct {
+  uniChar *name;		/* the agent */
+  char host[MAX_SYMB_LEN];	/* where it lives, empty if only learned */
+  int port;
+  struct sockaddr_in addr;	/* resolved when the route is declared */
+  connPo conn;			/* the connection to use, if open */
+} RouteRec, *routePo;
+
+static hashPo routes = NULL;	/* agent name -> route */
+static long learned = 0;	/* number of learned routes */
+static connPo conns = NULL;	/* all open connections */
+static int listenFd = -1;
+
+static void closeConnection(connPo c);
+static void offerRing(connPo c);
+
+static uniChar ringName[] = {'r','i','n','g',0};
+static uniChar ringOkName[] = {'r','i','n','g','o','k',0};
+static uniChar ringOnName[] = {'r','i','n','g','o','n',0};
+
+static byte emptyFrame[] = {trmString|1,0}; /* a mark, or a wake up */
+
+static void setNonBlocking(int fd)
+{
+  fcntl(fd,F_SETFL,fcntl(fd,F_GETFL,0)|O_NONBLOCK);
+}
+
+static connPo newConnection(int fd,char *host,int port,logical connecting)
+{
+  connPo c = (connPo)malloc(sizeof(ConnRec));
+
+  c->fd = fd;
+  strncpy(c->host,host,NumberOf(c->host)-1);
+  c->host[NumberOf(c->host)-1] = '\0';
+  c->port = port;
+  c->connecting = connecting;
+  c->front = c->back = NULL;
+  c->queued = 0;
+  c->sent = 0;
+  c->inMax = 4096;
+  c->in = (byte*)malloc(c->inMax);
+  c->inLen = 0;
+  c->outDict = newIcmDict();
+  c->inDict = newIcmDict();
+  c->outRing = c->inRing = NULL;
+  c->ringLive = c->marked = c->fromRing = False;
+  c->bypass = c->waking = 0;
+  c->ringPath[0] = '\0';
+  c->next = conns;
+  conns = c;
+  return c;
+}
+
+static logical localHost(char *host)
+{
+  char name[MAX_SYMB_LEN];
+
+  if(strcmp(host,"localhost")==0 || strncmp(host,"127.",4)==0)
+    return True;
+  else
+    return gethostname(name,NumberOf(name))==0 && strcmp(name,host)==0;
+}
+
+/* Resolve a host once, so that reconnecting never waits on the name service */
+static logical resolveHost(char *host,int port,struct sockaddr_in *addr)
+{
+  struct addrinfo hints, *res;
+  char service[16];
+
+  memset(&hints,0,sizeof(hints));
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  sprintf(service,"%d",port);
+
+  if(getaddrinfo(host,service,&hints,&res)!=0)
+    return False;
+
+  memcpy(addr,res->ai_addr,sizeof(struct sockaddr_in));
+  freeaddrinfo(res);
+  return True;
+}
+
+/* Connections are pooled -- one per remote engine */
+static connPo openConnection(char *host,int port,struct sockaddr_in *addr)
+{
+  connPo c;
+  int fd;
+
+  for(c=conns;c!=NULL;c=c->next)
+    if(c->port==port && strcmp(c->host,host)==0)
+      return c;
+
+  if((fd=socket(AF_INET,SOCK_STREAM,0))<0)
+    return NULL;
+
+  setNonBlocking(fd);
+
+  if(connect(fd,(struct sockaddr *)addr,sizeof(struct sockaddr_in))!=0 &&
+     errno!=EINPROGRESS){
+    close(fd);
+    return NULL;
+  }
+
+  c = newConnection(fd,host,port,True);
+
+  if(localHost(host))
+    offerRing(c);		/* the fast path between neighbours */
+  return c;
+}
+
+static retCode unRoute(void *n,void *r,void *c)
+{
+  routePo route = (routePo)r;
+
+  if(route->conn==(connPo)c){
+    route->conn = NULL;
+
+    if(route->host[0]=='\0'){	/* a learned route goes with its connection */
+      Uninstall(route->name,routes);
+      free(route->name);
+      free(route);
+      learned--;
+    }
+  }
+  return Ok;
+}
+
+static void closeConnection(connPo c)
+{
+  connPo *cc = &conns;
+
+  while(*cc!=NULL){
+    if(*cc==c){
+      *cc = c->next;
+      break;
+    }
+    cc = &(*cc)->next;
+  }
+
+  if(routes!=NULL)
+    ProcessTable(unRoute,routes,c);
+
+  while(c->front!=NULL){
+    framePo f = c->front;
+
+    c->front = f->next;
+    free(f->data);
+    free(f);
+  }
+
+  if(c->outRing!=NULL){
+    munmap(c->outRing,sizeof(RingHeader)+c->outRing->size);
+    unlink(c->ringPath);	/* in case the peer never mapped it */
+  }
+  if(c->inRing!=NULL)
+    munmap(c->inRing,sizeof(RingHeader)+c->inRing->size);
+
+  close(c->fd);
+  free(c->in);
+  freeIcmDict(c->outDict);
+  freeIcmDict(c->inDict);
+  free(c);
+}
+
+/* The header is the trmString tag and the length, as in encodeInt */
+static int frameHeader(byte *hdr,unsigned long len)
+{
+  byte bytes[16];
+  int n = 0, i;
+
+  do{
+    bytes[n++] = len&0xff;
+    len >>= 8;
+  } while(len>0);
+
+  if(bytes[n-1]&0x80)		/* the first byte is signed */
+    bytes[n++] = 0;
+
+  hdr[0] = trmString|n;
+  for(i=0;i<n;i++)
+    hdr[i+1] = bytes[n-1-i];
+  return n+1;
+}
+
+/* Error if env cannot be encoded -- nothing is queued then */
+static retCode queueFrame(connPo c,objPo env)
+{
+  ioPo tmp = openOutStr(rawEncoding);
+  framePo f;
+  WORD32 blen,i;
+  uniChar *text;
+  byte hdr[16];
+  int hlen;
+
+  if(encodeICM(tmp,env,True,c->outDict)!=Ok){
+    closeFile(tmp);		/* encodeICM has forgotten its new keys */
+    return Error;
+  }
+
+  text = getStrText(O_STRING(tmp),&blen);
+  hlen = frameHeader(hdr,blen);
+
+  f = (framePo)malloc(sizeof(FrameRec));
+  f->len = hlen+blen;
+  f->data = (byte*)malloc(f->len);
+  memcpy(f->data,hdr,hlen);
+  for(i=0;i<blen;i++)
+    f->data[hlen+i] = text[i]&0xff;
+  f->announce = False;
+  f->next = NULL;
+
+  closeFile(tmp);
+
+  if(c->back!=NULL)
+    c->back->next = f;
+  else
+    c->front = f;
+  c->back = f;
+  c->queued++;
+  return Ok;
+}
+
+/* Queue one of the frames that set up a ring: (tag,path) */
+static framePo ringFrame(connPo c,uniChar *tag,char *path)
+{
+  objPo msg = kvoid;
+  objPo el = kvoid;
+  void *root = gcAddRoot(&msg);
+  retCode res;
+
+  gcAddRoot(&el);
+
+  msg = allocateTuple(2);
+  el = newUniSymbol(tag);
+  updateTuple(msg,0,el);
+  el = allocateCString(path);
+  updateTuple(msg,1,el);
+
+  res = queueFrame(c,msg);
+  gcRemoveRoot(root);
+  return res==Ok?c->back:NULL;
+}
+
+/*
+ * Offer the peer a ring to read our frames from. Nothing goes into it
+ * until the peer says that it has mapped it.
+ */
+static void offerRing(connPo c)
+{
+  unsigned long size = TRANSPORTRING;
+  size_t len = sizeof(RingHeader)+size;
+  ringPo r;
+  int fd;
+
+  strcpy(c->ringPath,"/tmp/april-ringXXXXXX");
+
+  if((fd=mkstemp(c->ringPath))<0)
+    return;
+  else if(ftruncate(fd,len)!=0 ||
+	  (r=(ringPo)mmap(NULL,len,PROT_READ|PROT_WRITE,MAP_SHARED,fd,0))==MAP_FAILED){
+    close(fd);
+    unlink(c->ringPath);
+    return;
+  }
+
+  close(fd);
+
+  r->head = r->tail = 0;
+  r->sleeping = 0;
+  r->size = size;
+  c->outRing = r;
+
+  ringFrame(c,ringName,c->ringPath);
+}
+
+/* The peer has mapped our ring: the frames after this one go in it */
+static void startRing(connPo c,objPo path)
+{
+  char fn[MAX_SYMB_LEN];
+  framePo f;
+
+  if(c->outRing==NULL || c->ringLive || !isListOfChars(path))
+    return;
+
+  Cstring(path,fn,NumberOf(fn));
+
+  if(strcmp(fn,c->ringPath)==0 && (f=ringFrame(c,ringOnName,c->ringPath))!=NULL)
+    f->announce = True;
+}
+
+/* Is the other end of a connection on this host? */
+static logical localPeer(int fd)
+{
+  struct sockaddr_in peer, self;
+  socklen_t plen = sizeof(peer), slen = sizeof(self);
+
+  if(getpeername(fd,(struct sockaddr*)&peer,&plen)!=0 ||
+     getsockname(fd,(struct sockaddr*)&self,&slen)!=0 || peer.sin_family!=AF_INET)
+    return False;
+  else
+    return (ntohl(peer.sin_addr.s_addr)>>24)==127 ||
+      peer.sin_addr.s_addr==self.sin_addr.s_addr;
+}
+
+/* Could this be the name of a ring from offerRing? Nothing else will do */
+static logical ringFile(char *fn)
+{
+  char *prefix = "/tmp/april-ring";
+  int i;
+
+  if(strncmp(fn,prefix,strlen(prefix))!=0)
+    return False;
+
+  for(i=0,fn+=strlen(prefix);fn[i]!='\0';i++)
+    if(!isalnum((unsigned char)fn[i]))
+      return False;		/* no '/', no ".." */
+  return i==6;			/* as mkstemp makes them */
+}
+
+/*
+ * Map a ring offered by the peer, and offer one back. The file is only
+ * unlinked once it has passed every check.
+ */
+static void mapRing(connPo c,objPo path)
+{
+  char fn[MAX_SYMB_LEN];
+  struct stat buf;
+  ringPo r;
+  int fd;
+
+  if(c->inRing!=NULL || !isListOfChars(path) || !localPeer(c->fd))
+    return;
+
+  Cstring(path,fn,NumberOf(fn));
+
+  if(!ringFile(fn) || (fd=open(fn,O_RDWR|O_NOFOLLOW))<0)
+    return;
+  else if(fstat(fd,&buf)!=0 || !S_ISREG(buf.st_mode) || buf.st_uid!=getuid() ||
+	  buf.st_size!=sizeof(RingHeader)+TRANSPORTRING ||
+	  (r=(ringPo)mmap(NULL,buf.st_size,PROT_READ|PROT_WRITE,MAP_SHARED,fd,0))==MAP_FAILED){
+    close(fd);
+    return;
+  }
+
+  close(fd);
+
+  if(r->size!=TRANSPORTRING || r->head-r->tail>r->size){
+    munmap(r,buf.st_size);
+    return;
+  }
+
+  unlink(fn);			/* the mappings keep it alive */
+  c->inRing = r;
+  ringFrame(c,ringOkName,fn);	/* the peer may use it now */
+
+  if(c->outRing==NULL)
+    offerRing(c);
+}
+
+/*
+ * Send a message directly if its recipient has a route; Fail means that
+ * the caller should use the mailer instead, Error that the message cannot
+ * be encoded.
+ */
+retCode transportSend(objPo to,objPo sender,objPo opts,objPo msg)
+{
+  routePo route;
+  objPo name;
+
+  if(routes==NULL || !IsHandle(to) || to==knullhandle)
+    return Fail;
+
+  name = handleName(to);
+
+  if(!isSymb(name) || (route=(routePo)Search(SymText(name),routes))==NULL)
+    return Fail;
+
+  {
+    objPo env;
+    void *root = gcAddRoot(&to);
+
+    gcAddRoot(&sender);
+    gcAddRoot(&opts);
+    gcAddRoot(&msg);
+
+    if(route->conn==NULL &&	/* opening may allocate the offer of a ring */
+       (route->conn=openConnection(route->host,route->port,&route->addr))==NULL){
+      gcRemoveRoot(root);
+      return Fail;
+    }
+
+    env = allocateTuple(4);	/* the same envelope as the mailer gets */
+    updateTuple(env,0,to);
+    updateTuple(env,1,sender);
+    updateTuple(env,2,opts);
+    updateTuple(env,3,msg);
+
+    gcRemoveRoot(root);
+
+    if(queueFrame(route->conn,env)!=Ok)
+      return Error;
+  }
+
+  if(route->conn->queued>=TRANSPORTBATCH)
+    flushTransport();
+  return Ok;
+}
+
+static void dropFrame(connPo c)
+{
+  framePo f = c->front;
+
+  if(f->announce)
+    c->ringLive = True;		/* the peer now knows about the ring */
+
+  c->sent = 0;
+  c->marked = False;
+  c->front = f->next;
+  if(c->front==NULL)
+    c->back = NULL;
+  c->queued--;
+  free(f->data);
+  free(f);
+}
+
+/* Copy len bytes into a ring, if there is room for them */
+static logical putRing(ringPo r,byte *src,unsigned long len)
+{
+  byte *data = RingData(r);
+  unsigned long head = r->head;
+  unsigned long off = head&(r->size-1);
+  unsigned long first = r->size-off;
+
+  if(r->size-(head-r->tail)<len)
+    return False;		/* no room until the reader catches up */
+
+  if(first>=len)
+    memcpy(&data[off],src,len);
+  else{
+    memcpy(&data[off],src,first);
+    memcpy(data,src+first,len-first);
+  }
+
+  __sync_synchronize();		/* the frame must be there before head moves */
+  r->head = head+len;
+  return True;
+}
+
+/* Write what is left of the empty frame that wakes up the peer */
+static retCode writeWake(connPo c)
+{
+  while(c->waking>0){
+    ssize_t done = write(c->fd,&emptyFrame[sizeof(emptyFrame)-c->waking],c->waking);
+
+    if(done<0){
+      if(errno==EAGAIN || errno==EWOULDBLOCK || errno==EINTR)
+	return Fail;		/* try again later */
+      else
+	return Error;
+    }
+    c->waking -= done;
+  }
+  return Ok;
+}
+
+/* Copy as many frames as will fit into the ring; Fail if it is full */
+static retCode writeRing(connPo c)
+{
+  ringPo r = c->outRing;
+  logical wrote = False;
+  retCode ret = Ok;
+
+  while(c->front!=NULL && c->front->len<=r->size){
+    if(!putRing(r,c->front->data,c->front->len)){
+      ret = Fail;
+      break;
+    }
+    wrote = True;
+    dropFrame(c);
+  }
+
+  if(wrote){
+    __sync_synchronize();
+
+    if(r->sleeping){		/* an empty frame wakes the reader */
+      r->sleeping = 0;
+      if(c->waking==0)
+	c->waking = sizeof(emptyFrame);
+    }
+  }
+
+  if(c->waking>0){
+    retCode res = writeWake(c);
+
+    if(res!=Ok)
+      return res;
+  }
+  return ret;
+}
+
+static retCode writeConnection(connPo c)
+{
+  if(c->waking>0){		/* finish waking up the peer first */
+    retCode res = writeWake(c);
+
+    if(res!=Ok)
+      return res;
+  }
+
+  while(c->front!=NULL){
+    struct iovec iov[TRANSPORTIOV];
+    framePo f = c->front;
+    int n = 0;
+    ssize_t done;
+
+    if(c->ringLive && c->sent==0 && !c->marked){
+      if(f->len<=c->outRing->size){
+	if(writeRing(c)!=Ok)
+	  return Fail;
+	continue;
+      }
+      else if(!putRing(c->outRing,emptyFrame,sizeof(emptyFrame)))
+	return Fail;		/* an empty frame says look at the socket */
+      else
+	c->marked = True;
+    }
+
+    iov[n].iov_base = f->data+c->sent;
+    iov[n++].iov_len = f->len-c->sent;
+
+    if(!c->ringLive){		/* nothing may follow the switch to the ring */
+      for(;!f->announce && f->next!=NULL && n<TRANSPORTIOV;){
+	f = f->next;
+	iov[n].iov_base = f->data;
+	iov[n++].iov_len = f->len;
+      }
+    }
+
+    if((done=writev(c->fd,iov,n))<0){
+      if(errno==EAGAIN || errno==EWOULDBLOCK || errno==EINTR)
+	return Fail;		/* try again later */
+      else
+	return Error;
+    }
+
+    while(done>0){		/* drop the frames that have gone */
+      f = c->front;
+
+      if(done>=f->len-c->sent){
+	done -= f->len-c->sent;
+	dropFrame(c);
+      }
+      else{
+	c->sent += done;
+	done = 0;
+      }
+    }
+  }
+  return Ok;
+}
+
+void flushTransport(void)
+{
+  connPo c = conns;
+
+  while(c!=NULL){
+    connPo next = c->next;
+
+    if(!c->connecting && (c->front!=NULL || c->waking>0) &&
+       writeConnection(c)==Error){
+      logMsg(logFile,"lost transport connection to %s:%d",c->host,c->port);
+      closeConnection(c);
+    }
+    c = next;
+  }
+}
+
+static int addFds(fd_set *in,fd_set *out,int max)
+{
+  connPo c;
+
+  if(listenFd>=0){
+    FD_SET(listenFd,in);
+    if(listenFd>max)
+      max = listenFd;
+  }
+
+  for(c=conns;c!=NULL;c=c->next){
+    FD_SET(c->fd,in);
+    if(c->connecting || c->front!=NULL || c->waking>0)
+      FD_SET(c->fd,out);
+    if(c->fd>max)
+      max = c->fd;
+  }
+  return max;
+}
+
+/*
+ * The engine is about to wait in select: readers of rings ask to be woken
+ * up. The last transportPoll before the select sees anything that was
+ * written before the writer noticed.
+ */
+void transportSleep(void)
+{
+  connPo c;
+
+  for(c=conns;c!=NULL;c=c->next)
+    if(c->inRing!=NULL)
+      c->inRing->sleeping = 1;
+  __sync_synchronize();
+}
+
+/* Only after the last transportPoll -- it may open and close connections */
+int transportFds(fd_set *in,fd_set *out,int max)
+{
+  return addFds(in,out,max);
+}
+
+/* The engine is busy again, writers need not wake us */
+void transportAwake(void)
+{
+  connPo c;
+
+  for(c=conns;c!=NULL;c=c->next)
+    if(c->inRing!=NULL)
+      c->inRing->sleeping = 0;
+}
+
+/* Hand an incoming message to its recipient */
+static void deliver(connPo c,objPo env)
+{
+  objPo to,sender;
+  processpo p;
+
+  if(IsTuple(env) && tupleArity(env)==2 && isSymb(tupleArg(env,0))){
+    uniChar *tag = SymText(tupleArg(env,0));
+
+    if(uniCmp(tag,ringName)==0)
+      mapRing(c,tupleArg(env,1)); /* the peer is on this host */
+    else if(uniCmp(tag,ringOkName)==0)
+      startRing(c,tupleArg(env,1));
+    else if(uniCmp(tag,ringOnName)==0 && c->inRing!=NULL)
+      c->fromRing = True;	/* what follows this is in the ring */
+    else
+      logMsg(logFile,"invalid message on transport connection");
+    return;
+  }
+  else if(!IsTuple(env) || tupleArity(env)!=4){
+    logMsg(logFile,"invalid message on transport connection");
+    return;
+  }
+
+  to = tupleArg(env,0);
+  sender = tupleArg(env,1);
+
+  if(IsHandle(sender) && sender!=knullhandle && isSymb(handleName(sender))){
+    uniChar *name = SymText(handleName(sender));
+    routePo route = (routePo)Search(name,routes);
+
+    if(route==NULL && learned<TRANSPORTROUTES &&
+       (route=(routePo)malloc(sizeof(RouteRec)))!=NULL){
+      route->name = uniDuplicate(name); /* replies go back the way this came */
+      route->host[0] = '\0';
+      route->port = 0;
+      route->conn = c;
+      Install(route->name,route,routes);
+      learned++;
+    }
+  }
+
+  if((p=handleProc(to))!=NULL)
+    LocalMsg(p,tupleArg(env,3),sender,tupleArg(env,2));
+  else
+    logMsg(logFile,"message for %w discarded",to);
+}
+
+static retCode decodeFrame(connPo c,uniChar *text,long len)
+{
+  objPo env = kvoid;
+  void *root = gcAddRoot(&env);
+  ioPo str = openInStr(text,len,rawEncoding);
+  retCode res = decodeICM(str,&env,verifyCode,c->inDict);
+
+  closeFile(str);
+
+  if(res==Ok)
+    deliver(c,env);
+  gcRemoveRoot(root);
+  return res;
+}
+
+/*
+ * Decode the frames in the ring from a neighbour, up to one that was sent
+ * over the socket instead. Ok if we got anything, Fail if not.
+ */
+static retCode readRing(connPo c)
+{
+  ringPo r = c->inRing;
+  byte *data = RingData(r);
+  unsigned long mask = r->size-1;
+  retCode ret = Fail;
+
+  while(c->bypass==0){
+    unsigned long tail = r->tail;
+    unsigned long avail = r->head-tail;
+    unsigned long len = 0;
+    int n,i;
+
+    __sync_synchronize();	/* see the frame that head covers */
+
+    if(avail==0)
+      break;
+
+    n = data[tail&mask]&0x0f;
+
+    if((data[tail&mask]&0xf0)!=trmString || n==0 || n>8 || avail<n+1)
+      return Error;
+
+    for(i=1;i<=n;i++)
+      len = (len<<8)|data[(tail+i)&mask];
+
+    if(len>TRANSPORTMAXFRAME || avail<n+1+len)
+      return Error;		/* the writer only writes whole frames */
+    else if(len==0)
+      c->bypass++;		/* the next frame is on the socket */
+    else{
+      uniChar *text = (uniChar*)malloc(sizeof(uniChar)*(len+1));
+      retCode res;
+
+      if(text==NULL)
+	break;			/* leave it in the ring until later */
+
+      for(i=0;i<len;i++)
+	text[i] = data[(tail+n+1+i)&mask];
+
+      res = decodeFrame(c,text,len);
+      free(text);
+
+      if(res!=Ok)
+	return Error;
+    }
+
+    __sync_synchronize();
+    r->tail = tail+n+1+len;	/* only now may the writer reuse it */
+    ret = Ok;
+  }
+  return ret;
+}
+
+/* Read what has arrived on a connection */
+static retCode readSocket(connPo c)
+{
+  for(;;){
+    ssize_t got;
+
+    if(c->inLen==c->inMax){
+      long max = c->inMax+(c->inMax>>1);
+      byte *in;
+
+      if(c->inMax>=MAXINPUT)
+	return Ok;		/* decode some before reading any more */
+      else if(max>MAXINPUT)
+	max = MAXINPUT;
+
+      if((in=(byte*)realloc(c->in,max))==NULL)
+	return Ok;		/* decode what we have */
+      c->in = in;
+      c->inMax = max;
+    }
+
+    if((got=read(c->fd,c->in+c->inLen,c->inMax-c->inLen))==0)
+      return Eof;
+    else if(got<0){
+      if(errno==EAGAIN || errno==EWOULDBLOCK || errno==EINTR)
+	return Ok;
+      return Error;
+    }
+    c->inLen += got;
+  }
+}
+
+/*
+ * Decode the complete frames that have arrived on a connection, unless
+ * the ring has frames that come first. Ok if we got anything, Fail if not.
+ */
+static retCode readFrames(connPo c)
+{
+  retCode ret = Fail;
+
+  for(;;){
+    int n,i;
+    unsigned long len = 0;
+    long start = 0;
+
+    if(c->inLen<1)
+      break;
+
+    n = c->in[0]&0x0f;
+
+    if((c->in[0]&0xf0)!=trmString || n==0 || n>8)
+      return Error;
+    else if(c->inLen<n+1)
+      break;
+
+    for(i=1;i<=n;i++)
+      len = (len<<8)|c->in[i];
+
+    if(len>TRANSPORTMAXFRAME)
+      return Error;
+
+    start = n+1;
+
+    if(len>0 && c->fromRing && c->bypass==0)
+      break;			/* its place in the ring not reached yet */
+
+    if(c->inLen<start+len){
+      byte *in;
+
+      if(c->inMax<start+len &&	/* make room for the whole frame */
+	 (in=(byte*)realloc(c->in,start+len))!=NULL){
+	c->in = in;
+	c->inMax = start+len;
+      }
+      break;
+    }
+
+    if(len>0){			/* empty frames just wake us up */
+      uniChar *text = (uniChar*)malloc(sizeof(uniChar)*(len+1));
+      retCode res;
+
+      if(text==NULL)
+	break;			/* leave it in the buffer until later */
+
+      for(i=0;i<len;i++)
+	text[i] = c->in[start+i];
+
+      if(c->fromRing)
+	c->bypass--;
+
+      res = decodeFrame(c,text,len);
+      free(text);
+
+      if(res!=Ok)
+	return Error;
+      ret = Ok;
+    }
+
+    memmove(c->in,c->in+start+len,c->inLen-start-len);
+    c->inLen -= start+len;
+  }
+  return ret;
+}
+
+/* Decode the frames from the socket and the ring in the order they were sent */
+static retCode readInput(connPo c)
+{
+  retCode sock, ring;
+
+  do{
+    if((sock=readFrames(c))==Error)
+      return Error;
+    else if(c->fromRing && (ring=readRing(c))==Error)
+      return Error;
+    else if(!c->fromRing)
+      ring = Fail;
+  } while(sock==Ok || ring==Ok);
+
+  return Ok;
+}
+
+/*
+ * Called when the engine is prepared to allocate: accept new connections,
+ * finish connecting, read and deliver incoming messages.
+ */
+void transportPoll(void)
+{
+  fd_set in, out;
+  struct timeval period;
+  int max;
+  connPo c;
+
+  if(listenFd<0 && conns==NULL)
+    return;
+
+  c = conns;
+  while(c!=NULL){		/* the neighbours first -- no system calls */
+    connPo next = c->next;
+
+    if(c->fromRing && readInput(c)!=Ok){
+      logMsg(logFile,"corrupt transport ring");
+      closeConnection(c);
+    }
+    c = next;
+  }
+
+  FD_ZERO(&in);
+  FD_ZERO(&out);
+  max = addFds(&in,&out,-1);
+
+  period.tv_sec = 0;
+  period.tv_usec = 0;
+
+  if(select(max+1,&in,&out,NULL,&period)<=0)
+    return;
+
+  if(listenFd>=0 && FD_ISSET(listenFd,&in)){
+    int fd;
+
+    while((fd=accept(listenFd,NULL,NULL))>=0){
+      int one = 1;
+
+      setNonBlocking(fd);
+      setsockopt(fd,IPPROTO_TCP,TCP_NODELAY,&one,sizeof(one));
+      newConnection(fd,"",0,False);
+    }
+  }
+
+  c = conns;
+  while(c!=NULL){
+    connPo next = c->next;
+
+    if(c->connecting && FD_ISSET(c->fd,&out)){
+      int err = 0;
+      socklen_t len = sizeof(err);
+
+      if(getsockopt(c->fd,SOL_SOCKET,SO_ERROR,&err,&len)!=0 || err!=0){
+	logMsg(logFile,"cannot connect to %s:%d",c->host,c->port);
+	closeConnection(c);
+	c = next;
+	continue;
+      }
+      else{
+	int one = 1;
+
+	setsockopt(c->fd,IPPROTO_TCP,TCP_NODELAY,&one,sizeof(one));
+	c->connecting = False;
+      }
+    }
+
+    if(FD_ISSET(c->fd,&in) && (readSocket(c)!=Ok || readInput(c)!=Ok ||
+			       c->inLen>=MAXINPUT)){
+      closeConnection(c);
+      c = next;
+      continue;
+    }
+
+    c = next;
+  }
+
+  flushTransport();
+}
+
+/*
+ * __transport_listen(port)
+ *
+ * accept native transport connections on a port
+ */
+retCode m_transport_listen(processpo p,objPo *args)
+{
+  if(!p->priveleged)
+    return liberror("__transport_listen",1,"permission denied",eprivileged);
+  else if(!IsInteger(args[0]))
+    return liberror("__transport_listen",1,"argument should be an integer",einval);
+  else if(listenFd>=0)
+    return liberror("__transport_listen",1,"already listening",efail);
+  else{
+    struct sockaddr_in addr;
+    int one = 1;
+    int fd = socket(AF_INET,SOCK_STREAM,0);
+
+    if(fd<0)
+      return liberror("__transport_listen",1,"cant create socket",esystem);
+
+    setsockopt(fd,SOL_SOCKET,SO_REUSEADDR,&one,sizeof(one));
+
+    memset(&addr,0,sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(IntVal(args[0]));
+
+    if(bind(fd,(struct sockaddr*)&addr,sizeof(addr))!=0 || listen(fd,16)!=0){
+      close(fd);
+      return liberror("__transport_listen",1,"cant listen on port",enet);
+    }
+
+    setNonBlocking(fd);
+    listenFd = fd;
+
+    if(routes==NULL)
+      routes = NewHash(64,NULL,(compFun)uniCmp,NULL);
+    return Ok;
+  }
+}
+
+/*
+ * __transport_route(name,host,port)
+ *
+ * send messages for the agent name directly to the engine at host:port
+ */
+retCode m_transport_route(processpo p,objPo *args)
+{
+  if(!p->priveleged)
+    return liberror("__transport_route",3,"permission denied",eprivileged);
+  else if(!isSymb(args[2]))
+    return liberror("__transport_route",3,"1st argument should be a symbol",einval);
+  else if(!isListOfChars(args[1]))
+    return liberror("__transport_route",3,"2nd argument should be a string",einval);
+  else if(!IsInteger(args[0]) || IntVal(args[0])<=0)
+    return liberror("__transport_route",3,"3rd argument should be a port number",einval);
+  else{
+    uniChar *name = SymText(args[2]);
+    char host[MAX_SYMB_LEN];
+    struct sockaddr_in addr;
+    routePo route;
+
+    Cstring(args[1],host,NumberOf(host));
+
+    if(!resolveHost(host,IntVal(args[0]),&addr))
+      return liberror("__transport_route",3,"cant find host",enet);
+
+    if(routes==NULL)
+      routes = NewHash(64,NULL,(compFun)uniCmp,NULL);
+
+    if((route=(routePo)Search(name,routes))==NULL){
+      route = (routePo)malloc(sizeof(RouteRec));
+      route->name = uniDuplicate(name);
+      Install(route->name,route,routes);
+    }
+    else if(route->host[0]=='\0')
+      learned--;		/* an explicit route replaces a learned one */
+
+    strcpy(route->host,host);
+    route->port = IntVal(args[0]);
+    route->addr = addr;
+    route->conn = openConnection(route->host,route->port,&route->addr);
+
+    if(route->conn==NULL)
+      return liberror("__transport_route",3,"cant connect to host",enet);
+    return Ok;
+  }
+}
@@ -0,0 +1,401 @@
+/*
+  Cache of verified code segments
+  (c) 1994-2003 Imperial College and F.G.McCabe
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+  Contact: Francis McCabe <fgm@fla.fujitsu.com>
+*/
+
+/*
+ * Apart from its signature, which is checked every time, the verifier only
+ * looks at a code segment's instructions, the kinds of its literals and its
+ * form and arities. A SHA-256 digest of those -- and of the engine's
+ * identity -- identifies a segment that has been verified before; digests
+ * of verified segments are kept in a file so that later runs can skip the
+ * verifier.
+ *
+ * The engine's identity is a digest of its version, VERIFYVERSION and the
+ * instruction set. The file starts with it; a file written by another
+ * engine is started afresh. Since an entry in the file lets code
+ * in unverified, the file must be ours and writable by nobody else.
+ */
+
+#include "config.h"		/* pick up standard configuration header */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/param.h>
+
+#include "april.h"
+#include "types.h"
+#include "term.h"
+#include "handle.h"
+
+#define VCACHEINIT 1024		/* Initial size of the table of digests */
+
+typedef unsigned char digest[DIGESTLEN];
+
+typedef struct {
+  unsigned WORD32 h[8];		/* chaining state */
+  unsigned char buf[64];	/* partial block */
+  unsigned long len;		/* bytes hashed so far */
+} ShaRec, *shaPo;
+
+char *verifyCacheFile = NULL;	/* Where verified digests are kept */
+
+static digest *table = NULL;	/* open hash table of verified digests */
+static unsigned long tableSize = 0;
+static unsigned long tableCount = 0;
+static int cacheFd = -1;	/* the cache file, open for append */
+static logical cacheOpen = False;
+static digest engineDigest;	/* identifies this engine */
+
+/* SHA-256 */
+
+static const unsigned WORD32 shaK[64] = {
+  0x428a2f98,0x71374491,0xb5c0fbcf,0xe9b5dba5,0x3956c25b,0x59f111f1,0x923f82a4,0xab1c5ed5,
+  0xd807aa98,0x12835b01,0x243185be,0x550c7dc3,0x72be5d74,0x80deb1fe,0x9bdc06a7,0xc19bf174,
+  0xe49b69c1,0xefbe4786,0x0fc19dc6,0x240ca1cc,0x2de92c6f,0x4a7484aa,0x5cb0a9dc,0x76f988da,
+  0x983e5152,0xa831c66d,0xb00327c8,0xbf597fc7,0xc6e00bf3,0xd5a79147,0x06ca6351,0x14292967,
+  0x27b70a85,0x2e1b2138,0x4d2c6dfc,0x53380d13,0x650a7354,0x766a0abb,0x81c2c92e,0x92722c85,
+  0xa2bfe8a1,0xa81a664b,0xc24b8b70,0xc76c51a3,0xd192e819,0xd6990624,0xf40e3585,0x106aa070,
+  0x19a4c116,0x1e376c08,0x2748774c,0x34b0bcb5,0x391c0cb3,0x4ed8aa4a,0x5b9cca4f,0x682e6ff3,
+  0x748f82ee,0x78a5636f,0x84c87814,0x8cc70208,0x90befffa,0xa4506ceb,0xbef9a3f7,0xc67178f2
+};
+
+#define ROR(x,n) (((x)>>(n))|((x)<<(32-(n))))
+
+static void shaInit(shaPo s)
+{
+  static const unsigned WORD32 h0[8] = {
+    0x6a09e667,0xbb67ae85,0x3c6ef372,0xa54ff53a,
+    0x510e527f,0x9b05688c,0x1f83d9ab,0x5be0cd19
+  };
+
+  memcpy(s->h,h0,sizeof(h0));
+  s->len = 0;
+}
+
+static void shaBlock(shaPo s,const unsigned char *p)
+{
+  unsigned WORD32 w[64];
+  unsigned WORD32 a,b,c,d,e,f,g,h;
+  int i;
+
+  for(i=0;i<16;i++)
+    w[i] = ((unsigned WORD32)p[4*i]<<24)|(p[4*i+1]<<16)|(p[4*i+2]<<8)|p[4*i+3];
+
+  for(;i<64;i++){
+    unsigned WORD32 s0 = ROR(w[i-15],7)^ROR(w[i-15],18)^(w[i-15]>>3);
+    unsigned WORD32 s1 = ROR(w[i-2],17)^ROR(w[i-2],19)^(w[i-2]>>10);
+
+    w[i] = w[i-16]+s0+w[i-7]+s1;
+  }
+
+  a = s->h[0]; b = s->h[1]; c = s->h[2]; d = s->h[3];
+  e = s->h[4]; f = s->h[5]; g = s->h[6]; h = s->h[7];
+
+  for(i=0;i<64;i++){
+    unsigned WORD32 t1 = h+(ROR(e,6)^ROR(e,11)^ROR(e,25))+((e&f)^(~e&g))+shaK[i]+w[i];
+    unsigned WORD32 t2 = (ROR(a,2)^ROR(a,13)^ROR(a,22))+((a&b)^(a&c)^(b&c));
+
+    h = g; g = f; f = e; e = d+t1;
+    d = c; c = b; b = a; a = t1+t2;
+  }
+
+  s->h[0] += a; s->h[1] += b; s->h[2] += c; s->h[3] += d;
+  s->h[4] += e; s->h[5] += f; s->h[6] += g; s->h[7] += h;
+}
+
+static void shaUpdate(shaPo s,const void *data,unsigned long len)
+{
+  const unsigned char *p = (const unsigned char*)data;
+
+  while(len>0){
+    unsigned long off = s->len%64;
+    unsigned long n = 64-off;
+
+    if(n>len)
+      n = len;
+
+    memcpy(&s->buf[off],p,n);
+    s->len += n;
+    p += n;
+    len -= n;
+
+    if(s->len%64==0)
+      shaBlock(s,s->buf);
+  }
+}
+
+static void shaFinal(shaPo s,digest out)
+{
+  unsigned long bits = s->len*8;
+  unsigned char pad = 0x80;
+  unsigned char lenBuf[8];
+  int i;
+
+  shaUpdate(s,&pad,1);
+  pad = 0;
+  while(s->len%64!=56)
+    shaUpdate(s,&pad,1);
+
+  for(i=0;i<8;i++)
+    lenBuf[i] = (bits>>(56-8*i))&0xff;
+  shaUpdate(s,lenBuf,8);
+
+  for(i=0;i<8;i++){
+    out[4*i] = s->h[i]>>24;
+    out[4*i+1] = s->h[i]>>16;
+    out[4*i+2] = s->h[i]>>8;
+    out[4*i+3] = s->h[i];
+  }
+}
+
+/* The digest of a file's contents */
+logical fileDigest(char *file,unsigned char *d)
+{
+  unsigned char buf[4096];
+  ssize_t got;
+  ShaRec sha;
+  int fd;
+
+  if((fd=open(file,O_RDONLY))<0)
+    return False;
+
+  shaInit(&sha);
+
+  while((got=read(fd,buf,sizeof(buf)))>0)
+    shaUpdate(&sha,buf,got);
+
+  close(fd);
+
+  if(got<0)
+    return False;
+
+  shaFinal(&sha,d);
+  return True;
+}
+
+/* The table of verified digests */
+
+static unsigned long digestHash(digest d)
+{
+  return ((unsigned long)d[0]<<24|d[1]<<16|d[2]<<8|d[3])%tableSize;
+}
+
+static logical isEmpty(digest d)
+{
+  int i;
+
+  for(i=0;i<DIGESTLEN;i++)
+    if(d[i]!=0)
+      return False;
+  return True;
+}
+
+static logical findDigest(digest d)
+{
+  unsigned long h;
+
+  if(tableCount==0)
+    return False;
+
+  for(h=digestHash(d);!isEmpty(table[h]);h=(h+1)%tableSize)
+    if(memcmp(table[h],d,DIGESTLEN)==0)
+      return True;
+  return False;
+}
+
+static void installDigest(digest d)
+{
+  unsigned long h;
+
+  if((tableCount+1)*2>tableSize){	/* keep the table half empty */
+    digest *old = table;
+    unsigned long oldSize = tableSize;
+    unsigned long i;
+
+    tableSize = (oldSize==0?VCACHEINIT:oldSize*2);
+    table = (digest*)calloc(tableSize,sizeof(digest));
+    tableCount = 0;
+
+    for(i=0;i<oldSize;i++)
+      if(!isEmpty(old[i]))
+	installDigest(old[i]);
+    free(old);
+  }
+
+  for(h=digestHash(d);!isEmpty(table[h]);h=(h+1)%tableSize)
+    if(memcmp(table[h],d,DIGESTLEN)==0)
+      return;
+
+  memcpy(table[h],d,DIGESTLEN);
+  tableCount++;
+}
+
+/* The cache file */
+
+static void engineIdentity(void)
+{
+  extern char version[];
+  WORD32 vers = VERIFYVERSION;
+  WORD32 opc;
+  ShaRec sha;
+
+  shaInit(&sha);
+  shaUpdate(&sha,version,strlen(version));
+  shaUpdate(&sha,&vers,sizeof(vers));
+
+#undef instruction
+#define instruction(mnem,op,sig,tp) \
+  opc = op; \
+  shaUpdate(&sha,&opc,sizeof(opc)); \
+  shaUpdate(&sha,#mnem,sizeof(#mnem)); \
+  shaUpdate(&sha,sig,sizeof(sig)); \
+  shaUpdate(&sha,tp,sizeof(tp));
+
+#include "instructions.h"
+#undef instruction
+
+  shaFinal(&sha,engineDigest);
+}
+
+static void openCache(void)
+{
+  char fn[MAXPATHLEN];
+  char *file = verifyCacheFile;
+  struct stat buf;
+
+  cacheOpen = True;
+  engineIdentity();
+
+  if(file==NULL){
+    char *home = getenv("HOME");
+
+    if(home==NULL)
+      return;
+    sprintf(fn,"%.*s/.april-verified",(int)(NumberOf(fn)-20),home);
+    file = fn;
+  }
+  else if(*file=='\0')
+    return;			/* caching is turned off */
+
+  if((cacheFd=open(file,O_RDWR|O_CREAT,0600))<0)
+    return;
+  else if(fstat(cacheFd,&buf)!=0 || !S_ISREG(buf.st_mode) ||
+	  buf.st_uid!=geteuid() || (buf.st_mode&(S_IWGRP|S_IWOTH))!=0){
+    logMsg(logFile,"ignoring unsafe verification cache %s",file);
+    close(cacheFd);
+    cacheFd = -1;
+    return;
+  }
+  else{
+    digest d;
+    long entries = 0;
+
+    if(read(cacheFd,d,DIGESTLEN)!=DIGESTLEN || memcmp(d,engineDigest,DIGESTLEN)!=0){
+      /* Empty, damaged, or from another engine */
+      if(ftruncate(cacheFd,0)!=0 || lseek(cacheFd,0,SEEK_SET)!=0 ||
+	 write(cacheFd,engineDigest,DIGESTLEN)!=DIGESTLEN){
+	close(cacheFd);
+	cacheFd = -1;
+      }
+      return;
+    }
+
+    while(read(cacheFd,d,DIGESTLEN)==DIGESTLEN){
+      installDigest(d);
+      entries++;
+    }
+
+    /* a torn last entry is overwritten */
+    lseek(cacheFd,DIGESTLEN+entries*DIGESTLEN,SEEK_SET);
+  }
+}
+
+/* Compute the digest of what the verifier looks at */
+static void codeDigest(objPo code,logical allow_priv,digest d)
+{
+  WORD32 litcnt = CodeLitcnt(code);
+  objPo *lits = CodeLits(code);
+  WORD32 vals[5];
+  ShaRec sha;
+  int i;
+
+  vals[0] = CodeSize(code);
+  vals[1] = litcnt;
+  vals[2] = CodeForm(code);
+  vals[3] = CodeArity(code);
+  vals[4] = progTypeArity(CodeFrSig(code));
+
+  shaInit(&sha);
+  shaUpdate(&sha,engineDigest,DIGESTLEN);
+  shaUpdate(&sha,&allow_priv,sizeof(allow_priv));
+  shaUpdate(&sha,vals,sizeof(vals));
+  shaUpdate(&sha,CodeCode(code),CodeSize(code)*sizeof(WORD32));
+
+  for(i=0;i<litcnt;i++){
+    objPo lit = lits[i];
+    char kind;
+
+    if(isListOfChars(lit))
+      kind = 's';
+    else if(isSymb(lit))
+      kind = 'y';
+    else if(IsFloat(lit))
+      kind = 'f';
+    else if(IsInteger(lit))
+      kind = 'i';
+    else if(IsHandle(lit))
+      kind = 'h';
+    else
+      kind = '?';
+    shaUpdate(&sha,&kind,1);
+  }
+
+  shaFinal(&sha,d);
+}
+
+/* Verify code, unless it has been verified before */
+char *verifyCached(objPo code,logical allow_priv)
+{
+  digest d;
+  char *msg;
+
+  if(!cacheOpen)
+    openCache();
+
+  if(cacheFd<0)
+    return codeVerify(code,allow_priv);
+
+  codeDigest(code,allow_priv,d);
+
+  if(findDigest(d))
+    return sigVerify(code);
+  else if((msg=codeVerify(code,allow_priv))==NULL){
+    installDigest(d);
+    if(write(cacheFd,d,DIGESTLEN)!=DIGESTLEN){
+      close(cacheFd);		/* stop using a cache we cant write */
+      cacheFd = -1;
+    }
+  }
+  return msg;
+}
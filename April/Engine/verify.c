@@ -197,6 +197,10 @@ static void set_depth(varpo fp,int limit,int depth)
   if(pc<start || pc>end)\
     return "illegal destination of branch";
 
+#define check_fused(pc,end,op)\
+  if(pc>=end || op_cde(*pc)!=op)\
+    return "superinstruction not followed by its instruction";
+
 /* Which instructions use more than one instruction word? */
 static logical _single_check(insPo pc)
 {
@@ -449,6 +453,11 @@ static segPo splitPhase(insPo code,WORD32 length,WORD32 *count)
     case ineq:			/* Test two integers for inequality */
     case ile:			/* Test two integers for less than */
     case igt:			/* Test two integers for gt than */
+    case ieqjmp:		/* Superinstructions that test ... */
+    case ineqjmp:
+    case ilejmp:
+    case igtjmp:
+    case mlistjmp:		/* ... and execute their jmp */
       condIns = True;		/* The following instruction may be executed */
       continue;
       
@@ -675,6 +684,7 @@ static char *verifySegment(segPo base,segPo seg,int limit,
     }
 
     case call:			/* Call a local procedure */
+    case tcall:			/* verified as a call -- it may be one */
       check_inited(fp,ar,limit,op_sl_val(pcx)); /* Inited reference? */
       check_depth(fp,limit,op_sh_val(pcx)); /* Validate stack depth */
       check_arity(fp,op_m_val(pcx),ar,op_sh_val(pcx),limit); /* Check arity of call */
@@ -682,6 +692,7 @@ static char *verifySegment(segPo base,segPo seg,int limit,
       break;
 
     case ecall:			/* Call a procedure from env */
+    case etcall:
       check_env(free,op_sl_val(pcx)); /* Check reference to environment */
       check_depth(fp,limit,op_sh_val(pcx)); /* Check stack depth */
       check_arity(fp,op_sm_val(pcx),ar,op_sh_val(pcx),limit); /* Check arity of call */
@@ -1095,6 +1106,45 @@ static char *verifySegment(segPo base,segPo seg,int limit,
       condIns = True;
       continue;
 
+      /* Superinstructions -- the instruction that follows is checked too */
+    case ieqjmp:		/* ieq and its jmp */
+    case ineqjmp:		/* ineq and its jmp */
+    case ilejmp:		/* ile and its jmp */
+    case igtjmp:		/* igt and its jmp */
+      check_inited(fp,ar,limit,op_sl_val(pcx));
+      check_inited(fp,ar,limit,op_sm_val(pcx));
+      check_fused(pc,end_code,jmp);
+      condIns = True;
+      continue;
+
+    case mlistjmp:		/* mlist and its failure jmp */
+      check_inited(fp,ar,limit,op_sh_val(pcx));
+      set_inited(fp,ar,limit,op_sm_val(pcx));
+      set_inited(fp,ar,limit,op_sl_val(pcx));
+      check_fused(pc,end_code,jmp);
+      condIns = True;
+      continue;
+
+    case movlesc:		/* movl and its esc_fun */
+      check_lit(litcnt,op_o_val(pcx));
+      set_inited(fp,ar,limit,op_sh_val(pcx));
+      check_fused(pc,end_code,esc_fun);
+      break;
+
+    case emovecall:		/* emove and its call */
+      check_env(free,op_sm_val(pcx));
+      set_inited(fp,ar,limit,op_sl_val(pcx));
+      check_fused(pc,end_code,call);
+      break;
+
+    case lstprs:		/* lstpr and the next lstpr */
+      check_inited(fp,ar,limit,op_sh_val(pcx));
+      check_inited(fp,ar,limit,op_sm_val(pcx));
+      set_inited(fp,ar,limit,op_sl_val(pcx));
+      if(pc>=end_code || op_cde(*pc)!=lstpr)
+	check_fused(pc,end_code,lstprs);
+      break;
+
     case iftrue:		/* does a var contain true? */
       check_inited(fp,ar,limit,op_sh_val(pcx));
       check_jump(start,end_code,pc+op_so_val(pcx));
@@ -1246,6 +1296,31 @@ static char *verifySegment(segPo base,segPo seg,int limit,
   return NULL;
 }
 
+/* Check that the signature of code fits its form */
+char *sigVerify(objPo code)
+{
+  objPo type = CodeSig(code);
+
+  while(isBinCall(type=deRefVar(type),kallQ,NULL,&type))
+    ;
+
+  switch(CodeForm(code)){
+  case function:
+    if(!isBinCall(type,kfunTp,NULL,NULL))
+      return "invalid function code";
+    else
+      break;
+  case procedure:
+    if(!isConstructor(type,kprocTp))
+      return "invalid procedure code";
+    else
+      break;
+  case invalid_code:
+    return "invalid type of code";
+  }
+  return NULL;
+}
+
 /* return a string indicating error, or NULL */
 char *codeVerify(objPo code,logical allow_priv)
 {
@@ -1260,7 +1335,6 @@ char *codeVerify(objPo code,logical allow_priv)
     int limit=1;		/* Maximum env reached in code */
     insPo pc = CodeCode(code);	/* Starting point of real code */
     insPo end_code = pc+size;
-    objPo type = CodeSig(code);
     WORD32 segCount = 0;
     segPo segments = splitPhase(pc,end_code-pc,&segCount);
     varpo fp = &segments->variables[LOCAL];
@@ -1271,24 +1345,9 @@ char *codeVerify(objPo code,logical allow_priv)
 
     if(free<0 || free>MAXPAR)
       return "invalid number of free variables";
-      
-    while(isBinCall(type=deRefVar(type),kallQ,NULL,&type))
-      ;
 
-    switch(CodeForm(code)){
-    case function:
-      if(!isBinCall(type,kfunTp,NULL,NULL))
-	return "invalid function code";
-      else
-	break;
-    case procedure:
-      if(!isConstructor(type,kprocTp))
-	return "invalid procedure code";
-      else
-	break;
-    case invalid_code:
-      return "invalid type of code";
-    }
+    if((ret=sigVerify(code))!=NULL)
+      return ret;
 
     for(i=0;i<MAXVAR;i++){
       segments->variables[i].inited = False; /* All variables start off uninited */
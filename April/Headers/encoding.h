@@ -26,7 +26,15 @@ typedef enum {trmVariable=0x0, trmInt=0x10, trmFlt=0x20, trmNegFlt=0x30, trmSym=
 	      trmString=0x60, trmCode=0x70,
 	      trmNil=0x80, trmList=0x81, trmHdl=0x83, trmSigned=0x84,
 	      trmStruct=0x90,
-	      trmTag=0xa0, trmRef=0xb0, trmShort=0xc0} icmElTag;
+	      trmTag=0xa0, trmRef=0xb0, trmShort=0xc0,
+	      trmDict=0xd0, trmDictRef=0xe0} icmElTag;
+
+/*
+ * trmDict n <term> enters a symbol or ground type signature into the
+ * stream's dictionary as entry n; trmDictRef n refers to it afterwards.
+ * Encoders only emit them on streams that have agreed to use them.
+ */
+#define ICMDICTMAX 4096		/* Most entries in a dictionary */
 
 #endif
 
@@ -37,6 +37,8 @@
   pescape("_set_file_manager",m_file_manager,12,True,"PT\1h");/* set file mgr */
   fescape("_mailer",m_mailer,13,False,"Fth");/* mailer process */
   pescape("_set_mailer",m_set_mailer,14,True,"PT\1h"); /* set mailer */
+  pescape("_mailbox",m_mailbox,35,False,"PT\2Ns"); /* bound the mailbox */
+  fescape("_msg_stats",m_msg_stats,37,False,"FT\1hT\6NNNLNNN"); /* mailbox statistics */
   fescape("_monitor",m_monitor,15,False,"Fth");
   pescape("_set_monitor",m_set_monitor,16,True,"PT\1h");/* set monitor */
 
@@ -71,6 +73,12 @@
   fescape("gensym2",m_gensym2,55,False,"FT\1Ss"); 
 
   fescape("++",m_app,57,False,"FT\2SSS");  /* Synonym for append  */
+
+  fescape("__mmap",m_mmap,58,True,"FT\1SO"); /* map a file into memory */
+  fescape("__mmap_size",m_mmap_size,59,True,"FT\1ON"); /* size of a mapped file */
+  fescape("__mmap_slice",m_mmap_slice,60,True,"FT\3ONNO"); /* part of a mapped file */
+  fescape("__mmap_string",m_mmap_string,61,True,"FT\3ONNS"); /* mapped region as string */
+  fescape("__mmap_line",m_mmap_line,62,True,"FT\2ONT\2SN"); /* line of a mapped file */
   
   /* Character class escapes */
 
@@ -114,6 +122,7 @@
   fescape("str2utf",m_str2utf,100,False,"FT\1SLN"); // convert string to list of utf8 codes 
 
   fescape("sencode",m_sencode,101,False,"FT\1AS");
+  fescape("_sencode_tree",m_sencode_tree,38,False,"FT\1AS");
   fescape("sdecode",m_sdecode,102,False,"FT\1SA");
 
   fescape("num2str",m_num2str,103,False,"FT\6NNNcllS"); /* format a number */
@@ -148,6 +157,7 @@
   fescape("__read",m_read,130,True,":\1FT\1O$\1"); /* read a term */
   pescape("__encode",m_encode,131,True,":\1PT\2O$\1"); /* encode a term to output */
   fescape("__decode",m_decode,132,True,":\1FT\1O$\1"); /* decode an input term */
+  pescape("__icm_dictionary",m_icm_dictionary,39,True,"PT\1O"); /* encode with a dictionary */
   fescape("__tell",m_ftell,133,True,"FT\1ON"); /* report file position */
 // 134 is inchars
   pescape("__flush",m_flush,135,True,"PT\1O"); /* flush the I/O buffer */
@@ -159,6 +169,7 @@
   fescape("__stat",m_fstat,139,True,"FT\1S" FILE_STAT); /*file status*/
   pescape("__rm",m_frm,140,True,"PT\1S"); /* remove file */
   pescape("__mv",m_fmv,141,True,"PT\2SS"); /* rename file */
+  fescape("__sendfile",m_sendfile,142,True,"FT\3OONN"); /* copy file to file */
   pescape("__mkdir",m_fmkdir,143,True,"PT\2SL"FIL_MODE); /* create directory */
   pescape("__chmod",m_chmod,144,True,"PT\2SL"FIL_MODE); /* modifies permissions */
   fescape("__file_type",m_file_type,145,True,"FT\1S"FILE_TYPE); /* type of file */
@@ -168,6 +179,9 @@
 
   // used in bootstrap
   fescape("_load_code_",m_load,150,True,"FT\1SFT\2FT\1SASA"); /* special function to load code */
+  fescape("_load_lazy_",m_load_lazy,24,True,"FT\1SFT\2FT\1SASA"); /* load code as it is called */
+
+  pescape("__stats",m_stats,25,True,"PT\1l"); /* write out the execution profile */
 
   /* Socket handling functions */
   fescape("_listen",m_listen,151,True,"FT\1NO");
@@ -194,13 +208,18 @@
   /* send message */
   pescape("_send",m_send,166,False,"PT\3hLu'" MSG_ATTR_TYPE "'A");
   pescape("__send",m_send2,167,True,"PT\4hLu'" MSG_ATTR_TYPE "'Ah");
+  pescape("_multicast",m_multicast,36,False,"PT\3LhLu'" MSG_ATTR_TYPE "'A");
   pescape("_front_msg",m_front_msg,168,False,"PT\3ALu'" MSG_ATTR_TYPE "'h");/* msg on front */
+  pescape("__transport_listen",m_transport_listen,48,True,"PT\1N"); /* accept remote engines */
+  pescape("__transport_route",m_transport_route,49,True,"PT\3sSN"); /* route an agent directly */
   
 //  fescape("commserver",m_commserver,47,False,"Fth")             // Pick up communications server handle
 
   fescape("__getmsg",m_getmsg,169,False,"FT\1NT\5AhhLu'" MSG_ATTR_TYPE "'N");
   fescape("__nextmsg",m_nextmsg,170,False,"FT\1NT\5AhhLu'" MSG_ATTR_TYPE "'N");
+  fescape("__selectmsg",m_selectmsg,34,False,"FT\2NLAT\5AhhLu'" MSG_ATTR_TYPE "'N");
   fescape("__waitmsg",m_waitmsg,171,False,"FT\2NNT\5AhhLu'" MSG_ATTR_TYPE "'N");
+  fescape("__selectwait",m_selectwait,27,False,"FT\3NLANT\5AhhLu'" MSG_ATTR_TYPE "'N");
   pescape("__replacemsg",m_replacemsg,172,False,"PT\4AhLu'" MSG_ATTR_TYPE "'N");
   pescape("wait_for_msg",m_wait_msg,173,False,"Pt"); /* wait for a message */
   fescape("messages",m_messages,174,False,"FtN"); /* Count o/s messages */
@@ -292,4 +311,6 @@
   fescape("__dll_fcall_",m_dll_call,250,True,":\1:\2FT\3ON$\1$\2");
   pescape("__dll_pcall_",m_dll_call,251,True,":\1PT\3ON$\1");
 
-/* Last escape = 251 */
+  pescape("hibernate",m_hibernate,252,False,"Pt"); /* sleep until next message */
+
+/* Last escape = 252 */
@@ -143,6 +143,8 @@ instruction(self,97,"l","N") /* id of current process */
 
 instruction(die,98,"","T\0") /* kill off current sub-process */
 
+instruction(lazy,109,"","T\0") /* load the rest of the code on its first call */
+
 instruction(use,99,"ml","T\2NN")	/* use a new click counter */
 
 instruction(line_d,100,"hyo","T\3NSN") /* report debugging info */
@@ -159,4 +161,21 @@ instruction(suspend_d,111,"l","N") /* suspend process */
 instruction(error_d,112,"ml","T\2NN") /* report error */
 instruction(debug_d,113,"b","T\1s") /* are we debugging? */
 
+/* Superinstructions -- an instruction fused with the one that follows it.
+   The following instruction is left in place, and is executed as part of
+   the superinstruction */
+instruction(ieqjmp,114,"ml","T\2NN") /* ieq and the following jmp */
+instruction(ineqjmp,115,"ml","T\2NN") /* ineq and the following jmp */
+instruction(ilejmp,116,"ml","T\2NN") /* ile and the following jmp */
+instruction(igtjmp,117,"ml","T\2NN") /* igt and the following jmp */
+instruction(mlistjmp,118,"hml","T\3NNN") /* mlist and the following jmp */
+instruction(movlesc,119,"th","T\2$\0N") /* movl and the following esc_fun */
+instruction(emovecall,120,"ml","T\2NN") /* emove and the following call */
+instruction(lstprs,121,"hml","T\3NNN") /* lstpr and the following lstpr */
+
+/* Tail calls -- the callee takes over the caller's frame, and returns
+   directly to the caller's caller */
+instruction(tcall,122,"hml","T\3NNN") /* tail call procedure */
+instruction(etcall,123,"hml","T\3NNN") /* tail call environment procedure */
+
 